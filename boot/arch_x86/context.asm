@@ -1,22 +1,16 @@
-; Cooperative task context switch (x86 only).
+; Task context switch (x86 only). Saved contexts are irq_frame_t frames
+; built by isr_common (isr.asm), so a yield and a timer preemption leave a
+; task in the same shape.
 [BITS 32]
 section .note.GNU-stack noalloc noexec nowrite progbits
 section .text
 
 global task_yield_asm
-global run_scheduler_asm
 
-; void task_yield_asm(uint32_t *save_esp, uint32_t load_esp)
+IRQ_YIELD_VECTOR equ 0x30           ; keep in sync with irq.h
+
+; void task_yield_asm(void): trap into the scheduler like a timer tick.
 task_yield_asm:
-    pusha
-    mov eax, [esp + 36]     ; save_esp (pusha adds 32 bytes)
-    mov [eax], esp
-    mov esp, [esp + 40]     ; load_esp
-    popa
+    int IRQ_YIELD_VECTOR
     ret
 
-; void run_scheduler_asm(uint32_t load_esp)
-run_scheduler_asm:
-    mov esp, [esp + 4]
-    popa
-    ret
@@ -6,7 +6,10 @@ section .text
 
 global disable_interrupts_asm
 global enable_interrupts_asm
+global irq_save_asm
+global irq_restore_asm
 global cpu_pause
+global cpu_idle_asm
 global system_reboot
 
 disable_interrupts_asm:
@@ -17,10 +20,33 @@ enable_interrupts_asm:
     sti
     ret
 
+; uint32_t irq_save_asm(void): return EFLAGS, then disable interrupts.
+irq_save_asm:
+    pushfd
+    pop eax
+    cli
+    ret
+
+; void irq_restore_asm(uint32_t flags): re-enable only if IF was set.
+irq_restore_asm:
+    test dword [esp + 4], 0x200
+    jz .masked
+    sti
+.masked:
+    ret
+
 cpu_pause:
     pause
     ret
 
+; void cpu_idle_asm(void): enable interrupts and halt until the next one.
+; sti holds off interrupts for one instruction, so an IRQ that arrives after
+; the caller's last check still ends the hlt instead of being missed.
+cpu_idle_asm:
+    sti
+    hlt
+    ret
+
 ; Warm reset via QEMU/PC chipset reset register.
 system_reboot:
     mov dx, 0xCF9
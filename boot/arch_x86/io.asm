@@ -7,6 +7,8 @@ global inb
 global outb
 global inw
 global outw
+global inl
+global outl
 
 ; uint8_t inb(uint16_t port)
 inb:
@@ -33,3 +35,16 @@ outw:
     mov eax, [esp + 8]
     out dx, ax
     ret
+
+; uint32_t inl(uint16_t port)
+inl:
+    mov edx, [esp + 4]
+    in eax, dx
+    ret
+
+; void outl(uint16_t port, uint32_t value)
+outl:
+    mov edx, [esp + 4]
+    mov eax, [esp + 8]
+    out dx, eax
+    ret
@@ -0,0 +1,136 @@
+; IDT entry stubs: every vector funnels into isr_common, which saves the
+; full register frame on the current stack and lets the C dispatcher pick
+; the frame to resume (another task's, for a context switch).
+[BITS 32]
+
+section .note.GNU-stack noalloc noexec nowrite progbits
+section .text
+
+global isr_stub_table
+global isr_return
+global idt_load_asm
+extern isr_dispatch
+extern isr_switched
+
+ISR_STUB_COUNT equ 64               ; 0-31 exceptions, 32-47 PIC, 48 yield,
+                                    ; 49-63 local APIC (IPI, timer, spurious)
+
+%macro ISR_NOERR 1
+isr_stub_%+%1:
+    push dword 0
+    push dword %1
+    jmp isr_common
+%endmacro
+
+%macro ISR_ERR 1
+isr_stub_%+%1:
+    push dword %1
+    jmp isr_common
+%endmacro
+
+ISR_NOERR 0
+ISR_NOERR 1
+ISR_NOERR 2
+ISR_NOERR 3
+ISR_NOERR 4
+ISR_NOERR 5
+ISR_NOERR 6
+ISR_NOERR 7
+ISR_ERR   8
+ISR_NOERR 9
+ISR_ERR   10
+ISR_ERR   11
+ISR_ERR   12
+ISR_ERR   13
+ISR_ERR   14
+ISR_NOERR 15
+ISR_NOERR 16
+ISR_ERR   17
+ISR_NOERR 18
+ISR_NOERR 19
+ISR_NOERR 20
+ISR_ERR   21
+ISR_NOERR 22
+ISR_NOERR 23
+ISR_NOERR 24
+ISR_NOERR 25
+ISR_NOERR 26
+ISR_NOERR 27
+ISR_NOERR 28
+ISR_ERR   29
+ISR_ERR   30
+ISR_NOERR 31
+ISR_NOERR 32
+ISR_NOERR 33
+ISR_NOERR 34
+ISR_NOERR 35
+ISR_NOERR 36
+ISR_NOERR 37
+ISR_NOERR 38
+ISR_NOERR 39
+ISR_NOERR 40
+ISR_NOERR 41
+ISR_NOERR 42
+ISR_NOERR 43
+ISR_NOERR 44
+ISR_NOERR 45
+ISR_NOERR 46
+ISR_NOERR 47
+ISR_NOERR 48
+ISR_NOERR 49
+ISR_NOERR 50
+ISR_NOERR 51
+ISR_NOERR 52
+ISR_NOERR 53
+ISR_NOERR 54
+ISR_NOERR 55
+ISR_NOERR 56
+ISR_NOERR 57
+ISR_NOERR 58
+ISR_NOERR 59
+ISR_NOERR 60
+ISR_NOERR 61
+ISR_NOERR 62
+ISR_NOERR 63
+
+; Frame layout must match irq_frame_t in irq.h.
+isr_common:
+    pusha
+    push ds
+    push es
+    push fs
+    push gs
+    mov ax, ss
+    mov ds, ax
+    mov es, ax
+    cld
+    push esp                ; irq_frame_t *
+    call isr_dispatch       ; returns the frame to resume
+    add esp, 4
+    cmp eax, esp
+    mov esp, eax
+    je isr_return
+    call isr_switched       ; on the new task's stack
+isr_return:
+    pop gs
+    pop fs
+    pop es
+    pop ds
+    popa
+    add esp, 8              ; vector + error code
+    iret
+
+; void idt_load_asm(const void *idtr)
+idt_load_asm:
+    mov eax, [esp + 4]
+    lidt [eax]
+    ret
+
+section .data
+align 4
+isr_stub_table:
+%assign v 0
+%rep ISR_STUB_COUNT
+    dd isr_stub_%+v
+%assign v v + 1
+%endrep
@@ -1,4 +1,5 @@
-; PS/2 keyboard scancode set 1 → ASCII and polling helpers.
+; PS/2 keyboard scancode set 1 → ASCII and helpers on top of the IRQ1
+; scancode ring in src/keyboard.c.
 [BITS 32]
 
 section .note.GNU-stack noalloc noexec nowrite progbits
@@ -8,6 +9,9 @@ global scancode_to_ascii
 global keyboard_poll_scancode
 global read_key
 
+extern keyboard_get_scancode
+extern keyboard_wait
+
 section .rodata
 ; scancode (set1) index table for 0x00..0x39
 asc_unshift:
@@ -42,29 +46,25 @@ scancode_to_ascii:
     xor al, al
     ret
 
-; int keyboard_poll_scancode(void) — scancode in eax, 0 if none
+; int keyboard_poll_scancode(void) — next queued scancode in eax, 0 if none
 keyboard_poll_scancode:
+    push ecx
     push edx
-    mov dx, 0x64
-    in al, dx
-    test al, 1
-    jz .none
-    mov dx, 0x60
-    in al, dx
+    call keyboard_get_scancode
     movzx eax, al
     pop edx
-    ret
-.none:
-    xor eax, eax
-    pop edx
+    pop ecx
     ret
 
-; int read_key(void) — blocking ASCII key
+; int read_key(void) — blocking ASCII key; sleeps until IRQ1 queues one
 read_key:
     push ebx
     push esi
     mov esi, 0
+    jmp .next
 .wait:
+    call keyboard_wait
+.next:
     call keyboard_poll_scancode
     test eax, eax
     jz .wait
@@ -80,20 +80,19 @@ read_key:
     cmp bl, 0x1C
     je .enter
     push esi
-    mov ecx, ebx
-    mov edx, 0
+    push ebx
     call scancode_to_ascii
-    pop esi
+    add esp, 8
     test al, al
-    jz .wait
+    jz .next
     movzx eax, al
     jmp .done
 .shift_on:
     mov esi, 1
-    jmp .wait
+    jmp .next
 .shift_off:
     xor esi, esi
-    jmp .wait
+    jmp .next
 .enter:
     mov al, 13
     movzx eax, al
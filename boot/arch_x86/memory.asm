@@ -7,6 +7,7 @@ section .text
 
 global get_memory_info
 global detect_ps2_memory
+global get_boot_params
 
 ; uint32_t detect_ps2_memory(void) — returns megabytes
 detect_ps2_memory:
@@ -22,3 +23,8 @@ get_memory_info:
     call detect_ps2_memory
     shl eax, 10
     ret
+
+; const boot_params_t *get_boot_params(void) — E820 map left by the loader
+get_boot_params:
+    mov eax, BOOT_PARAMS_PHYS
+    ret
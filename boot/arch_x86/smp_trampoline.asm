@@ -0,0 +1,66 @@
+; AP startup trampoline (x86 SMP). smp_init copies smp_trampoline_start ..
+; smp_trampoline_end to SMP_TRAMPOLINE_PHYS and patches smp_tr_params; a
+; STARTUP IPI then runs it in real mode at that page. It loads the kernel
+; GDT, enters protected mode and far-jumps to smp_ap_entry in the kernel.
+[BITS 16]
+
+section .note.GNU-stack noalloc noexec nowrite progbits
+section .text
+
+global smp_trampoline_start
+global smp_trampoline_end
+global smp_tr_params
+global smp_ap_entry
+extern smp_ap_main
+
+SMP_TRAMPOLINE_PHYS equ 0x7000      ; keep in sync with smp.h
+
+; Address of a trampoline label once copied.
+%define TR(x) ((x) - smp_trampoline_start + SMP_TRAMPOLINE_PHYS)
+
+smp_trampoline_start:
+    cli
+    cld
+    xor ax, ax
+    mov ds, ax
+    o32 lgdt [TR(tr_gdtr)]
+    mov eax, cr0
+    or al, 1
+    mov cr0, eax
+    o32 jmp far [TR(tr_entry)]      ; 16:32 pointer: kernel cs:smp_ap_entry
+
+; Layout must match smp_tr_params_t in hal_smp.c.
+align 4
+smp_tr_params:
+tr_gdtr:
+    dw 0                            ; limit
+    dd 0                            ; base
+tr_entry:
+    dd 0                            ; smp_ap_entry
+    dw 0                            ; kernel cs
+tr_ds:
+    dw 0
+tr_stack:
+    dd 0
+tr_cpu:
+    dd 0
+smp_trampoline_end:
+
+; Protected mode, running in place in the kernel image. DS still has the
+; real-mode base of 0 cached, so the parameters can be read before the
+; kernel selectors are loaded.
+[BITS 32]
+smp_ap_entry:
+    mov ax, [TR(tr_ds)]
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+    mov ss, ax
+    mov esp, [TR(tr_stack)]
+    push dword [TR(tr_cpu)]
+    call smp_ap_main                ; never returns
+.hang:
+    cli
+    hlt
+    jmp .hang
@@ -13,6 +13,7 @@ global sys_graphics_init
 global exit_program
 
 extern keyboard_poll_scancode
+extern keyboard_wait
 extern scancode_to_ascii
 extern vga_putchar
 extern print_string
@@ -73,7 +74,10 @@ sys_read_line:
 .rl_loop:
     call keyboard_poll_scancode
     test eax, eax
-    jz .rl_loop
+    jnz .rl_key
+    call keyboard_wait          ; sleep until IRQ1 queues a scancode
+    jmp .rl_loop
+.rl_key:
     mov ecx, eax
     cmp cl, 0x2A
     je .sh_on
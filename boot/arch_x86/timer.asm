@@ -1,4 +1,4 @@
-; PIT channel 0 + TSC fallback for timing syscalls.
+; PIT channel 0 programming; time reads go to the calibrated clocksource.
 [BITS 32]
 
 section .note.GNU-stack noalloc noexec nowrite progbits
@@ -11,6 +11,8 @@ section .text
 global sys_timer_init
 global sys_timer_get
 
+extern plat_ticks_ms
+
 ; Program PIT channel 0 to ~100 Hz and latch initial count.
 sys_timer_init:
     mov al, 0x34
@@ -22,10 +24,6 @@ sys_timer_init:
     mov dword [pit_latch], 0
     ret
 
-; Return milliseconds since init using TSC (real time, no stub counter).
+; Milliseconds since boot (platform/x86/hal_clock.c).
 sys_timer_get:
-    rdtsc
-    mov ecx, 100000
-    xor edx, edx
-    div ecx
-    ret
+    jmp plat_ticks_ms
@@ -9,6 +9,7 @@
 %define ROOT_SEG 0x1100
 %define BPB_DRIVE 0x7C24
 %include "debugcon.asm"
+%include "arch_x86/boot_params.inc"
 
 loader_entry:
     mov dl, [BPB_DRIVE]
@@ -19,6 +20,7 @@ loader_entry:
     call fatload_kernel
     mov si, dbg_loaded
     call debug_puts
+    call probe_e820
     mov si, ok_msg
     call print_string
     call switch_to_pm
@@ -109,6 +111,63 @@ fatload_kernel:
     popa
     ret
 
+; INT 15h E820 memory map -> BOOT_PARAMS_PHYS (count + entries), plus the
+; top of usable RAM below 4 GB in MB for detect_ps2_memory(). DS = 0 here.
+probe_e820:
+    pushad
+    push es
+    xor ax, ax
+    mov es, ax
+    mov di, BOOT_PARAMS_PHYS + BOOT_PARAM_E820_MAP
+    xor ebx, ebx
+    xor bp, bp
+.e820_next:
+    mov eax, 0xE820
+    mov edx, 0x534D4150
+    mov ecx, BOOT_E820_ENTRY
+    mov dword [es:di + 20], 1
+    int 0x15
+    jc .e820_end
+    cmp eax, 0x534D4150
+    jne .e820_end
+    jcxz .e820_skip
+    inc bp
+    add di, BOOT_E820_ENTRY
+    cmp bp, BOOT_E820_MAX
+    jae .e820_end
+.e820_skip:
+    test ebx, ebx
+    jnz .e820_next
+.e820_end:
+    movzx eax, bp
+    mov [BOOT_PARAMS_PHYS + BOOT_PARAM_E820_COUNT], eax
+    xor esi, esi
+    mov di, BOOT_PARAMS_PHYS + BOOT_PARAM_E820_MAP
+    mov cx, bp
+    jcxz .e820_store
+.e820_scan:
+    cmp dword [di + 16], 1
+    jne .e820_scan_next
+    cmp dword [di + 4], 0
+    jne .e820_scan_next
+    mov eax, [di]
+    add eax, [di + 8]
+    jnc .e820_have_end
+    mov eax, 0xFFFFFFFF
+.e820_have_end:
+    cmp eax, esi
+    jbe .e820_scan_next
+    mov esi, eax
+.e820_scan_next:
+    add di, BOOT_E820_ENTRY
+    loop .e820_scan
+.e820_store:
+    shr esi, 20
+    mov [BOOT_PARAMS_PHYS + BOOT_PARAM_MEM_MB], esi
+    pop es
+    popad
+    ret
+
 read_lba:
 .read_loop:
     push eax
@@ -0,0 +1,18 @@
+#ifndef ACPI_H
+#define ACPI_H
+
+#include <stdint.h>
+
+/* Minimal ACPI table lookup (platform/x86/hal_acpi.c): RSDP in the BIOS
+ * area -> RSDT -> the first table with a matching signature. Tables are
+ * used in place (identity-mapped, no paging). */
+
+#define ACPI_SDT_HDR_LEN  36        /* signature, length, ..., creator */
+
+/* Checksummed table with signature sig (4 chars, e.g. "HPET"), or NULL. */
+const uint8_t *acpi_find_table(const char *sig);
+
+/* Length field of a table returned by acpi_find_table. */
+uint32_t acpi_table_len(const uint8_t *table);
+
+#endif /* ACPI_H */
@@ -0,0 +1,61 @@
+#ifndef ATA_H
+#define ATA_H
+
+#include <stdint.h>
+
+/* ATA primary channel, master drive (platform/x86/hal_ata.c). Requests go
+ * through one queue and run in order, each as few commands as possible:
+ * READ/WRITE DMA through the PCI IDE bus master when there is one, else
+ * READ/WRITE MULTIPLE with IRQ14 moving each DRQ block (ata_multiple
+ * sectors). A DMA command that fails is retried with PIO. IRQ14 also
+ * starts the next command, so a caller can ata_submit, keep working and ata_wait later
+ * (its task sleeps meanwhile instead of spinning on the status port).
+ * Until the scheduler preempts (boot, fs init with interrupts off) a
+ * request runs polled to completion inside ata_submit. */
+
+#define ATA_IRQ             14
+#define ATA_SECTOR_SIZE     512
+#define ATA_CMD_SECTORS_MAX 256     /* LBA28 sector count (written as 0) */
+#define ATA_MULTIPLE_MAX    16      /* sectors per DRQ block we ask for */
+#define ATA_IRQ_WAIT_MS     100     /* then check the status port (lost IRQ) */
+#define ATA_TIMEOUT_MS      5000    /* drive still busy: fail the request */
+
+#define ATA_REQ_PENDING     0
+#define ATA_REQ_DONE        1
+#define ATA_REQ_ERROR       (-1)
+
+typedef struct ata_req {
+    uint32_t lba;
+    uint32_t count;             /* sectors */
+    void *buf;                  /* count * ATA_SECTOR_SIZE bytes */
+    uint8_t write;
+    volatile int8_t status;     /* ATA_REQ_* */
+    uint8_t pio;                /* DMA failed: PIO for the rest */
+    uint32_t done;              /* sectors transferred */
+    int waiter;                 /* task sleeping in ata_wait, -1 = none */
+    struct ata_req *next;
+} ata_req_t;
+
+/* Identify the drive, set up multiple mode and DMA, hook IRQ14; called
+ * from plat_init. */
+void ata_init(void);
+
+/* Queue r (lba, count, buf, write filled in); r must stay valid until it
+ * completes. Returns 0, or -1 for a bad request. */
+int ata_submit(ata_req_t *r);
+
+/* Sleep until r completes: 0 done, -1 drive error or timeout. */
+int ata_wait(ata_req_t *r);
+
+/* Synchronous helpers (submit + wait). */
+int ata_read(uint32_t lba, uint32_t count, void *buf);
+int ata_write(uint32_t lba, uint32_t count, const void *buf);
+
+/* Sectors per DRQ block in use (1 if the drive has no multiple mode). */
+uint32_t ata_multiple(void);
+
+/* Assembly side (disk_io.asm): count sectors through the data port. */
+void ata_pio_read_sectors(void *buf, uint32_t count);
+void ata_pio_write_sectors(const void *buf, uint32_t count);
+
+#endif /* ATA_H */
@@ -0,0 +1,56 @@
+#ifndef BCACHE_H
+#define BCACHE_H
+
+#include <stdint.h>
+
+/* Sector buffer cache between the FAT12 code (platform/x86/hal_storage.c,
+ * src/fat12.c) and the block device: BCACHE_ENTRIES sectors hashed by
+ * LBA with LRU replacement. Misses are read as whole runs in one device
+ * request, straight into the caller's buffer. Writes of up to
+ * BCACHE_WRITE_MAX sectors only dirty the cache; bcache_sync writes the
+ * dirty sectors back in LBA order, consecutive ones as one request. Sync
+ * runs on demand, before a dirty sector is evicted, and from bcache_tick
+ * once data has been dirty for BCACHE_WRITEBACK_MS. Longer writes go to
+ * the device directly. One device at a time. Every call holds a sleeping
+ * task lock across its device requests, so a write-back never races a
+ * foreground read or write; bcache_tick skips a tick the lock is held. */
+
+#define BCACHE_SECTOR_SIZE   512
+#define BCACHE_ENTRIES       128     /* 64 KB of sectors */
+#define BCACHE_HASH          64      /* buckets, power of two */
+#define BCACHE_FILL_MAX      (BCACHE_ENTRIES / 2)   /* longer miss runs are not kept */
+#define BCACHE_WRITE_MAX     16      /* longer writes bypass the cache */
+#define BCACHE_WRITEBACK_MS  2000
+
+typedef struct {
+    int (*read)(void *ctx, uint32_t lba, uint32_t count, void *buf);
+    int (*write)(void *ctx, uint32_t lba, uint32_t count, const void *buf);
+    void *ctx;
+} bcache_dev_t;
+
+typedef struct {
+    uint32_t hits;          /* sectors served from the cache */
+    uint32_t misses;        /* sectors read from the device */
+    uint32_t writebacks;    /* dirty sectors written back */
+    uint32_t evictions;
+    uint32_t dirty;         /* dirty sectors now */
+    uint32_t cached;        /* valid sectors now */
+} bcache_stats_t;
+
+/* Cache dev from now on; syncs and drops anything from the previous one. */
+void bcache_attach(const bcache_dev_t *dev);
+
+/* 0, or -1 with no device or on a device error. */
+int bcache_read(uint32_t lba, uint32_t count, void *buf);
+int bcache_write(uint32_t lba, uint32_t count, const void *buf);
+int bcache_sync(void);
+
+/* Sync, then forget every sector (benchmarks, media change). */
+int bcache_invalidate(void);
+
+/* Write-back timer: sync once data has been dirty BCACHE_WRITEBACK_MS. */
+void bcache_tick(void);
+
+void bcache_get_stats(bcache_stats_t *out);
+
+#endif /* BCACHE_H */
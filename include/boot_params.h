@@ -0,0 +1,30 @@
+#ifndef BOOT_PARAMS_H
+#define BOOT_PARAMS_H
+
+#include <stdint.h>
+
+/* C view of boot/arch_x86/boot_params.inc — keep the two in sync. */
+
+#define BOOT_PARAMS_PHYS        0x00000500u
+#define BOOT_E820_MAX           16
+#define BOOT_E820_USABLE        1
+
+typedef struct {
+    uint64_t base;
+    uint64_t length;
+    uint32_t type;
+    uint32_t acpi_attrs;
+} __attribute__((packed)) boot_e820_entry_t;
+
+typedef struct {
+    uint32_t mem_mb;
+    uint32_t drive;
+    uint32_t e820_count;
+    uint32_t reserved;
+    boot_e820_entry_t e820[BOOT_E820_MAX];
+} __attribute__((packed)) boot_params_t;
+
+/* boot/arch_x86/memory.asm */
+const boot_params_t *get_boot_params(void);
+
+#endif /* BOOT_PARAMS_H */
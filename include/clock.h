@@ -0,0 +1,24 @@
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include <stdint.h>
+
+/* x86 clocksource (platform/x86/hal_clock.c): the TSC, calibrated once at
+ * boot against the HPET main counter when ACPI describes one, otherwise
+ * against PIT channel 2. Without a usable TSC the scheduler tick is the
+ * clock (SCHED_TICK_MS resolution). plat_ticks_ns/us/ms read it. */
+
+#define CLOCK_CALIBRATE_MS  10
+
+typedef enum {
+    CLOCK_SRC_TICK = 0,     /* no TSC: scheduler ticks */
+    CLOCK_SRC_TSC_PIT,
+    CLOCK_SRC_TSC_HPET
+} clock_src_t;
+
+/* Calibrate; call once from plat_init with interrupts off. */
+void clock_init(void);
+
+clock_src_t clock_source(void);
+
+#endif /* CLOCK_H */
@@ -16,6 +16,7 @@ typedef struct {
     block_dev_t *dev;
     uint8_t fat[FAT12_SECTORS_PER_FAT * BLOCK_SECTOR_SIZE];
     uint8_t root[FAT12_ROOT_SECTORS * BLOCK_SECTOR_SIZE];
+    uint32_t fat_dirty;     /* FAT copy 1 sectors not yet mirrored to copy 2 */
     int ready;
 } fat12_fs_t;
 
@@ -27,6 +28,10 @@ int  fat12_find_entry(const fat12_fs_t *fs, const char *name83, int *slot_out);
 int  fat12_read_file(const fat12_fs_t *fs, const char *name83, void *buf, uint32_t max, uint32_t *out_size);
 int  fat12_write_sector(fat12_fs_t *fs, uint32_t lba, const void *buf);
 int  fat12_read_sector(const fat12_fs_t *fs, uint32_t lba, void *buf);
+/* Sector I/O goes through the shared cache (bcache.h), attached by
+ * fat12_mount. Writes to FAT copy 1 are mirrored to copy 2 by
+ * fat12_sync, which then writes dirty sectors back. */
+int  fat12_sync(fat12_fs_t *fs);
 void fat12_normalize_name(const char *src, char *dest83);
 
 #endif /* FAT12_H */
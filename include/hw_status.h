@@ -15,6 +15,11 @@ typedef struct {
     uint32_t free_kb;
     uint32_t used_kb;
     uint32_t kernel_kb;
+    uint32_t heap_used_kb;       /* live heap payload */
+    uint32_t heap_peak_kb;
+    uint32_t heap_largest_free_kb;
+    uint32_t heap_frag_pct;      /* external fragmentation of free heap */
+    uint32_t heap_failed;        /* failed allocations since boot */
 } hw_memstat_t;
 
 typedef struct {
@@ -25,7 +30,7 @@ typedef struct {
 
 typedef struct {
     int running;
-    uint32_t load_percent;   /* 0–100 */
+    uint32_t load_percent;   /* 0–100, time in I/O subsystem ticks since last query */
     char status[32];
 } hw_iop_status_t;
 
@@ -46,7 +51,7 @@ typedef struct {
     char model[HW_STATUS_MODEL_LEN];
     uint32_t ee_mhz;
     uint32_t ram_mb;
-    uint32_t ee_load_percent;    /* 0–100, estimated */
+    uint32_t ee_load_percent;    /* 0–100, busy share of all cores since last query */
     hw_memstat_t memstat;
     hw_port_status_t ports[HW_STATUS_MAX_PORTS];
     hw_iop_status_t iop;
@@ -0,0 +1,81 @@
+#ifndef IRQ_H
+#define IRQ_H
+
+#include <stdint.h>
+
+/* x86 interrupt plumbing: IDT, 8259 PIC remapped to IRQ_BASE_VECTOR, a
+ * software vector the scheduler uses for cooperative yields and the local
+ * APIC vectors used once other cores are up (smp.h). Every vector
+ * enters through isr_common (boot/arch_x86/isr.asm), which saves a full
+ * irq_frame_t; a handler returns the frame to resume, so returning another
+ * task's saved frame switches to that task. */
+
+#define IRQ_BASE_VECTOR   0x20
+#define IRQ_LINES         16
+#define IRQ_YIELD_VECTOR  0x30      /* context.asm: task_yield_asm */
+#define IRQ_RESCHED_VECTOR 0x31     /* IPI: work was queued for this core */
+#define IRQ_LAPIC_TIMER_VECTOR 0x32 /* per-core scheduler tick on APs */
+#define IRQ_LAPIC_FIRST   IRQ_RESCHED_VECTOR
+#define IRQ_SPURIOUS_VECTOR 0x3F    /* low nibble all ones for P6 APICs */
+#define IRQ_VECTORS       (IRQ_SPURIOUS_VECTOR + 1)
+
+#define IRQ_TIMER         0
+#define IRQ_KEYBOARD      1
+#define PIT_HZ            100       /* sys_timer_init: channel 0, divisor 11932 */
+#define PIT_DIVISOR       11932
+#define PIT_ONESHOT_MAX_TICKS  5    /* 16-bit count: 5 * 11932 < 65536 */
+
+/* Pushed by isr_common, lowest address first. */
+typedef struct irq_frame {
+    uint32_t gs, fs, es, ds;
+    uint32_t edi, esi, ebp, esp_dummy, ebx, edx, ecx, eax;
+    uint32_t vector, err;
+    uint32_t eip, cs, eflags;       /* pushed by the CPU (same privilege) */
+} irq_frame_t;
+
+typedef irq_frame_t *(*irq_handler_t)(irq_frame_t *f);
+
+/* Build the IDT and remap the PIC (all lines masked). Call with IF clear. */
+void irq_init(void);
+
+/* Handler for PIC line irq (0-15); unmasks the line. */
+int irq_register(int irq, irq_handler_t fn);
+
+/* Handler for any vector (e.g. IRQ_YIELD_VECTOR); the line is not touched. */
+int irq_set_vector(int vector, irq_handler_t fn);
+
+/* Runs after every IRQ/yield handler with the frame about to be resumed
+ * (the scheduler uses it to preempt when a handler woke a better task). */
+void irq_set_exit_hook(irq_handler_t fn);
+
+/* Runs on the new stack when a handler returned a different frame, before
+ * the iret into it (the scheduler drops its lock there, once nothing on
+ * this core still uses the old task's stack). */
+void irq_set_switch_hook(void (*fn)(void));
+
+/* 1 while a registered handler is running on this core. */
+int irq_in_handler(void);
+
+/* Application processors: load the IDT built by irq_init. */
+void irq_init_ap(void);
+
+void irq_mask(int irq);
+void irq_unmask(int irq);
+
+/* Kernel code/data selectors captured at irq_init, for building frames. */
+uint16_t irq_kernel_cs(void);
+uint16_t irq_kernel_ds(void);
+
+/* PIT channel 0 (hal_system.c). Tickless idle replaces the periodic tick
+ * with one interrupt after ticks periods (1..PIT_ONESHOT_MAX_TICKS), then
+ * asks how many whole periods passed if something else woke the CPU. */
+void pit_set_periodic(void);
+void pit_set_oneshot(uint32_t ticks);
+uint32_t pit_oneshot_elapsed(uint32_t ticks);   /* ticks if it already fired */
+
+/* Assembly side (isr.asm / interrupts.asm). */
+void idt_load_asm(const void *idtr);
+uint32_t irq_save_asm(void);
+void irq_restore_asm(uint32_t flags);
+
+#endif /* IRQ_H */
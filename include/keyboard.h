@@ -3,14 +3,36 @@
 
 #include <stdint.h>
 
-/* PC keyboard via ports 0x60/0x64. No-op when PS2_HARDWARE (use controller). */
+/* PC keyboard via ports 0x60/0x64. No-op when PS2_HARDWARE (use controller).
+ * After keyboard_init, IRQ1 queues every scancode with the time it arrived,
+ * so keys pressed while a frame draws or the disk is busy are kept (up to
+ * KBD_RING_SIZE). There is one consumer at a time: the foreground task. */
 
-/* Returns 1 if a key event is available in the controller buffer. */
+#define KBD_RING_SIZE  64       /* power of two */
+
+typedef struct {
+    uint8_t scancode;
+    uint64_t time_us;           /* plat_ticks_us() when IRQ1 fired */
+} kbd_event_t;
+
+/* Hook IRQ1 (input subsystem init); before this the controller is polled. */
+void keyboard_init(void);
+
+/* Returns 1 if a key event is queued. */
 int keyboard_has_key(void);
 
 /* Returns next scancode (make or break). 0 if no data. Break = 0x80 | make. */
 uint8_t keyboard_get_scancode(void);
 
+/* Next event with its timestamp; 0 if none. */
+int keyboard_get_event(kbd_event_t *out);
+
+/* Sleep until a key is queued (falls back to plat_idle without IRQs). */
+void keyboard_wait(void);
+
+/* Events lost because the ring was full. */
+uint32_t keyboard_dropped(void);
+
 /* Scancode set 1 (XT): arrow keys and common keys */
 #define SCAN_UP    0x48
 #define SCAN_DOWN  0x50
@@ -0,0 +1,50 @@
+#ifndef KTIMER_H
+#define KTIMER_H
+
+#include <stdint.h>
+
+/* Timer wheel: one-shot and periodic callbacks on the platform clock
+ * (plat_ticks_ms) at KTIMER_TICK_MS resolution, a power of two so slot
+ * numbers stay continuous when the millisecond counter wraps. Timers are
+ * caller-owned (no allocation). Callbacks run in task context from
+ * ktimer_run(): the timer task when the scheduler is preemptive, else the
+ * shell loop. A callback may start or cancel any timer, including its own.
+ * Starting and cancelling are safe from IRQ handlers. */
+
+#define KTIMER_TICK_SHIFT  3
+#define KTIMER_TICK_MS   (1u << KTIMER_TICK_SHIFT)
+#define KTIMER_SLOTS     64     /* power of two */
+#define KTIMER_NONE      0xFFFFFFFFu
+
+typedef void (*ktimer_fn_t)(void *arg);
+
+typedef struct ktimer {
+    ktimer_fn_t fn;
+    void *arg;
+    uint32_t expires;           /* ms, on a tick boundary */
+    uint32_t period;            /* ms, whole ticks; 0 = one-shot */
+    struct ktimer *next;
+    uint8_t active;
+} ktimer_t;
+
+void ktimer_init(ktimer_t *t, ktimer_fn_t fn, void *arg);
+
+/* Fire at the first tick boundary at least delay_ms away, then every
+ * period_ms (whole ticks) if non-zero. Restarts a pending timer. */
+void ktimer_start(ktimer_t *t, uint32_t delay_ms, uint32_t period_ms);
+
+/* 1 if it was pending. */
+int ktimer_cancel(ktimer_t *t);
+
+int ktimer_pending(const ktimer_t *t);
+
+/* Run every expired callback; returns how many ran. */
+int ktimer_run(void);
+
+/* Milliseconds until the earliest pending timer, KTIMER_NONE if none. */
+uint32_t ktimer_next_ms(void);
+
+/* Timer task body: run callbacks, sleep until the next one is due. */
+void ktimer_task(void);
+
+#endif /* KTIMER_H */
@@ -0,0 +1,25 @@
+#ifndef LZ_H
+#define LZ_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* LZ block codec: byte-oriented LZ77 with LZ4-style sequences (token,
+ * literals, 16-bit offset) for swap chunks, save files and snapshots.
+ * A block is one tag byte followed by either sequences or the raw input,
+ * so output never exceeds LZ_BOUND(len). */
+
+#define LZ_BLOCK_STORED   0
+#define LZ_BLOCK_LZ       1
+#define LZ_BOUND(len)     ((len) + 1)
+
+/* Compress len bytes into dst (dst_cap >= LZ_BOUND(len)). Falls back to a
+ * stored block when matching does not pay off. Returns bytes written, or 0
+ * if dst_cap is too small. Uses a static match table: not reentrant. */
+size_t lz_compress(const void *src, size_t len, void *dst, size_t dst_cap);
+
+/* Decode one block. Every read and write is bounds-checked; returns -1 on a
+ * malformed block or if the output would exceed dst_cap. */
+int lz_decompress(const void *src, size_t len, void *dst, size_t dst_cap, size_t *out_len);
+
+#endif /* LZ_H */
@@ -8,9 +8,14 @@
  * evict to external storage (swap) so we never assume "infinite" RAM. */
 
 #define BUDGET_REGION_MAX    8
+#define BUDGET_SHRINKER_MAX  8
 #define SWAP_SLOT_MAX        32
 #define SWAP_CHUNK_SIZE      4096   /* 4KB eviction unit */
+#define SWAP_FILE_CHUNKS     64     /* swap file = 256KB of chunk slots */
 #define PS2_RAM_BYTES        (32 * 1024 * 1024)
+#define SWAP_PATH_DEFAULT    "SWAP.SYS"
+#define SWAP_WATERMARK_HIGH  90     /* % pressure that starts LRU eviction */
+#define SWAP_WATERMARK_LOW   75     /* evict until pressure drops below this */
 
 typedef enum {
     BUDGET_KERNEL = 0,
@@ -25,21 +30,40 @@ typedef enum {
 
 typedef struct {
     uint32_t limit_kb;      /* max KB for this region */
-    uint32_t used_kb;       /* current usage */
+    uint32_t used_bytes;    /* current usage */
     const char *name;
 } budget_entry_t;
 
+/* Shrinker: release up to want_bytes from a cache; returns bytes released. */
+typedef size_t (*budget_shrink_fn)(size_t want_bytes, void *ctx);
+
 typedef struct {
     int in_use;
-    uint32_t offset;        /* offset in swap file (chunk index) */
+    uint32_t offset;        /* slot index */
     void *local_ptr;       /* when swapped in */
+    uint32_t chunk;         /* first swap file chunk */
+    uint32_t chunk_count;   /* chunks reserved (0 = never evicted) */
     uint32_t size;
     budget_region_t region;
+    uint32_t last_use;      /* LRU stamp, bumped by swap_touch/swap_access */
 } swap_slot_t;
 
+typedef struct {
+    uint32_t evictions;     /* slots written out (explicit, policy, shrinker) */
+    uint32_t refaults;      /* evicted slots read back on demand */
+    uint32_t prefetches;    /* evicted slots read ahead of a sequential scan */
+    uint32_t resident;
+    uint32_t swapped;
+    uint32_t high_pct;
+    uint32_t low_pct;
+} swap_stats_t;
+
 /* Init: set default limits (kernel 4MB, network 2MB, app 16MB, etc.). */
 void memory_budget_init(void);
 
+/* Periodic housekeeping (core subsystem tick): watermark-driven swap eviction. */
+void memory_budget_tick(void);
+
 /* Set limit for a region (in KB). */
 void memory_budget_set_limit(budget_region_t region, uint32_t limit_kb);
 
@@ -56,20 +80,51 @@ int memory_budget_can_alloc(budget_region_t region, uint32_t size_bytes);
 uint32_t memory_budget_used_kb(budget_region_t region);
 uint32_t memory_budget_total_used_kb(void);
 
+/* Tagged heap allocation: malloc charged to region. Over the limit (or when
+ * the heap is exhausted) registered shrinkers are asked to release memory
+ * before the request fails. */
+void *budget_malloc(budget_region_t region, size_t size);
+void budget_free(budget_region_t region, void *ptr);
+
+/* Register a cache that can give memory back under pressure in region. */
+int memory_budget_register_shrinker(budget_region_t region, budget_shrink_fn fn, void *ctx);
+
+/* Run region's shrinkers until want_bytes are released; returns bytes freed. */
+size_t memory_budget_shrink(budget_region_t region, size_t want_bytes);
+
 /* Swap layer: reserve a slot that can be evicted to storage. */
 int swap_slot_alloc(size_t size, budget_region_t region, swap_slot_t *out);
 
-/* Evict slot to storage (write to path). Call when low on RAM. */
+/* Evict slot to storage: each SWAP_CHUNK_SIZE piece is compressed and
+ * written to its own chunk of the swap file (created at swap_path, or
+ * SWAP_PATH_DEFAULT when NULL, on first eviction). On I/O error the data
+ * stays resident. Call when low on RAM. */
 int swap_evict(swap_slot_t *slot, const char *swap_path);
 
-/* Restore slot from storage (read back). */
+/* Restore slot from storage (read back and decompress). */
 int swap_restore(swap_slot_t *slot, const char *swap_path);
 
+/* Mark slot as used now (LRU). */
+void swap_touch(swap_slot_t *slot);
+
+/* Resident pointer for slot, restoring it first if it was evicted. The
+ * policy may evict any slot on a later swap call or tick, so re-fetch the
+ * pointer through here instead of caching slot->local_ptr. */
+void *swap_access(swap_slot_t *slot);
+
+/* Pressure is the larger of BUDGET_SWAP_CACHE use against its limit and
+ * heap use once the page allocator can no longer grow the heap. Above
+ * high_pct the least recently used slots are evicted until below low_pct. */
+void swap_set_watermarks(uint32_t high_pct, uint32_t low_pct);
+int swap_balance(void);               /* returns slots evicted */
+void swap_get_stats(swap_stats_t *out);
+
 /* Free slot (and its backing file chunk if any). */
 void swap_slot_free(swap_slot_t *slot);
 
-/* Optional: compress buffer before swap (stub: copy only; real impl = LZ/RLE). */
+/* Swap chunk codec (lz.h). dst must hold LZ_BOUND(len) bytes; a chunk that
+ * does not compress comes back as a stored block of len + 1 bytes. */
 void swap_compress(const void *src, size_t len, void *dst, size_t *out_len);
-void swap_decompress(const void *src, size_t len, void *dst, size_t *out_len);
+int swap_decompress(const void *src, size_t len, void *dst, size_t dst_cap, size_t *out_len);
 
 #endif /* MEMORY_BUDGET_H */
@@ -2,22 +2,91 @@
 #define MEMORY_MANAGER_H
 
 #include <stddef.h>  // For size_t
+#include <stdint.h>
 
 
-#define MEMORY_POOL_SIZE (1024 * 1024)  // 1MB pool
+/* Static bootstrap arena; once page_alloc is up the heap grows in
+ * MM_ARENA_MIN (or larger) page-backed arenas on demand. */
+#define MEMORY_POOL_SIZE (64 * 1024)
 #define ALIGNMENT 4
+#define MM_ARENA_MIN     (256 * 1024)
+#define MM_ARENA_MAX     32
+#define MM_PAGE_DIRECT   (64 * 1024)   /* requests this large bypass the heap */
 
-// Memory block structure for simple memory management
+/* Segregated size classes: 16, 32, ... 2048 bytes served from slabs in O(1).
+ * Anything larger falls back to the first-fit block list. */
+#define MM_CLASS_COUNT   8
+#define MM_CLASS_MIN     16
+#define MM_SMALL_MAX     (MM_CLASS_MIN << (MM_CLASS_COUNT - 1))
+#define MM_SLAB_SIZE     4096
+#define MM_CLASS_LARGE   (-1)
+#define MM_CLASS_PAGES   (-2)          /* direct page_alloc() block */
+
+/* Heap block header. Large blocks also carry a footer (mem_footer_t) after
+ * the payload so free() can find both neighbours in O(1); next/prev link the
+ * doubly linked free list. Slab objects reuse next as their class list link.
+ * Profiling builds (make MM_PROFILE=1) also record who allocated the block,
+ * when, and how much was asked for. */
 typedef struct mem_block {
     size_t size;
     struct mem_block *next;
+    struct mem_block *prev;
     int free;
+    int size_class;     /* 0..MM_CLASS_COUNT-1 slab object, MM_CLASS_LARGE or MM_CLASS_PAGES */
+#ifdef MM_PROFILE
+    const void *caller; /* return address of the allocating call */
+    uint32_t stamp_ms;
+    uint32_t request;
+#endif
 } mem_block_t;
 
+/* Boundary tag: payload size with bit 0 set while the block is free. */
+typedef struct {
+    size_t tag;
+} mem_footer_t;
+
+/* Heap counters, maintained on every malloc/free. Request sizes are
+ * histogrammed by power of two: <=16, <=32, ... <=16K, larger. Reading
+ * them is O(1), except the first read after the largest free block was
+ * taken, which rescans the free list (largest_free is amortized O(1)). */
+#define MM_HIST_BUCKETS  12
+
+typedef struct {
+    size_t in_use;          /* payload bytes handed out */
+    size_t peak;            /* high-water mark of in_use */
+    size_t heap_bytes;      /* arenas + direct page blocks */
+    size_t free_bytes;      /* free payload on the large-block list */
+    size_t largest_free;    /* biggest single free block */
+    unsigned int frag_pct;  /* 100 - largest_free * 100 / free_bytes */
+    unsigned int allocs;
+    unsigned int frees;
+    unsigned int failed;    /* malloc() calls that returned NULL */
+    unsigned int hist[MM_HIST_BUCKETS];
+} heap_stats_t;
+
+/* Live allocations of one call site (heap_profile_sites). caller 0 collects
+ * sites that did not fit in the table. */
+#define MM_PROFILE_SITES 32
+
+typedef struct {
+    const void *caller;
+    uint32_t count;
+    uint32_t bytes;         /* requested bytes */
+    uint32_t oldest_ms;     /* allocation time of the oldest live block */
+} heap_site_t;
+
 // Function prototypes
 void init_memory_manager(void);
 void *malloc(size_t size);
+void *malloc_from(size_t size, const void *caller);   /* wrappers pass their caller */
 void free(void *ptr);
+void *realloc(void *ptr, size_t new_size);
+void *calloc(size_t nmemb, size_t size);
+size_t malloc_usable_size(void *ptr);     /* payload bytes behind ptr, 0 if none */
 unsigned int get_memory_usage_percent(void);
+void heap_get_stats(heap_stats_t *out);
+/* Live blocks at least min_age_ms old grouped by call site, most bytes
+ * first. Returns sites written, or -1 if built without MM_PROFILE. */
+int heap_profile_sites(heap_site_t *out, int max, uint32_t min_age_ms);
 
 #endif // MEMORY_MANAGER_H
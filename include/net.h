@@ -13,10 +13,19 @@
 #define NET_MAX_PAYLOAD     1400
 #define NET_HOST_MAX        64
 
+/* Reply waits poll every NET_POLL_MS (sleeping in between) until the timeout. */
+#define NET_POLL_MS         10
+#define NET_PING_TIMEOUT_MS 1000
+#define NET_ICMP_TIMEOUT_MS 2000
+
 int net_init(void);
 void net_shutdown(void);
 int net_udp_send(uint32_t dst_ip, uint16_t dst_port, const void *data, uint16_t len);
 int net_udp_recv(uint32_t *src_ip, uint16_t *src_port, void *buf, uint16_t max_len);
+/* Send the payload already in p (pbuf.h); the UDP header is prepended in
+ * place and ownership passes down to the NIC. */
+struct pbuf;
+int net_udp_send_pbuf(uint32_t dst_ip, uint16_t dst_port, struct pbuf *p);
 int net_ping(const char *host, uint32_t *rtt_ms);
 int net_icmp_ping(uint32_t dst_ip, uint32_t *rtt_ms);
 int net_parse_ip(const char *str, uint32_t *out);
@@ -0,0 +1,37 @@
+#ifndef PAGE_ALLOC_H
+#define PAGE_ALLOC_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Physical page-frame allocator (binary buddy). Seeded from the platform
+ * memory map (E820 on x86); backs heap arenas and large buffers. */
+
+#define PAGE_SIZE        4096
+#define PAGE_SHIFT       12
+#define PAGE_MAX_ORDER   10     /* buddy blocks up to 2^10 pages = 4MB */
+
+/* Build free lists from plat_mem_map(). Safe to call more than once. */
+void page_alloc_init(void);
+
+/* Allocate 2^order contiguous pages; NULL if none. Orders above
+ * PAGE_MAX_ORDER take a run of adjacent free top-order blocks. */
+void *page_alloc(unsigned int order);
+
+/* Return a block obtained from page_alloc() with the same order. */
+void page_free(void *addr, unsigned int order);
+
+/* Smallest order whose block holds bytes (one page_alloc refuses if none can). */
+unsigned int page_order_for(size_t bytes);
+
+/* Order of the allocated block starting at addr, or -1 if addr is not the
+ * start of one (checks pointers the caller did not get from here). */
+int page_block_order(const void *addr);
+
+/* Non-zero once at least one region has been added. */
+int page_alloc_ready(void);
+
+uint32_t page_alloc_total_pages(void);
+uint32_t page_alloc_free_pages(void);
+
+#endif /* PAGE_ALLOC_H */
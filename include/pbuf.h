@@ -0,0 +1,60 @@
+#ifndef PBUF_H
+#define PBUF_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Packet buffers: a fixed pool of refcounted frames shared by transport,
+ * UDP and the NIC driver. A buffer is allocated with headroom in front of
+ * the payload; each layer on the way down prepends its header in place
+ * (pbuf_push) and hands the buffer on, so the payload is written once and
+ * read once by the NIC. On receive the driver fills a buffer and each layer
+ * strips its header with pbuf_pull. */
+
+#define PBUF_POOL_SIZE    16
+#define PBUF_FRAME_MAX    1514   /* Ethernet frame without FCS */
+#define PBUF_ETH_HLEN     14
+#define PBUF_NET_HLEN     11     /* "ASM" + ip + port + len (net/udp.c) */
+#define PBUF_TRANSPORT_HLEN 12   /* TRANSPORT_HEADER_SIZE */
+#define PBUF_HEADROOM     40     /* >= ETH + NET + TRANSPORT, multiple of 4 */
+#define PBUF_RX_HEADROOM  2      /* aligns the header after the 14-byte MAC header */
+#define PBUF_BUF_SIZE     (PBUF_HEADROOM + PBUF_FRAME_MAX)
+
+typedef struct pbuf {
+    uint8_t *payload;       /* start of the current layer's data */
+    uint16_t len;           /* bytes from payload on */
+    uint16_t ref;           /* 0 = free in the pool */
+    struct pbuf *next;      /* free list link */
+    uint8_t buf[PBUF_BUF_SIZE];
+} pbuf_t;
+
+typedef struct {
+    uint32_t total;
+    uint32_t free;
+    uint32_t low_water;     /* fewest free buffers seen */
+    uint32_t alloc_fail;
+} pbuf_stats_t;
+
+/* Take a buffer with ref 1 and len bytes of payload after headroom bytes.
+ * Returns NULL when the pool is empty or the frame would not fit. */
+pbuf_t *pbuf_alloc(uint16_t headroom, uint16_t len);
+
+/* Extra reference (e.g. loopback keeps the data while the NIC sends it). */
+void pbuf_ref(pbuf_t *p);
+
+/* Drop a reference; the buffer returns to the pool at zero. NULL is ignored. */
+void pbuf_free(pbuf_t *p);
+
+/* Grow the payload by n bytes at the front; returns the new header start, or
+ * NULL if the headroom is used up. */
+void *pbuf_push(pbuf_t *p, uint16_t n);
+
+/* Strip n bytes of header; returns the new payload, or NULL if len < n. */
+void *pbuf_pull(pbuf_t *p, uint16_t n);
+
+/* Cut the payload to len bytes (no-op if already shorter). */
+void pbuf_trim(pbuf_t *p, uint16_t len);
+
+void pbuf_get_stats(pbuf_stats_t *out);
+
+#endif /* PBUF_H */
@@ -0,0 +1,32 @@
+#ifndef PCI_H
+#define PCI_H
+
+#include <stdint.h>
+
+/* PCI configuration space through mechanism #1 (ports 0xCF8/0xCFC),
+ * platform/x86/hal_pci.c. Enough to find a controller by class and read
+ * its BARs; no resource assignment (the BIOS has done that). */
+
+#define PCI_VENDOR_ID       0x00    /* dword: device << 16 | vendor */
+#define PCI_COMMAND         0x04    /* dword: status << 16 | command */
+#define PCI_CLASS           0x08    /* dword: class, subclass, prog-if, rev */
+#define PCI_HEADER          0x0C    /* dword: bits 16-23 header type */
+#define PCI_BAR4            0x20
+
+#define PCI_CMD_IO          0x0001
+#define PCI_CMD_BUS_MASTER  0x0004
+
+#define PCI_CLASS_STORAGE   0x01
+#define PCI_SUBCLASS_IDE    0x01
+
+typedef struct {
+    uint8_t bus, dev, fn;
+} pci_dev_t;
+
+uint32_t pci_read32(const pci_dev_t *d, uint8_t off);
+void pci_write32(const pci_dev_t *d, uint8_t off, uint32_t val);
+
+/* First function with the given class and subclass: 0 and *out, or -1. */
+int pci_find_class(uint8_t cls, uint8_t subclass, pci_dev_t *out);
+
+#endif /* PCI_H */
@@ -8,6 +8,8 @@
 #define PLAT_IP_STR_MAX     16
 #define PLAT_FILENAME_MAX   12
 #define PLAT_SECTOR_SIZE    512
+#define PLAT_MEM_REGION_MAX 16
+#define PLAT_FS_MAX_OPEN    8
 
 typedef struct {
     char name[PLAT_FILENAME_MAX];
@@ -15,6 +17,11 @@ typedef struct {
     uint16_t cluster;
 } plat_file_info_t;
 
+typedef struct {
+    uint32_t base;
+    uint32_t length;
+} plat_mem_region_t;
+
 typedef struct {
     int linked;
     uint32_t ip;
@@ -23,6 +30,25 @@ typedef struct {
     char mac_str[24];
 } plat_net_info_t;
 
+typedef struct {
+    uint32_t rx_packets;
+    uint32_t rx_dropped;    /* no buffer or receive queue full */
+    uint32_t rx_errors;     /* bad ring headers */
+    uint32_t rx_overruns;   /* card ring overflowed */
+    uint32_t rx_irqs;
+    uint32_t rx_polls;      /* drains run from recv while IRQs were masked */
+    uint32_t tx_packets;
+} plat_net_stats_t;
+
+typedef struct {
+    int dma;                /* new commands use bus-master DMA */
+    uint32_t dma_cmds;
+    uint32_t pio_cmds;
+    uint32_t sectors;
+    uint32_t errors;        /* failed commands (DMA ones retry with PIO) */
+    uint32_t pio_time;      /* CPU in data-port transfers, ns >> 10 */
+} plat_disk_stats_t;
+
 typedef struct {
     uint16_t buttons;
     int8_t lx, ly, rx, ry;
@@ -40,10 +66,36 @@ void plat_read_line(char *buf, int max_len);
 uint32_t plat_mem_total_kb(void);
 uint32_t plat_mem_used_kb(void);
 uint32_t plat_mem_free_kb(void);
+/* Usable RAM not occupied by the kernel image; returns region count. */
+int plat_mem_map(plat_mem_region_t *out, unsigned int max);
 
 /* Timer */
 uint32_t plat_ticks_ms(void);
+/* Monotonic since boot from the calibrated clocksource (x86: TSC). */
+uint64_t plat_ticks_us(void);
+uint64_t plat_ticks_ns(void);
+const char *plat_clock_name(void);
+uint32_t plat_clock_khz(void);              /* counter rate, 0 if tick-based */
+/* At least ms; from a task this sleeps and the CPU can halt meanwhile. */
 void plat_delay_ms(uint32_t ms);
+/* Nothing to do until the next interrupt (polling loops): lets other tasks
+ * run or the CPU halt for about one scheduler tick. */
+void plat_idle(void);
+
+/* Critical sections against preemption and IRQ handlers: save returns the
+ * previous interrupt state, restore puts it back (nests). */
+uint32_t plat_irq_save(void);
+void plat_irq_restore(uint32_t flags);
+
+/* Data shared between CPU cores (x86 SMP): a spinlock taken with local
+ * interrupts off, so it also covers preemption and IRQ handlers on this
+ * core. Not recursive; hold it briefly and never across a sleep. */
+typedef struct {
+    volatile uint32_t locked;
+} plat_lock_t;
+#define PLAT_LOCK_INIT  { 0 }
+uint32_t plat_lock_irqsave(plat_lock_t *l);
+void plat_unlock_irqrestore(plat_lock_t *l, uint32_t flags);
 
 /* Storage / FAT12 */
 int plat_fs_init(void);
@@ -51,10 +103,33 @@ int plat_fs_list(plat_file_info_t *out, unsigned int max);
 int plat_fs_read(const char *name, void *buf, uint32_t buf_size, uint32_t *out_size);
 int plat_fs_write(const char *name, const void *data, uint32_t size);
 int plat_fs_delete(const char *name);
+/* Preallocate name at size bytes (contents undefined). */
+int plat_fs_create(const char *name, uint32_t size);
+/* Byte-offset I/O inside an existing file; writes never extend it. */
+int plat_fs_read_at(const char *name, uint32_t offset, void *buf, uint32_t len, uint32_t *out_len);
+int plat_fs_write_at(const char *name, uint32_t offset, const void *data, uint32_t len);
+/* Handles on existing files (-1 if missing or all PLAT_FS_MAX_OPEN are in
+ * use). Each keeps its place in the file, so sequential pread/pwrite
+ * costs O(1) per call. pwrite grows the file as needed; a handle on a
+ * deleted file fails every call but close. */
+int plat_fs_open(const char *name);
+int plat_fs_pread(int fd, uint32_t offset, void *buf, uint32_t len, uint32_t *out_len);
+int plat_fs_pwrite(int fd, uint32_t offset, const void *data, uint32_t len);
+int plat_fs_size(int fd, uint32_t *out_size);
+int plat_fs_close(int fd);
 int plat_fs_validate(void);
 int plat_fs_repair(void);
 int plat_fs_read_sector(uint32_t lba, void *buf);
 int plat_fs_write_sector(uint32_t lba, const void *buf);
+/* count consecutive sectors as few drive commands as possible. Sector
+ * and file I/O goes through a write-back cache (x86: bcache.h). */
+int plat_fs_read_sectors(uint32_t lba, uint32_t count, void *buf);
+int plat_fs_write_sectors(uint32_t lba, uint32_t count, const void *buf);
+/* Write cached dirty sectors to the disk. */
+int plat_fs_sync(void);
+void plat_disk_get_stats(plat_disk_stats_t *out);
+/* DMA for new commands (on) or PIO only; -1 if there is no DMA. */
+int plat_disk_set_dma(int on);
 
 /* Input */
 int plat_keyboard_scancode(void);
@@ -72,7 +147,14 @@ int plat_net_init(void);
 void plat_net_shutdown(void);
 int plat_net_send(const void *data, size_t len);
 int plat_net_recv(void *buf, size_t max_len);
+/* Zero-copy path (pbuf.h): send_pbuf prepends the link header in p's
+ * headroom and takes ownership; recv_pbuf returns the next frame with the
+ * link header stripped, or NULL. The caller frees received buffers. */
+struct pbuf;
+int plat_net_send_pbuf(struct pbuf *p);
+struct pbuf *plat_net_recv_pbuf(void);
 void plat_net_get_info(plat_net_info_t *out);
+void plat_net_get_stats(plat_net_stats_t *out);
 int plat_net_ping(const char *host_ip, uint32_t *rtt_ms);
 
 /* System */
@@ -1,19 +1,139 @@
 #ifndef SCHEDULER_H
 #define SCHEDULER_H
 
-// Define the maximum number of tasks that can be scheduled
-#define MAX_TASKS 8
+#include <stdint.h>
+#include "platform.h"
 
-// Task ID (0 .. MAX_TASKS-1), or -1 if not a task
+// Task table: starts with TASK_TABLE_INIT slots (x86: slot 0 is the boot thread, 1 idle)
+// and doubles on demand up to TASK_MAX; slots of joined/reaped tasks are reused
+#define TASK_TABLE_INIT 8
+#define TASK_MAX        64
+
+/* Stacks come from a page-backed pool (x86), rounded up to whole pages.
+ * The lowest TASK_STACK_CANARY_WORDS words hold a canary that is checked on
+ * every switch away from the task; an overflowed task is stopped with exit
+ * code TASK_EXIT_OVERFLOW instead of corrupting its neighbour. */
+#define TASK_STACK_SIZE 4096        // default (add_task, task_create with 0)
+#define TASK_STACK_MIN  1024
+#define TASK_STACK_MAX  65536
+#define TASK_STACK_CANARY        0xDEADC0DEu
+#define TASK_STACK_CANARY_WORDS  4
+#define TASK_EXIT_OVERFLOW       (-2)
+
+/* Preemption: on x86 IRQ0 (PIT, SCHED_TICK_MS per tick) switches to the next
+ * ready task every time slice; task_yield() gives the rest of a slice away. */
+#define SCHED_TICK_MS       10
+#define SCHED_TIMESLICE_MS  10
+
+/* Priority classes: the best ready task always runs; equal priorities share
+ * the CPU round-robin per time slice. Deadline (EDF) tasks run ahead of all
+ * of them, earliest deadline first. TASK_PRIO_IDLE is the idle task's. */
+#define TASK_PRIO_HIGH    0     /* input, network */
+#define TASK_PRIO_NORMAL  1     /* shell, games (add_task default) */
+#define TASK_PRIO_LOW     2     /* background save, swap I/O */
+#define TASK_PRIO_IDLE    3
+#define TASK_PRIO_LEVELS  4
+
+#define TASK_UNUSED    0
+#define TASK_READY     1
+#define TASK_RUNNING   2
+#define TASK_SLEEPING  3
+#define TASK_BLOCKED   4
+#define TASK_DONE      5        /* exited, waiting for task_join or the reaper */
+
+// Task ID (0 .. sched_task_slots()-1), or -1 if not a task
 typedef int task_id_t;
 
+// task_create entry; the return value is the exit code task_join reports
+typedef int (*task_fn_t)(void *arg);
+
+typedef struct {
+    uint8_t state;
+    uint8_t prio;
+    uint8_t edf;
+    uint8_t cpu;            // core it runs on or is queued for
+    uint8_t pinned;         // task_set_cpu
+    uint32_t period_ms;
+    uint32_t deadline_misses;
+    uint32_t stack_size;    // 0 for the boot thread
+    int exit_code;          // valid once state is TASK_DONE
+    uint32_t switches;      // times switched in
+    uint32_t run_time;      // CPU time, ns >> 10 (wraps; use differences)
+} task_info_t;
+
 // Declare the task scheduling functions
-void add_task(void (*task_func)(void));  // Add a task to the scheduler
+task_id_t add_task(void (*task_func)(void));  // Detached TASK_PRIO_NORMAL task, default stack; -1 on failure
+
+/* stack_size 0 = TASK_STACK_SIZE; priority TASK_PRIO_HIGH..LOW. The task
+ * is joinable: call task_join (or task_detach) or its slot and stack stay
+ * allocated after it exits. -1 if out of slots/memory or bad arguments. */
+task_id_t task_create(task_fn_t fn, void *arg, uint32_t stack_size, int priority);
+void task_exit(int code);                     // End the calling task (also: return from fn)
+int task_join(task_id_t id, int *exit_code);  // Block until id exits, then free it; -1 bad id/self/already joined
+int task_detach(task_id_t id);                // Free automatically on exit; -1 if bad id or being joined
 void run_scheduler(void);                // Run the round-robin scheduler
 void init_scheduler(void);
 
-/* Multitasking workaround: cooperative yield. No native kernel — we are the kernel. */
+/* Cooperative yield on top of preemption: hand the rest of the slice to the next task. */
 void task_yield(void);                   // Yield to next task (saves esp, loads next, returns in other task)
 task_id_t task_current(void);            // Current task index, or -1 if not in a task
 
+void sched_set_timeslice_ms(uint32_t ms);   // Rounded down to whole ticks (min 1); 0 = default
+uint32_t sched_get_timeslice_ms(void);
+uint32_t sched_ticks(void);                 // Timer ticks since boot
+int sched_preemptive(void);                 // 1 once IRQ0 drives task switches
+/* x86 idle task: hlt with the timer stretched to the next wakeup (tickless) */
+void sched_get_idle_stats(uint32_t *halts, uint32_t *ticks_skipped);
+
+/* Sleeping and blocked tasks take no CPU. task_wake on a task that is not
+ * blocked yet makes its next task_block return at once (no lost wakeups). */
+void task_sleep_ms(uint32_t ms);            // At least ms, rounded up to ticks
+void task_block(void);
+void task_block_timeout(uint32_t ms);       // task_block, but for at most ms
+void task_wake(task_id_t id);               // Safe from IRQ handlers
+
+int task_set_priority(task_id_t id, int prio);  // TASK_PRIO_HIGH..LOW; 0 ok, -1 bad id/prio
+/* Deadline class: the task's deadline is the end of its current period;
+ * call task_wait_period() when a period's work is done. 0 = back to priority. */
+int task_set_deadline(task_id_t id, uint32_t period_ms);
+void task_wait_period(void);
+
+int task_get_info(task_id_t id, task_info_t *out);  // -1 if id unused
+int sched_task_slots(void);                 // Valid ids are 0 .. slots-1
+
+/* SMP (x86): every core has its own run queues. New tasks go to the least
+ * loaded core, woken tasks back to the one they last ran on, and a core
+ * with nothing to run steals from the busiest one. Task 0 (the shell) and
+ * the idle tasks stay where they are. */
+typedef struct {
+    int current;            // running task
+    int ready;              // queued tasks, idle not counted
+    uint32_t switches;
+    uint32_t steals;        // tasks taken from other cores
+    uint32_t halts;
+    uint32_t busy_time;     // ns >> 10 since boot (wraps; use differences)
+    uint32_t idle_time;
+} sched_cpu_info_t;
+
+int task_set_cpu(task_id_t id, int cpu);    // Pin to a core, -1 = any; -1 bad id/core
+int sched_cpu_count(void);                  // Cores scheduling (1 without SMP)
+int sched_get_cpu_info(int cpu, sched_cpu_info_t *out);    // -1 if not online
+void sched_start_ap(int cpu);               // AP entry from smp.c; never returns
+
+/* Sleeping lock for state that only tasks touch (file system, swap,
+ * transport). A task that finds it held blocks until the owner unlocks;
+ * the owner may take it again (counted). Not for IRQ handlers. Periodic
+ * housekeeping uses trylock and skips a tick the foreground is inside. */
+typedef struct {
+    plat_lock_t guard;
+    int owner;              // task id, -1 = free
+    uint32_t depth;
+    uint64_t waiters;       // bit per blocked task id
+} task_mutex_t;
+#define TASK_MUTEX_INIT  { PLAT_LOCK_INIT, -1, 0, 0 }
+
+void task_mutex_lock(task_mutex_t *m);
+int task_mutex_trylock(task_mutex_t *m);    // 0 taken, -1 held by another task
+void task_mutex_unlock(task_mutex_t *m);
+
 #endif  // SCHEDULER_H
@@ -0,0 +1,34 @@
+#ifndef SMP_H
+#define SMP_H
+
+#include <stdint.h>
+
+/* x86 symmetric multiprocessing (platform/x86/hal_smp.c). Cores come from
+ * the ACPI MADT, or the Intel MP table when there is no MADT. Each AP is
+ * started with INIT-SIPI-SIPI through a real-mode trampoline copied to
+ * SMP_TRAMPOLINE_PHYS, switches to the kernel GDT and IDT and enters the
+ * scheduler (sched_start_ap). Cores are numbered 0 (BSP) .. count-1 in
+ * the order they came online; smp_cpu_id() maps the local APIC ID back. */
+
+#define SMP_MAX_CPUS          8
+#define SMP_TRAMPOLINE_PHYS   0x7000u   /* below the boot sector, SIPI vector 0x07 */
+#define SMP_AP_STACK_ORDER    2         /* 16 KB boot/idle stack per AP */
+#define SMP_AP_START_MS       100       /* per-AP wait before giving up */
+
+/* Find the cores and start every AP; call once from kernel_main after
+ * init_scheduler, with interrupts off. Returns the number of cores online. */
+int smp_init(void);
+
+int smp_cpu_count(void);        /* cores online (1 until smp_init) */
+int smp_cpu_id(void);           /* this core, 0 .. SMP_MAX_CPUS-1 */
+uint8_t smp_apic_id(int cpu);
+
+/* Reschedule IPI (IRQ_RESCHED_VECTOR) to another core. */
+void smp_send_resched(int cpu);
+
+/* Local APIC helpers for the interrupt path and the scheduler. */
+void lapic_eoi(void);
+void smp_timer_start(void);     /* this AP: periodic IRQ_LAPIC_TIMER_VECTOR per SCHED_TICK_MS */
+void smp_timer_stop(void);      /* this AP: no ticks until smp_timer_start (idle) */
+
+#endif /* SMP_H */
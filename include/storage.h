@@ -39,6 +39,12 @@ int storage_copy(const char *src, const char *dst);
 /* Snapshot backup: clone memory card or given path to external device. */
 int storage_snapshot_backup(const char *source_path, const char *backup_path);
 
+/* Swap file: one preallocated file of fixed-size chunks, addressed by
+ * chunk index. Opening reuses the file if it is already big enough. */
+int storage_swap_open(const char *path, uint32_t chunk_size, uint32_t chunk_count);
+int storage_swap_write(uint32_t chunk, const void *data, uint32_t len);
+int storage_swap_read(uint32_t chunk, void *buf, uint32_t len);
+
 /* Init layer (detect USB, HDD, network mounts). */
 void storage_init(void);
 
@@ -28,7 +28,9 @@ typedef struct {
 
 typedef struct stream_pipeline stream_pipeline_t;
 
-/* Create pipeline for path (e.g. "mass0:file.bin"). Uses chunked I/O. */
+/* Create pipeline for path (e.g. "mass0:file.bin"). Uses chunked I/O at
+ * each request's offset through one open file handle; a write pipeline
+ * creates the file. NULL if it cannot be opened. */
 stream_pipeline_t *stream_open(const char *path, int for_write);
 
 /* Close and flush. */
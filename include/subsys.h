@@ -44,4 +44,14 @@ const subsys_t *subsys_get(subsys_id_t id);
 int subsys_has_cap(subsys_id_t id, uint32_t cap);
 int subsys_status_all(char *buf, int max);
 
+/* Tick cost, measured around every call from subsys_tick_all. */
+typedef struct {
+    uint32_t ticks;
+    uint32_t total_time;    /* ns >> 10 since boot (wraps; use differences) */
+    uint32_t last_us;
+    uint32_t max_us;
+} subsys_stats_t;
+
+int subsys_get_stats(subsys_id_t id, subsys_stats_t *out);  /* -1 bad id */
+
 #endif /* SUBSYS_H */
@@ -43,7 +43,7 @@ typedef struct {
     uint16_t remote_seq;
     uint8_t  connected;
     uint8_t  heartbeat_missed;
-    uint32_t last_heartbeat_ticks;
+    uint32_t last_heartbeat_ms;     /* plat_ticks_ms of the last packet or heartbeat */
 } transport_session_t;
 
 /* Initialize transport layer; call after network init. */
@@ -55,6 +55,12 @@ void transport_shutdown(void);
 /* Send one packet (header + payload). Payload length 0..TRANSPORT_MAX_PAYLOAD. */
 int transport_send(uint8_t type, const void *payload, uint16_t len);
 
+/* Zero-copy send: p (pbuf.h, allocated with PBUF_HEADROOM) already holds the
+ * payload; the header is prepended in place and p passes to the NIC.
+ * Takes ownership of p even on error. */
+struct pbuf;
+int transport_send_pbuf(uint8_t type, struct pbuf *p);
+
 /* Send multiple payloads in one batch (reduces overhead). */
 int transport_send_batch(const void *payloads[], const uint16_t lens[], int count);
 
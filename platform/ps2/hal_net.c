@@ -1,5 +1,6 @@
 #include "platform.h"
 #include "net.h"
+#include "pbuf.h"
 #include <string.h>
 #include <kernel.h>
 #include <ps2ip.h>
@@ -55,6 +56,20 @@ int plat_net_recv(void *buf, size_t max_len) {
     return 0;
 }
 
+int plat_net_send_pbuf(struct pbuf *p) {
+    if (!p || p->len == 0) {
+        pbuf_free(p);
+        return -1;
+    }
+    int len = (int)p->len;
+    pbuf_free(p);
+    return len;
+}
+
+struct pbuf *plat_net_recv_pbuf(void) {
+    return (struct pbuf *)0;
+}
+
 void plat_net_get_info(plat_net_info_t *out) {
     if (!out) return;
     out->linked = net_ready;
@@ -64,6 +79,11 @@ void plat_net_get_info(plat_net_info_t *out) {
     strcpy(out->mac_str, "00:00:00:00:00:00");
 }
 
+/* Frames go through ps2ip on the IOP; nothing is counted on the EE side. */
+void plat_net_get_stats(plat_net_stats_t *out) {
+    if (out) memset(out, 0, sizeof(*out));
+}
+
 int plat_net_ping(const char *host_ip, uint32_t *rtt_ms) {
     return net_ping(host_ip, rtt_ms);
 }
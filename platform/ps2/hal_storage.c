@@ -61,6 +61,89 @@ int plat_fs_delete(const char *name) {
     return remove(path);
 }
 
+int plat_fs_create(const char *name, uint32_t size) {
+    char path[128];
+    int fd, n = 0;
+    char zero = 0;
+    if (!name) return -1;
+    mc_path(path, sizeof(path), name);
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0) return -1;
+    if (size > 0 && lseek(fd, (off_t)size - 1, SEEK_SET) >= 0)
+        n = write(fd, &zero, 1);
+    close(fd);
+    return (size == 0 || n == 1) ? 0 : -1;
+}
+
+int plat_fs_read_at(const char *name, uint32_t offset, void *buf, uint32_t len, uint32_t *out_len) {
+    char path[128];
+    int fd, n;
+    if (!name || !buf) return -1;
+    mc_path(path, sizeof(path), name);
+    fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+    if (lseek(fd, (off_t)offset, SEEK_SET) < 0) {
+        close(fd);
+        return -1;
+    }
+    n = read(fd, buf, len);
+    close(fd);
+    if (n < 0) return -1;
+    if (out_len) *out_len = (uint32_t)n;
+    return 0;
+}
+
+int plat_fs_write_at(const char *name, uint32_t offset, const void *data, uint32_t len) {
+    char path[128];
+    struct stat st;
+    int fd, n;
+    if (!name || !data) return -1;
+    mc_path(path, sizeof(path), name);
+    if (stat(path, &st) != 0 || (uint32_t)st.st_size < offset + len) return -1;
+    fd = open(path, O_WRONLY);
+    if (fd < 0) return -1;
+    if (lseek(fd, (off_t)offset, SEEK_SET) < 0) {
+        close(fd);
+        return -1;
+    }
+    n = write(fd, data, len);
+    close(fd);
+    return (n == (int)len) ? 0 : -1;
+}
+
+/* Handles are memory card file descriptors. */
+int plat_fs_open(const char *name) {
+    char path[128];
+    if (!name) return -1;
+    mc_path(path, sizeof(path), name);
+    return open(path, O_RDWR);
+}
+
+int plat_fs_pread(int fd, uint32_t offset, void *buf, uint32_t len, uint32_t *out_len) {
+    int n;
+    if (fd < 0 || !buf || lseek(fd, (off_t)offset, SEEK_SET) < 0) return -1;
+    n = read(fd, buf, len);
+    if (n < 0) return -1;
+    if (out_len) *out_len = (uint32_t)n;
+    return 0;
+}
+
+int plat_fs_pwrite(int fd, uint32_t offset, const void *data, uint32_t len) {
+    if (fd < 0 || !data || lseek(fd, (off_t)offset, SEEK_SET) < 0) return -1;
+    return (write(fd, data, len) == (int)len) ? 0 : -1;
+}
+
+int plat_fs_size(int fd, uint32_t *out_size) {
+    off_t end;
+    if (fd < 0 || (end = lseek(fd, 0, SEEK_END)) < 0) return -1;
+    *out_size = (uint32_t)end;
+    return 0;
+}
+
+int plat_fs_close(int fd) {
+    return fd < 0 ? -1 : close(fd);
+}
+
 int plat_fs_validate(void) {
     return fs_ready ? 0 : -1;
 }
@@ -80,3 +163,29 @@ int plat_fs_write_sector(uint32_t lba, const void *buf) {
     (void)buf;
     return -1;
 }
+
+int plat_fs_read_sectors(uint32_t lba, uint32_t count, void *buf) {
+    (void)lba;
+    (void)count;
+    (void)buf;
+    return -1;
+}
+
+int plat_fs_write_sectors(uint32_t lba, uint32_t count, const void *buf) {
+    (void)lba;
+    (void)count;
+    (void)buf;
+    return -1;
+}
+
+int plat_fs_sync(void) {
+    return 0;
+}
+
+void plat_disk_get_stats(plat_disk_stats_t *out) {
+    memset(out, 0, sizeof(*out));
+}
+
+int plat_disk_set_dma(int on) {
+    return on ? -1 : 0;
+}
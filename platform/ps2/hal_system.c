@@ -1,5 +1,6 @@
 #include "platform.h"
 #include "memory_manager.h"
+#include "page_alloc.h"
 #include <kernel.h>
 #include <delaythread.h>
 #include <debug.h>
@@ -8,6 +9,10 @@
 
 static uint32_t tick_ms;
 
+/* EE RAM is owned by the PS2SDK runtime; hand the page allocator a fixed arena. */
+#define PS2_PAGE_ARENA_SIZE  (8 * 1024 * 1024)
+static uint8_t page_arena[PS2_PAGE_ARENA_SIZE] __attribute__((aligned(4096)));
+
 void plat_init(void) {
     tick_ms = 0;
 }
@@ -25,8 +30,21 @@ uint32_t plat_mem_total_kb(void) {
     return 32 * 1024;
 }
 
+/* Everything not sitting free in the page allocator or the heap. */
 uint32_t plat_mem_used_kb(void) {
-    return (plat_mem_total_kb() * get_memory_usage_percent()) / 100;
+    heap_stats_t hs;
+    heap_get_stats(&hs);
+    uint32_t free_kb = page_alloc_free_pages() * (PAGE_SIZE / 1024) +
+                       (uint32_t)(hs.free_bytes / 1024);
+    uint32_t t = plat_mem_total_kb();
+    return (free_kb < t) ? (t - free_kb) : 0;
+}
+
+int plat_mem_map(plat_mem_region_t *out, unsigned int max) {
+    if (!out || max == 0) return 0;
+    out[0].base = (uint32_t)page_arena;
+    out[0].length = sizeof(page_arena);
+    return 1;
 }
 
 uint32_t plat_mem_free_kb(void) {
@@ -39,11 +57,52 @@ uint32_t plat_ticks_ms(void) {
     return tick_ms;
 }
 
+/* No calibrated counter wired up here: milliseconds advanced by delays. */
+uint64_t plat_ticks_us(void) {
+    return (uint64_t)tick_ms * 1000u;
+}
+
+uint64_t plat_ticks_ns(void) {
+    return (uint64_t)tick_ms * 1000000u;
+}
+
+const char *plat_clock_name(void) {
+    return "delay count";
+}
+
+uint32_t plat_clock_khz(void) {
+    return 0;
+}
+
 void plat_delay_ms(uint32_t ms) {
     DelayThread(ms * 1000);
     tick_ms += ms;
 }
 
+void plat_idle(void) {
+    plat_delay_ms(1);
+}
+
+/* The EE scheduler is cooperative here; nothing preempts shared state. */
+uint32_t plat_irq_save(void) {
+    return 0;
+}
+
+void plat_irq_restore(uint32_t flags) {
+    (void)flags;
+}
+
+/* One EE core: nothing else can hold the lock. */
+uint32_t plat_lock_irqsave(plat_lock_t *l) {
+    (void)l;
+    return 0;
+}
+
+void plat_unlock_irqrestore(plat_lock_t *l, uint32_t flags) {
+    (void)l;
+    (void)flags;
+}
+
 void plat_reboot(void) {
     scr_printf("Reboot not implemented on PS2 — reset console.\n");
 }
@@ -0,0 +1,62 @@
+/* x86 ACPI table lookup, see acpi.h. */
+
+#include "acpi.h"
+#include <stdint.h>
+
+#define ACPI_SCAN_START    0x000E0000u
+#define ACPI_SCAN_END      0x00100000u
+
+static const uint8_t *rsdt;
+static int rsdt_probed;
+
+static int acpi_checksum_ok(const uint8_t *p, uint32_t len) {
+    uint8_t sum = 0;
+    while (len--) sum = (uint8_t)(sum + *p++);
+    return sum == 0;
+}
+
+static int sig_eq(const uint8_t *p, const char *sig) {
+    return p[0] == (uint8_t)sig[0] && p[1] == (uint8_t)sig[1] &&
+           p[2] == (uint8_t)sig[2] && p[3] == (uint8_t)sig[3];
+}
+
+uint32_t acpi_table_len(const uint8_t *table) {
+    return *(const uint32_t *)(table + 4);
+}
+
+/* The RSDP scan runs once; later lookups walk the cached RSDT. */
+static const uint8_t *rsdt_find(void) {
+    uint32_t a;
+    const uint8_t *rsdp = (const uint8_t *)0;
+    if (rsdt_probed) return rsdt;
+    rsdt_probed = 1;
+    for (a = ACPI_SCAN_START; a < ACPI_SCAN_END; a += 16) {
+        const uint8_t *s = (const uint8_t *)a;
+        if (sig_eq(s, "RSD ") && sig_eq(s + 4, "PTR ") && acpi_checksum_ok(s, 20)) {
+            rsdp = s;
+            break;
+        }
+    }
+    if (!rsdp) return (const uint8_t *)0;
+    const uint8_t *t = (const uint8_t *)*(const uint32_t *)(rsdp + 16);
+    if (!t || !sig_eq(t, "RSDT")) return (const uint8_t *)0;
+    uint32_t len = acpi_table_len(t);
+    if (len < ACPI_SDT_HDR_LEN || !acpi_checksum_ok(t, len)) return (const uint8_t *)0;
+    rsdt = t;
+    return rsdt;
+}
+
+const uint8_t *acpi_find_table(const char *sig) {
+    const uint8_t *r = rsdt_find();
+    uint32_t i, len;
+    if (!r) return (const uint8_t *)0;
+    len = acpi_table_len(r);
+    for (i = ACPI_SDT_HDR_LEN; i + 4 <= len; i += 4) {
+        const uint8_t *t = (const uint8_t *)*(const uint32_t *)(r + i);
+        if (!t || !sig_eq(t, sig)) continue;
+        if (acpi_table_len(t) < ACPI_SDT_HDR_LEN) continue;
+        if (!acpi_checksum_ok(t, acpi_table_len(t))) continue;
+        return t;
+    }
+    return (const uint8_t *)0;
+}
@@ -0,0 +1,462 @@
+/* x86 ATA driver: request queue, bus-master DMA through the PCI IDE
+ * controller with multi-sector PIO as the fallback, IRQ14 completion,
+ * see ata.h. */
+
+#include "ata.h"
+#include "irq.h"
+#include "pci.h"
+#include "platform.h"
+#include "scheduler.h"
+#include "arch_x86.h"
+#include <stdint.h>
+
+#define ATA_SECCNT   0x1F2
+#define ATA_LBA0     0x1F3
+#define ATA_LBA1     0x1F4
+#define ATA_LBA2     0x1F5
+#define ATA_DRIVE    0x1F6
+#define ATA_CMD      0x1F7
+#define ATA_STATUS   0x1F7
+#define ATA_CTRL     0x3F6      /* device control; reads alternate status */
+
+#define ATA_ST_ERR   0x01
+#define ATA_ST_DRQ   0x08
+#define ATA_ST_DF    0x20
+#define ATA_ST_BSY   0x80
+
+#define ATA_CMD_READ            0x20
+#define ATA_CMD_WRITE           0x30
+#define ATA_CMD_READ_MULTIPLE   0xC4
+#define ATA_CMD_WRITE_MULTIPLE  0xC5
+#define ATA_CMD_SET_MULTIPLE    0xC6
+#define ATA_CMD_READ_DMA        0xC8
+#define ATA_CMD_WRITE_DMA       0xCA
+#define ATA_CMD_IDENTIFY        0xEC
+#define ATA_ID_MULTIPLE_MAX     47      /* IDENTIFY word: low byte = max per block */
+#define ATA_ID_CAPS             49      /* IDENTIFY word: bit 8 = DMA */
+#define ATA_ID_CAP_DMA          0x0100
+
+/* Bus-master IDE registers, primary channel (offsets from BAR4). */
+#define BM_CMD         0x00
+#define BM_STATUS      0x02
+#define BM_PRDT        0x04
+#define BM_CMD_START   0x01
+#define BM_CMD_READ    0x08     /* device to memory */
+#define BM_ST_ACTIVE   0x01
+#define BM_ST_ERR      0x02
+#define BM_ST_IRQ      0x04
+#define BM_PROGIF_BM   0x80     /* prog-if: controller can bus-master */
+#define BM_PROGIF_NATIVE 0x01   /* prog-if: primary channel not at 0x1F0 */
+
+/* Physical region descriptors: a 256-sector command is 128 KB, which
+ * splits into at most three regions that do not cross 64 KB. */
+#define ATA_PRD_MAX    4
+#define ATA_PRD_EOT    0x8000
+
+typedef struct {
+    uint32_t addr;
+    uint16_t bytes;         /* 0 = 64 KB */
+    uint16_t flags;
+} ata_prd_t;
+
+#define ATA_SPIN_MAX   100000
+
+/* Queue and channel registers: IRQ14 (BSP) vs tasks on any core. */
+static plat_lock_t ata_lock = PLAT_LOCK_INIT;
+static ata_req_t *q_head, *q_tail;      /* q_head is the active request */
+static uint32_t active_ms;              /* when q_head last made progress */
+static uint32_t cmd_left;               /* sectors left in q_head's command */
+static uint32_t blk;                    /* sectors in the block just written */
+static uint32_t multiple = 1;           /* sectors per DRQ block (SET MULTIPLE) */
+static int cmd_dma;                     /* q_head's command is a DMA command */
+static int dma_on;                      /* use DMA for new commands */
+static uint16_t bm_base;                /* bus-master registers, 0 = none */
+static ata_prd_t prdt[ATA_PRD_MAX] __attribute__((aligned(32)));
+static plat_disk_stats_t stats;
+static int irq_ready;
+/* Waiters of requests retired under ata_lock, one bit per task id; woken
+ * by ata_unlock once the lock is dropped, since task_wake may switch. */
+static uint64_t wake_mask;
+
+/* Let the drive update its status after a command or data block. */
+static void ata_delay400(void) {
+    (void)inb(ATA_CTRL);
+    (void)inb(ATA_CTRL);
+    (void)inb(ATA_CTRL);
+    (void)inb(ATA_CTRL);
+}
+
+static int ata_wait_status(uint8_t mask, uint8_t want) {
+    int spin = ATA_SPIN_MAX;
+    uint8_t st;
+    do {
+        st = inb(ATA_STATUS);
+        if (!(st & ATA_ST_BSY) && (st & (ATA_ST_ERR | ATA_ST_DF))) return -1;
+        if ((st & mask) == want) return 0;
+    } while (--spin);
+    return -1;
+}
+
+/* n sectors at r's cursor through the data port; the CPU time goes to
+ * stats.pio_time. */
+static void ata_pio_xfer(ata_req_t *r, uint32_t n) {
+    uint8_t *p = (uint8_t *)r->buf + r->done * ATA_SECTOR_SIZE;
+    uint64_t t0 = plat_ticks_ns();
+    if (r->write) ata_pio_write_sectors(p, n);
+    else ata_pio_read_sectors(p, n);
+    stats.pio_time += (uint32_t)((plat_ticks_ns() - t0) >> 10);
+}
+
+/* Next DRQ block of a write: at most one block of the current command. */
+static void ata_write_block(ata_req_t *r) {
+    blk = cmd_left < multiple ? cmd_left : multiple;
+    ata_pio_xfer(r, blk);
+    ata_delay400();
+}
+
+/* Describe buf for the bus master; -1 if it cannot (odd address). */
+static int ata_dma_prepare(const uint8_t *buf, uint32_t bytes) {
+    uint32_t addr = (uint32_t)buf;          /* identity-mapped, no paging */
+    int i = 0;
+    if (addr & 1) return -1;
+    while (bytes) {
+        uint32_t chunk = 0x10000 - (addr & 0xFFFF);
+        if (chunk > bytes) chunk = bytes;
+        if (i == ATA_PRD_MAX) return -1;
+        prdt[i].addr = addr;
+        prdt[i].bytes = (uint16_t)chunk;
+        prdt[i].flags = 0;
+        addr += chunk;
+        bytes -= chunk;
+        i++;
+    }
+    prdt[i - 1].flags = ATA_PRD_EOT;
+    return 0;
+}
+
+/* Issue one command for up to ATA_CMD_SECTORS_MAX of r's remaining
+ * sectors: DMA when the controller can reach the buffer, else PIO, where
+ * a write also sends its first block (the drive asks for it without an
+ * interrupt). */
+static int ata_issue(ata_req_t *r) {
+    uint32_t lba = r->lba + r->done;
+    uint32_t n = r->count - r->done;
+    uint8_t cmd, bm_dir = r->write ? 0 : BM_CMD_READ;
+    if (n > ATA_CMD_SECTORS_MAX) n = ATA_CMD_SECTORS_MAX;
+    cmd_dma = dma_on && !r->pio &&
+              ata_dma_prepare((uint8_t *)r->buf + r->done * ATA_SECTOR_SIZE,
+                              n * ATA_SECTOR_SIZE) == 0;
+    if (cmd_dma) cmd = r->write ? ATA_CMD_WRITE_DMA : ATA_CMD_READ_DMA;
+    else if (multiple > 1) cmd = r->write ? ATA_CMD_WRITE_MULTIPLE : ATA_CMD_READ_MULTIPLE;
+    else cmd = r->write ? ATA_CMD_WRITE : ATA_CMD_READ;
+    if (ata_wait_status(ATA_ST_BSY, 0) != 0) return -1;
+    if (cmd_dma) {
+        outb(bm_base + BM_CMD, 0);
+        outb(bm_base + BM_STATUS, BM_ST_ERR | BM_ST_IRQ);
+        outl(bm_base + BM_PRDT, (uint32_t)prdt);
+        outb(bm_base + BM_CMD, bm_dir);
+        stats.dma_cmds++;
+    } else {
+        stats.pio_cmds++;
+    }
+    outb(ATA_SECCNT, (uint8_t)n);           /* 0 = 256 */
+    outb(ATA_LBA0, (uint8_t)lba);
+    outb(ATA_LBA1, (uint8_t)(lba >> 8));
+    outb(ATA_LBA2, (uint8_t)(lba >> 16));
+    outb(ATA_DRIVE, (uint8_t)(0xE0 | ((lba >> 24) & 0x0F)));
+    outb(ATA_CMD, cmd);
+    if (cmd_dma) outb(bm_base + BM_CMD, bm_dir | BM_CMD_START);
+    ata_delay400();
+    cmd_left = n;
+    if (r->write && !cmd_dma) {
+        if (ata_wait_status(ATA_ST_BSY | ATA_ST_DRQ, ATA_ST_DRQ) != 0) return -1;
+        ata_write_block(r);
+    }
+    active_ms = plat_ticks_ms();
+    return 0;
+}
+
+/* Drop ata_lock, then wake the tasks whose requests were retired. */
+static void ata_unlock(uint32_t flags) {
+    uint64_t w = wake_mask;
+    int id;
+    wake_mask = 0;
+    plat_unlock_irqrestore(&ata_lock, flags);
+    for (id = 0; w; id++, w >>= 1)
+        if (w & 1) task_wake(id);
+}
+
+/* Retire q_head and start the next request (failing any the drive
+ * refuses). r may live on the waiter's stack: the status store is the
+ * last access. ata_lock held; the waiter is woken by ata_unlock. */
+static void ata_retire(int8_t status) {
+    ata_req_t *r = q_head;
+    int waiter = r->waiter;
+    q_head = r->next;
+    if (!q_head) q_tail = (ata_req_t *)0;
+    r->status = status;
+    if (waiter >= 0) wake_mask |= (uint64_t)1 << waiter;
+    if (q_head && ata_issue(q_head) != 0) ata_retire(ATA_REQ_ERROR);
+}
+
+/* q_head's command is over: issue the next one or retire the request. */
+static void ata_next_command(ata_req_t *r) {
+    if (r->done == r->count) ata_retire(ATA_REQ_DONE);
+    else if (ata_issue(r) != 0) ata_retire(ATA_REQ_ERROR);
+}
+
+/* DMA command of q_head: done once the bus master saw the drive's
+ * interrupt or an error. A failed command is tried again with PIO. */
+static void ata_dma_complete(ata_req_t *r, uint8_t st) {
+    uint8_t bm = inb(bm_base + BM_STATUS);
+    int failed = (bm & BM_ST_ERR) || (st & (ATA_ST_ERR | ATA_ST_DF));
+    if (!failed && !(bm & BM_ST_IRQ) && (bm & BM_ST_ACTIVE)) return;
+    outb(bm_base + BM_CMD, 0);
+    outb(bm_base + BM_STATUS, BM_ST_ERR | BM_ST_IRQ);
+    cmd_dma = 0;
+    active_ms = plat_ticks_ms();
+    if (failed) {
+        stats.errors++;
+        r->pio = 1;
+        if (ata_issue(r) != 0) ata_retire(ATA_REQ_ERROR);
+        return;
+    }
+    r->done += cmd_left;
+    stats.sectors += cmd_left;
+    cmd_left = 0;
+    ata_next_command(r);
+}
+
+/* The drive finished a block or command of q_head (status st, already
+ * read): collect read data or send the next write block, then issue the
+ * next command or retire the request. ata_lock held. */
+static void ata_complete(uint8_t st) {
+    ata_req_t *r = q_head;
+    uint32_t n;
+    if (cmd_dma) {
+        ata_dma_complete(r, st);
+        return;
+    }
+    if (st & (ATA_ST_ERR | ATA_ST_DF)) {
+        stats.errors++;
+        ata_retire(ATA_REQ_ERROR);
+        return;
+    }
+    if (!r->write) {
+        if (!(st & ATA_ST_DRQ)) return;     /* not ready: not our interrupt */
+        n = cmd_left < multiple ? cmd_left : multiple;
+        ata_pio_xfer(r, n);
+    } else {
+        n = blk;
+    }
+    r->done += n;
+    stats.sectors += n;
+    cmd_left -= n;
+    active_ms = plat_ticks_ms();
+    if (cmd_left) {
+        if (!r->write) return;
+        if (!(st & ATA_ST_DRQ)) ata_retire(ATA_REQ_ERROR);
+        else ata_write_block(r);
+    } else {
+        ata_next_command(r);
+    }
+}
+
+static irq_frame_t *ata_irq(irq_frame_t *f) {
+    uint32_t flags = plat_lock_irqsave(&ata_lock);
+    uint8_t st = inb(ATA_STATUS);           /* also acknowledges the drive */
+    if (q_head && !(st & ATA_ST_BSY)) ata_complete(st);
+    ata_unlock(flags);
+    return f;
+}
+
+/* Finish the queue on the status port when its IRQ cannot be taken. */
+static void ata_drain_polled(void) {
+    int spin = ATA_SPIN_MAX;
+    while (q_head) {
+        ata_req_t *r = q_head;
+        uint32_t done = r->done;
+        uint8_t st = inb(ATA_STATUS);
+        if (!(st & ATA_ST_BSY)) ata_complete(st);
+        if (q_head != r || r->done != done) spin = ATA_SPIN_MAX;
+        else if (--spin == 0) {
+            ata_complete(ATA_ST_ERR);       /* drive stuck: fail it */
+            spin = ATA_SPIN_MAX;
+        }
+    }
+}
+
+/* Whole request with the CPU on the status port: before the scheduler
+ * runs, with interrupts off, or from an IRQ handler. */
+static void ata_run_polled(ata_req_t *r) {
+    ata_drain_polled();
+    q_head = q_tail = r;
+    if (ata_issue(r) != 0) ata_retire(ATA_REQ_ERROR);
+    ata_drain_polled();
+    (void)inb(ATA_STATUS);                  /* drop the IRQ the drive raised */
+}
+
+static int ata_identify(uint16_t *id) {
+    outb(ATA_DRIVE, 0xA0);
+    ata_delay400();
+    if (inb(ATA_STATUS) == 0xFF) return -1; /* floating bus: no drive */
+    outb(ATA_CMD, ATA_CMD_IDENTIFY);
+    ata_delay400();
+    if (inb(ATA_STATUS) == 0) return -1;
+    if (ata_wait_status(ATA_ST_BSY | ATA_ST_DRQ, ATA_ST_DRQ) != 0) return -1;
+    ata_pio_read_sectors(id, 1);
+    return 0;
+}
+
+/* SET MULTIPLE MODE with the largest power of two the drive allows (up
+ * to ATA_MULTIPLE_MAX); stays at 1 if anything fails. */
+static void ata_setup_multiple(const uint16_t *id) {
+    uint32_t max, m = 1;
+    max = id[ATA_ID_MULTIPLE_MAX] & 0xFF;
+    if (max > ATA_MULTIPLE_MAX) max = ATA_MULTIPLE_MAX;
+    while (m * 2 <= max) m *= 2;
+    if (m < 2) return;
+    outb(ATA_SECCNT, (uint8_t)m);
+    outb(ATA_DRIVE, 0xE0);
+    outb(ATA_CMD, ATA_CMD_SET_MULTIPLE);
+    ata_delay400();
+    if (ata_wait_status(ATA_ST_BSY, 0) == 0) multiple = m;
+    (void)inb(ATA_STATUS);
+}
+
+/* Bus master of a PCI IDE controller whose primary channel sits at the
+ * legacy ports (PIIX and most others in compatibility mode). */
+static void ata_setup_dma(const uint16_t *id) {
+    pci_dev_t d;
+    uint32_t progif, bar4;
+    if (!(id[ATA_ID_CAPS] & ATA_ID_CAP_DMA)) return;
+    if (pci_find_class(PCI_CLASS_STORAGE, PCI_SUBCLASS_IDE, &d) != 0) return;
+    progif = (pci_read32(&d, PCI_CLASS) >> 8) & 0xFF;
+    bar4 = pci_read32(&d, PCI_BAR4);
+    if (!(progif & BM_PROGIF_BM) || (progif & BM_PROGIF_NATIVE)) return;
+    if (!(bar4 & 1) || !(bar4 & 0xFFFC)) return;    /* want an I/O BAR */
+    pci_write32(&d, PCI_COMMAND, (pci_read32(&d, PCI_COMMAND) & 0xFFFF) |
+                                 PCI_CMD_IO | PCI_CMD_BUS_MASTER);
+    bm_base = (uint16_t)(bar4 & 0xFFFC);
+    outb(bm_base + BM_CMD, 0);
+    outb(bm_base + BM_STATUS, BM_ST_ERR | BM_ST_IRQ);
+    dma_on = 1;
+}
+
+void ata_init(void) {
+    uint16_t id[ATA_SECTOR_SIZE / 2];
+    if (ata_identify(id) == 0) {
+        ata_setup_multiple(id);
+        ata_setup_dma(id);
+    }
+    outb(ATA_CTRL, 0x00);                   /* nIEN clear: drive interrupts on */
+    irq_register(ATA_IRQ, ata_irq);
+    irq_ready = 1;
+}
+
+int ata_submit(ata_req_t *r) {
+    if (!r || !r->buf || r->count == 0) return -1;
+    r->done = 0;
+    r->pio = 0;
+    r->waiter = -1;
+    r->next = (ata_req_t *)0;
+    r->status = ATA_REQ_PENDING;
+    uint32_t flags = plat_lock_irqsave(&ata_lock);
+    if (!irq_ready || !sched_preemptive() || irq_in_handler() || !(flags & 0x200)) {
+        ata_run_polled(r);
+    } else if (q_tail) {
+        q_tail->next = r;
+        q_tail = r;
+    } else {
+        q_head = q_tail = r;
+        if (ata_issue(r) != 0) {
+            q_head = q_tail = (ata_req_t *)0;
+            r->status = ATA_REQ_ERROR;
+        }
+    }
+    ata_unlock(flags);
+    return 0;
+}
+
+/* A missed IRQ leaves the drive idle with q_head pending: after
+ * ATA_IRQ_WAIT_MS look at the status port ourselves, and give up on a
+ * command that makes no progress for ATA_TIMEOUT_MS. */
+static void ata_check_stalled(ata_req_t *r) {
+    uint32_t flags = plat_lock_irqsave(&ata_lock);
+    uint32_t idle_ms = plat_ticks_ms() - active_ms;
+    if (r->status == ATA_REQ_PENDING && q_head && idle_ms >= ATA_IRQ_WAIT_MS) {
+        uint8_t st = inb(ATA_STATUS);
+        if (!(st & ATA_ST_BSY)) ata_complete(st);
+        if (q_head && plat_ticks_ms() - active_ms > ATA_TIMEOUT_MS)
+            ata_complete(ATA_ST_ERR);
+    }
+    ata_unlock(flags);
+}
+
+int ata_wait(ata_req_t *r) {
+    task_id_t self = task_current();
+    uint32_t flags = plat_lock_irqsave(&ata_lock);
+    if (r->status == ATA_REQ_PENDING) r->waiter = self;
+    plat_unlock_irqrestore(&ata_lock, flags);
+    while (r->status == ATA_REQ_PENDING) {
+        if (self >= 0) task_block_timeout(ATA_IRQ_WAIT_MS);
+        else plat_idle();
+        if (r->status == ATA_REQ_PENDING) ata_check_stalled(r);
+    }
+    return r->status == ATA_REQ_DONE ? 0 : -1;
+}
+
+int ata_read(uint32_t lba, uint32_t count, void *buf) {
+    ata_req_t r;
+    r.lba = lba;
+    r.count = count;
+    r.buf = buf;
+    r.write = 0;
+    if (ata_submit(&r) != 0) return -1;
+    return ata_wait(&r);
+}
+
+int ata_write(uint32_t lba, uint32_t count, const void *buf) {
+    ata_req_t r;
+    r.lba = lba;
+    r.count = count;
+    r.buf = (void *)buf;
+    r.write = 1;
+    if (ata_submit(&r) != 0) return -1;
+    return ata_wait(&r);
+}
+
+uint32_t ata_multiple(void) {
+    return multiple;
+}
+
+void plat_disk_get_stats(plat_disk_stats_t *out) {
+    uint32_t flags = plat_lock_irqsave(&ata_lock);
+    *out = stats;
+    out->dma = dma_on;
+    plat_unlock_irqrestore(&ata_lock, flags);
+}
+
+int plat_disk_set_dma(int on) {
+    if (on && !bm_base) return -1;
+    uint32_t flags = plat_lock_irqsave(&ata_lock);
+    dma_on = on ? 1 : 0;                    /* from the next command on */
+    plat_unlock_irqrestore(&ata_lock, flags);
+    return 0;
+}
+
+int disk_read_sectors(uint32_t lba, uint32_t count, void *buf) {
+    return ata_read(lba, count, buf);
+}
+
+int disk_write_sectors(uint32_t lba, uint32_t count, const void *buf) {
+    return ata_write(lba, count, buf);
+}
+
+int disk_read_sector(uint32_t lba, void *buf) {
+    return ata_read(lba, 1, buf);
+}
+
+int disk_write_sector(uint32_t lba, const void *buf) {
+    return ata_write(lba, 1, buf);
+}
@@ -0,0 +1,156 @@
+/* x86 clocksource — TSC calibrated against the HPET or PIT, see clock.h. */
+
+#include "clock.h"
+#include "acpi.h"
+#include "platform.h"
+#include "scheduler.h"
+#include "kernel.h"
+#include "arch_x86.h"
+#include <stdint.h>
+
+#define CLOCK_SHIFT        24       /* ns = cycles * ns_mult >> CLOCK_SHIFT */
+#define CLOCK_MIN_KHZ      4000     /* keeps ns_mult within 32 bits */
+
+#define PIT_INPUT_HZ       1193182
+#define PIT_CH2            0x42
+#define PIT_CMD            0x43
+#define PIT_CH2_ONESHOT    0xB0     /* channel 2, lo/hi byte, mode 0 */
+#define PORT_B             0x61     /* bit 0: ch2 gate, 1: speaker, 5: ch2 output */
+
+#define HPET_TBL_ADDR      44       /* base address in the HPET table's GAS */
+#define HPET_REG_CAP_HI    (0x004 / 4)  /* counter period in femtoseconds */
+#define HPET_REG_CONFIG    (0x010 / 4)
+#define HPET_REG_COUNTER   (0x0F0 / 4)
+#define HPET_CFG_ENABLE    1
+#define HPET_MAX_PERIOD_FS 100000000u   /* spec limit (10 MHz minimum) */
+
+static clock_src_t src = CLOCK_SRC_TICK;
+static uint64_t tsc_base;
+static uint32_t tsc_khz;
+static uint32_t ns_mult;
+static volatile uint32_t *hpet;
+
+static uint64_t rdtsc(void) {
+    uint32_t lo, hi;
+    __asm__ volatile ("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+/* 64-by-32 division as two divl steps (no libgcc in the kernel). */
+static uint64_t div64_32(uint64_t n, uint32_t d) {
+    uint32_t hi = (uint32_t)(n >> 32), lo = (uint32_t)n;
+    uint32_t qhi = hi / d, rem;
+    hi %= d;
+    __asm__ ("divl %4" : "=a"(lo), "=d"(rem) : "a"(lo), "d"(hi), "rm"(d));
+    (void)rem;
+    return ((uint64_t)qhi << 32) | lo;
+}
+
+static int cpu_has_tsc(void) {
+    uint32_t a = 1, b, c, d;
+    __asm__ volatile ("cpuid" : "+a"(a), "=b"(b), "=c"(c), "=d"(d));
+    return (d >> 4) & 1;
+}
+
+/* ACPI "HPET" table -> MMIO base. */
+static volatile uint32_t *hpet_find(void) {
+    const uint8_t *t = acpi_find_table("HPET");
+    if (!t) return (volatile uint32_t *)0;
+    const uint32_t *addr = (const uint32_t *)(t + HPET_TBL_ADDR);
+    if (addr[1] != 0 || addr[0] == 0) return (volatile uint32_t *)0;  /* above 4GB */
+    return (volatile uint32_t *)addr[0];
+}
+
+/* TSC cycles and nanoseconds over CLOCK_CALIBRATE_MS of HPET counts. */
+static int calibrate_hpet(uint64_t *cycles, uint32_t *ns) {
+    uint32_t period = hpet[HPET_REG_CAP_HI];
+    if (period == 0 || period > HPET_MAX_PERIOD_FS) return -1;
+    hpet[HPET_REG_CONFIG] |= HPET_CFG_ENABLE;
+    uint32_t target = (uint32_t)div64_32((uint64_t)CLOCK_CALIBRATE_MS * 1000000000000ull, period);
+    uint32_t h0 = hpet[HPET_REG_COUNTER], h1;
+    uint32_t spins = 0;
+    uint64_t t0 = rdtsc();
+    do {
+        h1 = hpet[HPET_REG_COUNTER];
+        if (++spins == 0) return -1;        /* counter not running */
+    } while (h1 - h0 < target);
+    *cycles = rdtsc() - t0;
+    *ns = (uint32_t)div64_32((uint64_t)(h1 - h0) * period, 1000000);
+    return 0;
+}
+
+/* The same with PIT channel 2 counting down once (gate on, speaker off). */
+static int calibrate_pit(uint64_t *cycles, uint32_t *ns) {
+    uint32_t count = PIT_INPUT_HZ / 1000 * CLOCK_CALIBRATE_MS;
+    uint32_t spins = 0;
+    outb(PORT_B, (uint8_t)((inb(PORT_B) & ~0x02) | 0x01));
+    outb(PIT_CMD, PIT_CH2_ONESHOT);
+    outb(PIT_CH2, (uint8_t)(count & 0xFF));
+    outb(PIT_CH2, (uint8_t)(count >> 8));
+    uint64_t t0 = rdtsc();
+    while (!(inb(PORT_B) & 0x20))
+        if (++spins == 0) return -1;        /* output never rose */
+    *cycles = rdtsc() - t0;
+    *ns = (uint32_t)div64_32((uint64_t)count * 1000000000u, PIT_INPUT_HZ);
+    return 0;
+}
+
+void clock_init(void) {
+    uint64_t cycles = 0;
+    uint32_t ns = 0;
+    clock_src_t s;
+    if (!cpu_has_tsc()) {
+        kprint("Clock: no TSC, using timer ticks\n");
+        return;
+    }
+    hpet = hpet_find();
+    if (hpet && calibrate_hpet(&cycles, &ns) == 0) s = CLOCK_SRC_TSC_HPET;
+    else if (calibrate_pit(&cycles, &ns) == 0) s = CLOCK_SRC_TSC_PIT;
+    else return;
+    if (ns == 0) return;
+    tsc_khz = (uint32_t)div64_32(cycles * 1000000u, ns);
+    if (tsc_khz < CLOCK_MIN_KHZ) return;
+    ns_mult = (uint32_t)div64_32((uint64_t)1000000 << CLOCK_SHIFT, tsc_khz);
+    tsc_base = rdtsc();
+    src = s;
+    kprintf("Clock: TSC %d MHz (%s calibrated)\n", (int)(tsc_khz / 1000),
+            s == CLOCK_SRC_TSC_HPET ? "HPET" : "PIT");
+}
+
+clock_src_t clock_source(void) {
+    return src;
+}
+
+/* Split at 32 bits so the products cannot overflow however long the
+ * uptime: mult < 2^32 and the high half stays far below 2^(64-32). */
+static uint64_t cycles_to_ns(uint64_t c) {
+    uint64_t lo = ((uint64_t)(uint32_t)c * ns_mult) >> CLOCK_SHIFT;
+    uint64_t hi = ((c >> 32) * ns_mult) << (32 - CLOCK_SHIFT);
+    return lo + hi;
+}
+
+uint64_t plat_ticks_ns(void) {
+    if (src == CLOCK_SRC_TICK)
+        return (uint64_t)sched_ticks() * SCHED_TICK_MS * 1000000u;
+    return cycles_to_ns(rdtsc() - tsc_base);
+}
+
+uint64_t plat_ticks_us(void) {
+    return div64_32(plat_ticks_ns(), 1000);
+}
+
+uint32_t plat_ticks_ms(void) {
+    return (uint32_t)div64_32(plat_ticks_ns(), 1000000);
+}
+
+const char *plat_clock_name(void) {
+    switch (src) {
+    case CLOCK_SRC_TSC_HPET: return "tsc/hpet";
+    case CLOCK_SRC_TSC_PIT:  return "tsc/pit";
+    default:                 return "pit tick";
+    }
+}
+
+uint32_t plat_clock_khz(void) {
+    return src == CLOCK_SRC_TICK ? 0 : tsc_khz;
+}
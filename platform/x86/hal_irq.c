@@ -0,0 +1,210 @@
+/* x86 IDT, 8259 PIC remap and interrupt dispatch. */
+
+#include "irq.h"
+#include "smp.h"
+#include "platform.h"
+#include "kernel.h"
+#include "arch_x86.h"
+#include <stdint.h>
+
+#define PIC1_CMD   0x20
+#define PIC1_DATA  0x21
+#define PIC2_CMD   0xA0
+#define PIC2_DATA  0xA1
+#define PIC_EOI    0x20
+#define PIC_READ_ISR 0x0B
+
+#define IDT_GATE_INT32  0x8E        /* present, ring 0, 32-bit interrupt gate */
+
+typedef struct {
+    uint16_t off_lo;
+    uint16_t sel;
+    uint8_t zero;
+    uint8_t flags;
+    uint16_t off_hi;
+} __attribute__((packed)) idt_entry_t;
+
+typedef struct {
+    uint16_t limit;
+    uint32_t base;
+} __attribute__((packed)) idt_ptr_t;
+
+extern uint32_t isr_stub_table[];
+
+static idt_entry_t idt[IRQ_VECTORS];
+static idt_ptr_t idtr;
+static irq_handler_t handlers[IRQ_VECTORS];
+static uint16_t pic_mask = 0xFFFF;
+static uint16_t kernel_cs, kernel_ds;
+static irq_handler_t exit_hook;
+static void (*switch_hook)(void);
+static volatile int irq_depth[SMP_MAX_CPUS];
+
+static const char *const exc_names[32] = {
+    "divide error", "debug", "NMI", "breakpoint", "overflow", "bound range",
+    "invalid opcode", "no FPU", "double fault", "FPU overrun", "invalid TSS",
+    "segment not present", "stack fault", "general protection", "page fault",
+    "reserved", "FPU error", "alignment check", "machine check", "SIMD error",
+    "virtualization", "control protection", "reserved", "reserved", "reserved",
+    "reserved", "reserved", "reserved", "hypervisor injection", "VMM communication",
+    "security", "reserved"
+};
+
+static void idt_set_gate(int v, uint32_t handler) {
+    idt[v].off_lo = (uint16_t)(handler & 0xFFFF);
+    idt[v].sel = kernel_cs;
+    idt[v].zero = 0;
+    idt[v].flags = IDT_GATE_INT32;
+    idt[v].off_hi = (uint16_t)(handler >> 16);
+}
+
+static void pic_write_mask(void) {
+    outb(PIC1_DATA, (uint8_t)(pic_mask & 0xFF));
+    outb(PIC2_DATA, (uint8_t)(pic_mask >> 8));
+}
+
+/* ICW1-4: cascade, vectors IRQ_BASE_VECTOR.., slave on IRQ2, 8086 mode. */
+static void pic_remap(void) {
+    outb(PIC1_CMD, 0x11);
+    outb(PIC2_CMD, 0x11);
+    outb(PIC1_DATA, IRQ_BASE_VECTOR);
+    outb(PIC2_DATA, IRQ_BASE_VECTOR + 8);
+    outb(PIC1_DATA, 0x04);
+    outb(PIC2_DATA, 0x02);
+    outb(PIC1_DATA, 0x01);
+    outb(PIC2_DATA, 0x01);
+    pic_mask = 0xFFFF & ~(1u << 2);     /* cascade line stays open */
+    pic_write_mask();
+}
+
+static uint8_t pic_in_service(uint16_t cmd) {
+    outb(cmd, PIC_READ_ISR);
+    return inb(cmd);
+}
+
+void irq_init(void) {
+    int v;
+    __asm__ volatile ("mov %%cs, %0" : "=r"(kernel_cs));
+    __asm__ volatile ("mov %%ds, %0" : "=r"(kernel_ds));
+    for (v = 0; v < IRQ_VECTORS; v++) {
+        handlers[v] = (irq_handler_t)0;
+        idt_set_gate(v, isr_stub_table[v]);
+    }
+    idtr.limit = (uint16_t)(sizeof(idt) - 1);
+    idtr.base = (uint32_t)idt;
+    idt_load_asm(&idtr);
+    pic_remap();
+}
+
+void irq_init_ap(void) {
+    idt_load_asm(&idtr);
+}
+
+void irq_mask(int irq) {
+    if (irq < 0 || irq >= IRQ_LINES) return;
+    pic_mask |= (uint16_t)(1u << irq);
+    pic_write_mask();
+}
+
+void irq_unmask(int irq) {
+    if (irq < 0 || irq >= IRQ_LINES) return;
+    pic_mask &= (uint16_t)~(1u << irq);
+    pic_write_mask();
+}
+
+int irq_set_vector(int vector, irq_handler_t fn) {
+    if (vector < 0 || vector >= IRQ_VECTORS) return -1;
+    handlers[vector] = fn;
+    return 0;
+}
+
+int irq_register(int irq, irq_handler_t fn) {
+    if (irq < 0 || irq >= IRQ_LINES) return -1;
+    handlers[IRQ_BASE_VECTOR + irq] = fn;
+    if (fn) irq_unmask(irq);
+    else irq_mask(irq);
+    return 0;
+}
+
+void irq_set_exit_hook(irq_handler_t fn) {
+    exit_hook = fn;
+}
+
+void irq_set_switch_hook(void (*fn)(void)) {
+    switch_hook = fn;
+}
+
+int irq_in_handler(void) {
+    return irq_depth[smp_cpu_id()] > 0;
+}
+
+uint16_t irq_kernel_cs(void) { return kernel_cs; }
+uint16_t irq_kernel_ds(void) { return kernel_ds; }
+
+static void exception_halt(irq_frame_t *f) {
+    kprintf("\nCPU exception %d (%s) err %x\n", (int)f->vector,
+            exc_names[f->vector & 31], f->err);
+    kprintf("  eip %x cs %x eflags %x\n", f->eip, f->cs, f->eflags);
+    kprintf("  eax %x ebx %x ecx %x edx %x\n", f->eax, f->ebx, f->ecx, f->edx);
+    kprintf("  esi %x edi %x ebp %x\n", f->esi, f->edi, f->ebp);
+    for (;;) {
+        disable_interrupts_asm();
+        __asm__ volatile ("hlt");
+    }
+}
+
+/* Called from isr_common with the saved frame; returns the frame to resume. */
+irq_frame_t *isr_dispatch(irq_frame_t *f) {
+    uint32_t v = f->vector;
+    irq_handler_t fn = (v < IRQ_VECTORS) ? handlers[v] : (irq_handler_t)0;
+    if (v < 32) {
+        if (fn) return fn(f);
+        exception_halt(f);
+    }
+    if (v >= IRQ_BASE_VECTOR && v < IRQ_BASE_VECTOR + IRQ_LINES) {
+        int irq = (int)(v - IRQ_BASE_VECTOR);
+        /* Spurious IRQ7/15: no ISR bit set, no EOI (except the cascade's). */
+        if (irq == 7 && !(pic_in_service(PIC1_CMD) & 0x80)) return f;
+        if (irq == 15 && !(pic_in_service(PIC2_CMD) & 0x80)) {
+            outb(PIC1_CMD, PIC_EOI);
+            return f;
+        }
+        /* EOI first: the handler may switch to a task that resumes elsewhere. */
+        if (irq >= 8) outb(PIC2_CMD, PIC_EOI);
+        outb(PIC1_CMD, PIC_EOI);
+    }
+    if (v >= IRQ_LAPIC_FIRST) {
+        if (v == IRQ_SPURIOUS_VECTOR) return f;     /* no EOI for spurious */
+        lapic_eoi();
+    }
+    int cpu = smp_cpu_id();
+    irq_depth[cpu]++;
+    if (fn) f = fn(f);
+    irq_depth[cpu]--;
+    return exit_hook ? exit_hook(f) : f;
+}
+
+/* Called from isr_common after it moved onto a different frame. */
+void isr_switched(void) {
+    if (switch_hook) switch_hook();
+}
+
+uint32_t plat_irq_save(void) {
+    return irq_save_asm();
+}
+
+void plat_irq_restore(uint32_t flags) {
+    irq_restore_asm(flags);
+}
+
+uint32_t plat_lock_irqsave(plat_lock_t *l) {
+    uint32_t flags = irq_save_asm();
+    while (__sync_lock_test_and_set(&l->locked, 1))
+        while (l->locked) cpu_pause();
+    return flags;
+}
+
+void plat_unlock_irqrestore(plat_lock_t *l, uint32_t flags) {
+    __sync_lock_release(&l->locked);
+    irq_restore_asm(flags);
+}
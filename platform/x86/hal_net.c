@@ -1,81 +1,277 @@
-/* x86 NE2000 network driver + platform net HAL. */
+/* x86 NE2000 network driver + platform net HAL. Receive is interrupt
+ * driven: IRQ9 copies frames from the card ring into pool buffers with
+ * word-wide remote DMA (rep insw). */
 
 #include "platform.h"
 #include "net.h"
+#include "pbuf.h"
 #include "arch_x86.h"
+#include "irq.h"
 #include <stdint.h>
 
 #define NE2000_IO       0x300
-#define NE2000_MEM      0x00008000
+#define NE2000_DATA     (NE2000_IO + 0x10)  /* remote DMA data port */
+#define NE2000_RESET    (NE2000_IO + 0x1F)
+#define NE2000_IRQ      9                   /* QEMU ne2k_isa default */
+
+/* DP8390 page 0 registers. */
+#define NE_CR       0x00
+#define NE_PSTART   0x01
+#define NE_PSTOP    0x02
+#define NE_BNRY     0x03
+#define NE_TPSR     0x04
+#define NE_TBCR0    0x05
+#define NE_TBCR1    0x06
+#define NE_ISR      0x07
+#define NE_RSAR0    0x08
+#define NE_RSAR1    0x09
+#define NE_RBCR0    0x0A
+#define NE_RBCR1    0x0B
+#define NE_RCR      0x0C
+#define NE_TCR      0x0D
+#define NE_DCR      0x0E
+#define NE_IMR      0x0F
+#define NE_PAR0     0x01    /* page 1 */
+#define NE_CURR     0x07    /* page 1 */
+
+#define NE_CR_STP     0x01
+#define NE_CR_STA     0x02
+#define NE_CR_TXP     0x04
+#define NE_CR_RREAD   0x08
+#define NE_CR_RWRITE  0x10
+#define NE_CR_NODMA   0x20
+#define NE_CR_PAGE1   0x40
+
+#define NE_ISR_PRX    0x01
+#define NE_ISR_PTX    0x02
+#define NE_ISR_RXE    0x04
+#define NE_ISR_TXE    0x08
+#define NE_ISR_OVW    0x10
+#define NE_ISR_RDC    0x40
+#define NE_ISR_RST    0x80
+#define NE_RX_IRQS    (NE_ISR_PRX | NE_ISR_RXE | NE_ISR_OVW)
+
+/* 16 KB of card memory in 256-byte pages: one full frame to transmit,
+ * the rest is the receive ring. */
+#define NE_TX_PAGE    0x40
+#define NE_RX_START   0x46
+#define NE_RX_STOP    0x80
+
+/* Frames move from the card ring to rxq in batches. The IRQ handler takes
+ * at most NE_RX_BUDGET; if the ring still holds more, it masks receive
+ * interrupts and leaves the rest to plat_net_recv_pbuf, which drains in
+ * budget-sized passes and unmasks once the ring is empty (NAPI style). */
+#define NE_RXQ_SIZE   8     /* power of two, half the pbuf pool */
+#define NE_RX_BUDGET  4
+#define NE_SPIN_MAX   100000
+
+typedef struct {
+    uint8_t status;
+    uint8_t next;           /* page of the following frame */
+    uint16_t count;         /* header + frame + FCS */
+} ne_rx_hdr_t;
 
 static int net_ready;
 static uint32_t our_ip;
 static uint32_t our_mask;
 static uint8_t our_mac[6] = { 0x52, 0x54, 0x00, 0x12, 0x34, 0x56 };
 
+/* Remote DMA, the register page and rxq: IRQ handler vs any task/core. */
+static plat_lock_t ne_lock = PLAT_LOCK_INIT;
+static uint8_t rx_next;     /* page of the next unread frame */
+static int rx_polling;      /* receive IRQs masked, drained from recv */
+static pbuf_t *rxq[NE_RXQ_SIZE];
+static uint32_t rxq_head, rxq_tail;
+static plat_net_stats_t stats;
+
 static void ne_write(uint8_t reg, uint8_t val) {
-    outb(NE2000_IO, reg);
-    outb(NE2000_IO + 1, val);
+    outb(NE2000_IO + reg, val);
 }
 
 static uint8_t ne_read(uint8_t reg) {
-    outb(NE2000_IO, reg);
-    return inb(NE2000_IO + 1);
+    return inb(NE2000_IO + reg);
+}
+
+static void ne_insw(void *buf, uint32_t words) {
+    __asm__ volatile ("cld; rep insw"
+                      : "+D"(buf), "+c"(words) : "d"(NE2000_DATA) : "memory");
+}
+
+static void ne_outsw(const void *buf, uint32_t words) {
+    __asm__ volatile ("cld; rep outsw"
+                      : "+S"(buf), "+c"(words) : "d"(NE2000_DATA) : "memory");
 }
 
 static int ne_probe(void) {
-    ne_write(0x00, 0x21);
+    ne_write(NE_CR, NE_CR_NODMA | NE_CR_STP);
     ne_write(0x01, 0x00);
     ne_write(0x01, 0x00);
     uint8_t id = ne_read(0x0A);
     return (id == 0x50) ? 1 : 0;
 }
 
+/* Point remote DMA at addr for count bytes (count even: word transfers). */
+static void ne_dma_setup(uint16_t addr, uint16_t count, uint8_t dir) {
+    ne_write(NE_CR, NE_CR_NODMA | NE_CR_STA);
+    ne_write(NE_RBCR0, (uint8_t)count);
+    ne_write(NE_RBCR1, (uint8_t)(count >> 8));
+    ne_write(NE_RSAR0, (uint8_t)addr);
+    ne_write(NE_RSAR1, (uint8_t)(addr >> 8));
+    ne_write(NE_CR, dir | NE_CR_STA);
+}
+
+static void ne_dma_done(void) {
+    int spin = NE_SPIN_MAX;
+    while (!(ne_read(NE_ISR) & NE_ISR_RDC) && --spin) ;
+    ne_write(NE_ISR, NE_ISR_RDC);
+}
+
+/* Read len bytes at card address addr; the DMA wraps at the ring end. */
+static void ne_block_read(uint16_t addr, void *buf, uint16_t len) {
+    uint16_t words = (uint16_t)(len >> 1);
+    ne_dma_setup(addr, (uint16_t)((len + 1) & ~1u), NE_CR_RREAD);
+    ne_insw(buf, words);
+    if (len & 1) {
+        uint16_t last;
+        ne_insw(&last, 1);
+        ((uint8_t *)buf)[len - 1] = (uint8_t)last;
+    }
+    ne_dma_done();
+}
+
+static uint8_t ne_curr(void) {
+    ne_write(NE_CR, NE_CR_PAGE1 | NE_CR_NODMA | NE_CR_STA);
+    uint8_t curr = ne_read(NE_CURR);
+    ne_write(NE_CR, NE_CR_NODMA | NE_CR_STA);
+    return curr;
+}
+
+/* Reset, program the rings and MAC, start with receive interrupts on. */
 static void ne_init_hw(void) {
-    int i;
-    ne_write(0x00, 0x21);
+    int i, spin = NE_SPIN_MAX;
+    outb(NE2000_RESET, inb(NE2000_RESET));
+    while (!(ne_read(NE_ISR) & NE_ISR_RST) && --spin) ;
+    ne_write(NE_CR, NE_CR_NODMA | NE_CR_STP);
+    ne_write(NE_DCR, 0x49);             /* word transfers, 8-byte FIFO */
+    ne_write(NE_RBCR0, 0);
+    ne_write(NE_RBCR1, 0);
+    ne_write(NE_RCR, 0x20);             /* monitor while setting up */
+    ne_write(NE_TCR, 0x02);             /* internal loopback */
+    ne_write(NE_TPSR, NE_TX_PAGE);
+    ne_write(NE_PSTART, NE_RX_START);
+    ne_write(NE_PSTOP, NE_RX_STOP);
+    ne_write(NE_BNRY, NE_RX_START);
+    ne_write(NE_ISR, 0xFF);
+    ne_write(NE_IMR, 0);
+    ne_write(NE_CR, NE_CR_PAGE1 | NE_CR_NODMA | NE_CR_STP);
     for (i = 0; i < 6; i++)
-        ne_write(0x01 + i, our_mac[i]);
-    ne_write(0x07, 0x49);
-    ne_write(0x08, 0x00);
-    ne_write(0x0C, 0x00);
-    ne_write(0x0D, 0x00);
-    ne_write(0x0E, 0x00);
-    ne_write(0x0F, 0x00);
-    ne_write(0x00, 0x22);
+        ne_write(NE_PAR0 + i, our_mac[i]);
+    ne_write(NE_CURR, NE_RX_START + 1);
+    ne_write(NE_CR, NE_CR_NODMA | NE_CR_STA);
+    ne_write(NE_TCR, 0x00);
+    ne_write(NE_RCR, 0x04);             /* unicast + broadcast */
+    rx_next = NE_RX_START + 1;
+    rx_polling = 0;
+    ne_write(NE_IMR, NE_RX_IRQS);
 }
 
+/* Runts are padded to the 60-byte minimum with zeroes written into the
+ * TX page; the card would otherwise send whatever an earlier frame left
+ * there. An odd last byte goes out in a zero-filled word. */
 static int ne_send(const void *data, uint16_t len) {
-    if (len > 1514) len = 1514;
-    uint16_t i;
-    const uint8_t *p = (const uint8_t *)data;
-    ne_write(0x00, 0x22);
-    ne_write(0x07, 0x49);
-    for (i = 0; i < len; i++)
-        outb(NE2000_IO + 1, p[i]);
-    ne_write(0x00, 0x18);
+    static const uint16_t zero[30];
+    if (len > PBUF_FRAME_MAX) len = PBUF_FRAME_MAX;
+    uint16_t tx_len = len < 60 ? 60 : len;
+    uint16_t dma_len = (uint16_t)((tx_len + 1) & ~1u);
+    uint16_t words = (uint16_t)(len >> 1);
+    int spin = NE_SPIN_MAX;
+    uint32_t flags = plat_lock_irqsave(&ne_lock);
+    while ((ne_read(NE_CR) & NE_CR_TXP) && --spin) ;
+    ne_dma_setup(NE_TX_PAGE << 8, dma_len, NE_CR_RWRITE);
+    ne_outsw(data, words);
+    if (len & 1) {
+        uint16_t last = ((const uint8_t *)data)[len - 1];
+        ne_outsw(&last, 1);
+        words++;
+    }
+    if (words < dma_len / 2) ne_outsw(zero, (uint32_t)(dma_len / 2 - words));
+    ne_dma_done();
+    ne_write(NE_TPSR, NE_TX_PAGE);
+    ne_write(NE_TBCR0, (uint8_t)tx_len);
+    ne_write(NE_TBCR1, (uint8_t)(tx_len >> 8));
+    ne_write(NE_CR, NE_CR_NODMA | NE_CR_TXP | NE_CR_STA);
+    stats.tx_packets++;
+    plat_unlock_irqrestore(&ne_lock, flags);
     return 0;
 }
 
-static int ne_recv(void *buf, uint16_t max) {
-    uint8_t isr = ne_read(0x07);
-    if (!(isr & 0x01)) return 0;
-    uint8_t bn = ne_read(0x0A);
-    if (bn == 0) bn = 0x40;
-    ne_write(0x00, 0x22);
-    ne_write(0x0E, bn);
-    ne_write(0x0F, bn);
-    uint16_t status = inw(NE2000_IO + 1);
-    (void)status;
-    uint16_t len = inw(NE2000_IO + 1) - 4;
-    if (len > max) len = max;
-    uint16_t i;
-    uint8_t *d = (uint8_t *)buf;
-    for (i = 0; i < len; i++)
-        d[i] = inb(NE2000_IO + 1);
-    ne_write(0x0D, bn);
-    ne_write(0x07, 0x40);
-    return (int)len;
+static int ne_rx_drain(int budget);
+
+/* Overflow recovery (DP8390 datasheet): stop, drain what arrived, restart
+ * in loopback so a half-sent frame is not lost, then resume. */
+static void ne_rx_overflow(void) {
+    int spin = NE_SPIN_MAX;
+    uint8_t txp = ne_read(NE_CR) & NE_CR_TXP;
+    ne_write(NE_CR, NE_CR_NODMA | NE_CR_STP);
+    while (!(ne_read(NE_ISR) & NE_ISR_RST) && --spin) ;
+    ne_write(NE_RBCR0, 0);
+    ne_write(NE_RBCR1, 0);
+    ne_write(NE_TCR, 0x02);
+    ne_write(NE_CR, NE_CR_NODMA | NE_CR_STA);
+    ne_rx_drain(NE_RX_STOP - NE_RX_START);
+    ne_write(NE_ISR, NE_ISR_OVW);
+    ne_write(NE_TCR, 0x00);
+    if (txp && !(ne_read(NE_ISR) & (NE_ISR_PTX | NE_ISR_TXE)))
+        ne_write(NE_CR, NE_CR_NODMA | NE_CR_TXP | NE_CR_STA);
+    stats.rx_overruns++;
+}
+
+/* Move up to budget frames from the card ring to rxq (ne_lock held).
+ * Returns 1 if the ring still holds frames. */
+static int ne_rx_drain(int budget) {
+    while (budget-- > 0) {
+        uint8_t curr = ne_curr();
+        if (rx_next == curr) return 0;
+        ne_rx_hdr_t hdr;
+        ne_block_read((uint16_t)(rx_next << 8), &hdr, sizeof(hdr));
+        uint16_t len = (uint16_t)(hdr.count - sizeof(hdr) - 4);
+        if (hdr.next < NE_RX_START || hdr.next >= NE_RX_STOP ||
+            hdr.count < sizeof(hdr) + 4 + PBUF_ETH_HLEN || len > PBUF_FRAME_MAX) {
+            rx_next = curr;                 /* ring corrupt: skip to the write pointer */
+            stats.rx_errors++;
+        } else {
+            pbuf_t *p = (rxq_head - rxq_tail < NE_RXQ_SIZE)
+                      ? pbuf_alloc(PBUF_RX_HEADROOM, len) : (pbuf_t *)0;
+            if (p) {
+                ne_block_read((uint16_t)((rx_next << 8) + sizeof(hdr)), p->payload, len);
+                rxq[rxq_head++ & (NE_RXQ_SIZE - 1)] = p;
+                stats.rx_packets++;
+            } else {
+                stats.rx_dropped++;
+            }
+            rx_next = hdr.next;
+        }
+        ne_write(NE_BNRY, rx_next == NE_RX_START ? NE_RX_STOP - 1 : rx_next - 1);
+    }
+    return rx_next != ne_curr();
+}
+
+static irq_frame_t *ne_irq(irq_frame_t *f) {
+    uint32_t flags = plat_lock_irqsave(&ne_lock);
+    uint8_t isr = ne_read(NE_ISR);
+    stats.rx_irqs++;
+    if (isr & NE_ISR_OVW) {
+        ne_rx_overflow();
+    } else if (isr & (NE_ISR_PRX | NE_ISR_RXE)) {
+        ne_write(NE_ISR, NE_ISR_PRX | NE_ISR_RXE);
+        if (ne_rx_drain(NE_RX_BUDGET)) {
+            ne_write(NE_IMR, 0);            /* more than a budget: switch to polling */
+            rx_polling = 1;
+        }
+    }
+    ne_write(NE_ISR, isr & (NE_ISR_PTX | NE_ISR_TXE));
+    plat_unlock_irqrestore(&ne_lock, flags);
+    return f;
 }
 
 int plat_net_init(void) {
@@ -83,7 +279,11 @@ int plat_net_init(void) {
     our_mask = 0xFFFFFF00u;
     net_ready = 0;
     if (ne_probe()) {
+        uint32_t flags = plat_lock_irqsave(&ne_lock);
+        while (rxq_tail != rxq_head) pbuf_free(rxq[rxq_tail++ & (NE_RXQ_SIZE - 1)]);
         ne_init_hw();
+        plat_unlock_irqrestore(&ne_lock, flags);
+        irq_register(NE2000_IRQ, ne_irq);
         net_ready = 1;
     }
     return 0;
@@ -91,36 +291,81 @@ int plat_net_init(void) {
 
 void plat_net_shutdown(void) {
     net_shutdown();
+    if (net_ready) {
+        irq_register(NE2000_IRQ, (irq_handler_t)0);
+        ne_write(NE_IMR, 0);
+    }
     net_ready = 0;
 }
 
-int plat_net_send(const void *data, size_t len) {
-    if (net_ready) {
-        uint8_t frame[1514];
-        if (len + 14 > sizeof(frame)) len = sizeof(frame) - 14;
-        frame[0] = 0xFF; frame[1] = 0xFF; frame[2] = 0xFF; frame[3] = 0xFF; frame[4] = 0xFF; frame[5] = 0xFF;
-        frame[6] = our_mac[0]; frame[7] = our_mac[1]; frame[8] = our_mac[2];
-        frame[9] = our_mac[3]; frame[10] = our_mac[4]; frame[11] = our_mac[5];
-        frame[12] = 0x08; frame[13] = 0x00;
-        size_t i;
-        for (i = 0; i < len; i++) frame[14 + i] = ((const uint8_t *)data)[i];
-        return ne_send(frame, (uint16_t)(14 + len));
+void plat_net_get_stats(plat_net_stats_t *out) {
+    if (!out) return;
+    uint32_t flags = plat_lock_irqsave(&ne_lock);
+    *out = stats;
+    plat_unlock_irqrestore(&ne_lock, flags);
+}
+
+/* Prepend the MAC header in the buffer's headroom and hand the frame to the
+ * card. Takes ownership of p. */
+int plat_net_send_pbuf(struct pbuf *p) {
+    if (!p) return -1;
+    if (!net_ready) {
+        int len = (int)p->len;
+        pbuf_free(p);
+        return len;
+    }
+    uint8_t *eth = (uint8_t *)pbuf_push(p, PBUF_ETH_HLEN);
+    if (!eth) {
+        pbuf_free(p);
+        return -1;
     }
-    return (int)len;
+    eth[0] = 0xFF; eth[1] = 0xFF; eth[2] = 0xFF; eth[3] = 0xFF; eth[4] = 0xFF; eth[5] = 0xFF;
+    eth[6] = our_mac[0]; eth[7] = our_mac[1]; eth[8] = our_mac[2];
+    eth[9] = our_mac[3]; eth[10] = our_mac[4]; eth[11] = our_mac[5];
+    eth[12] = 0x08; eth[13] = 0x00;
+    int r = ne_send(p->payload, p->len);
+    pbuf_free(p);
+    return r;
 }
 
-int plat_net_recv(void *buf, size_t max_len) {
-    if (net_ready) {
-        uint8_t frame[1514];
-        int n = ne_recv(frame, sizeof(frame));
-        if (n <= 14) return 0;
-        size_t plen = (size_t)n - 14;
-        if (plen > max_len) plen = max_len;
-        size_t i;
-        for (i = 0; i < plen; i++) ((uint8_t *)buf)[i] = frame[14 + i];
-        return (int)plen;
+/* Next frame from rxq, MAC header pulled. While receive IRQs are masked
+ * for load, each call also runs one budget-sized drain of the card ring. */
+struct pbuf *plat_net_recv_pbuf(void) {
+    if (!net_ready) return (struct pbuf *)0;
+    pbuf_t *p = (pbuf_t *)0;
+    uint32_t flags = plat_lock_irqsave(&ne_lock);
+    if (rx_polling) {
+        stats.rx_polls++;
+        if (!ne_rx_drain(NE_RX_BUDGET)) {
+            rx_polling = 0;
+            ne_write(NE_ISR, NE_ISR_PRX | NE_ISR_RXE);
+            ne_write(NE_IMR, NE_RX_IRQS);
+        }
     }
-    return 0;
+    if (rxq_tail != rxq_head) p = rxq[rxq_tail++ & (NE_RXQ_SIZE - 1)];
+    plat_unlock_irqrestore(&ne_lock, flags);
+    if (p) pbuf_pull(p, PBUF_ETH_HLEN);
+    return p;
+}
+
+int plat_net_send(const void *data, size_t len) {
+    if (len > PBUF_FRAME_MAX - PBUF_ETH_HLEN) len = PBUF_FRAME_MAX - PBUF_ETH_HLEN;
+    pbuf_t *p = pbuf_alloc(PBUF_HEADROOM, (uint16_t)len);
+    if (!p) return -1;
+    size_t i;
+    for (i = 0; i < len; i++) p->payload[i] = ((const uint8_t *)data)[i];
+    return plat_net_send_pbuf(p);
+}
+
+int plat_net_recv(void *buf, size_t max_len) {
+    pbuf_t *p = plat_net_recv_pbuf();
+    if (!p) return 0;
+    size_t plen = p->len;
+    if (plen > max_len) plen = max_len;
+    size_t i;
+    for (i = 0; i < plen; i++) ((uint8_t *)buf)[i] = p->payload[i];
+    pbuf_free(p);
+    return (int)plen;
 }
 
 void plat_net_get_info(plat_net_info_t *out) {
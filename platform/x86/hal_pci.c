@@ -0,0 +1,45 @@
+/* x86 PCI configuration access, see pci.h. */
+
+#include "pci.h"
+#include "arch_x86.h"
+#include <stdint.h>
+
+#define PCI_CONFIG_ADDR  0xCF8
+#define PCI_CONFIG_DATA  0xCFC
+
+static uint32_t pci_addr(const pci_dev_t *d, uint8_t off) {
+    return 0x80000000u | ((uint32_t)d->bus << 16) | ((uint32_t)d->dev << 11) |
+           ((uint32_t)d->fn << 8) | (off & 0xFC);
+}
+
+uint32_t pci_read32(const pci_dev_t *d, uint8_t off) {
+    outl(PCI_CONFIG_ADDR, pci_addr(d, off));
+    return inl(PCI_CONFIG_DATA);
+}
+
+void pci_write32(const pci_dev_t *d, uint8_t off, uint32_t val) {
+    outl(PCI_CONFIG_ADDR, pci_addr(d, off));
+    outl(PCI_CONFIG_DATA, val);
+}
+
+/* Brute-force scan; functions 1-7 only on multi-function devices. */
+int pci_find_class(uint8_t cls, uint8_t subclass, pci_dev_t *out) {
+    pci_dev_t d;
+    uint32_t bus;
+    for (bus = 0; bus < 256; bus++) {
+        d.bus = (uint8_t)bus;
+        for (d.dev = 0; d.dev < 32; d.dev++) {
+            uint8_t fns = 1;
+            for (d.fn = 0; d.fn < fns; d.fn++) {
+                if ((pci_read32(&d, PCI_VENDOR_ID) & 0xFFFF) == 0xFFFF) continue;
+                if (d.fn == 0 && (pci_read32(&d, PCI_HEADER) & 0x00800000u)) fns = 8;
+                uint32_t c = pci_read32(&d, PCI_CLASS);
+                if ((c >> 24) == cls && ((c >> 16) & 0xFF) == subclass) {
+                    *out = d;
+                    return 0;
+                }
+            }
+        }
+    }
+    return -1;
+}
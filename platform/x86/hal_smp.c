@@ -0,0 +1,302 @@
+/* x86 SMP bring-up — MADT/MP table parsing, local APIC and AP startup, see smp.h. */
+
+#include "smp.h"
+#include "acpi.h"
+#include "irq.h"
+#include "clock.h"
+#include "platform.h"
+#include "scheduler.h"
+#include "page_alloc.h"
+#include "kernel.h"
+#include "arch_x86.h"
+#include <stdint.h>
+
+#define LAPIC_DEFAULT_BASE   0xFEE00000u
+#define LAPIC_ID             (0x020 / 4)
+#define LAPIC_EOI            (0x0B0 / 4)
+#define LAPIC_SVR            (0x0F0 / 4)
+#define LAPIC_ICR_LO         (0x300 / 4)
+#define LAPIC_ICR_HI         (0x310 / 4)
+#define LAPIC_LVT_TIMER      (0x320 / 4)
+#define LAPIC_TIMER_INIT     (0x380 / 4)
+#define LAPIC_TIMER_CUR      (0x390 / 4)
+#define LAPIC_TIMER_DIV      (0x3E0 / 4)
+
+#define LAPIC_SVR_ENABLE     0x100
+#define LAPIC_LVT_MASKED     0x10000
+#define LAPIC_TIMER_PERIODIC 0x20000
+#define LAPIC_DIV_16         0x3
+#define LAPIC_CAL_MS         10
+#define LAPIC_DEFAULT_PER_MS 6250       /* 100 MHz bus / 16, without a clock */
+
+#define ICR_FIXED            0x00004000u    /* edge, assert */
+#define ICR_INIT             0x00004500u
+#define ICR_STARTUP          0x00004600u
+#define ICR_BUSY             0x00001000u
+
+#define MADT_LAPIC_ADDR      36
+#define MADT_ENTRIES         44
+#define MADT_TYPE_LAPIC      0
+#define MADT_LAPIC_ENABLED   1
+
+#define MP_EBDA_SEG_PTR      0x040Eu
+#define MP_BASE_MEM_TOP      0x0009FC00u
+#define MP_BIOS_START        0x000F0000u
+#define MP_BIOS_END          0x00100000u
+#define MP_CFG_COUNT         34
+#define MP_CFG_LAPIC         36
+#define MP_CFG_ENTRIES       44
+#define MP_ENTRY_CPU         0
+#define MP_CPU_ENABLED       1
+
+/* Patched into the copied trampoline (boot/arch_x86/smp_trampoline.asm). */
+typedef struct {
+    uint16_t gdt_limit;
+    uint32_t gdt_base;
+    uint32_t entry;         /* 32-bit far jump target ... */
+    uint16_t cs;            /* ... and selector */
+    uint16_t ds;
+    uint32_t stack;
+    uint32_t cpu;
+} __attribute__((packed)) smp_tr_params_t;
+
+extern uint8_t smp_trampoline_start[], smp_trampoline_end[], smp_tr_params[];
+extern void smp_ap_entry(void);
+
+static volatile uint32_t *lapic;
+static uint8_t cpu_apic[SMP_MAX_CPUS];
+static uint8_t apic_cpu[256];
+static uint8_t found_apic[SMP_MAX_CPUS];
+static int found;
+static int cpus_online = 1;
+static int smp_active;
+static volatile int ap_booted;
+static uint32_t lapic_per_tick;
+
+static int cpu_has_apic(void) {
+    uint32_t a = 1, b, c, d;
+    __asm__ volatile ("cpuid" : "+a"(a), "=b"(b), "=c"(c), "=d"(d));
+    return (d >> 9) & 1;
+}
+
+static void cpu_add(uint8_t apic_id) {
+    int i;
+    for (i = 0; i < found; i++)
+        if (found_apic[i] == apic_id) return;
+    if (found < SMP_MAX_CPUS) found_apic[found++] = apic_id;
+}
+
+/* ACPI "APIC" table: one type-0 entry per enabled core. */
+static int madt_parse(uint32_t *base) {
+    const uint8_t *t = acpi_find_table("APIC");
+    uint32_t off, len;
+    if (!t) return 0;
+    len = acpi_table_len(t);
+    *base = *(const uint32_t *)(t + MADT_LAPIC_ADDR);
+    for (off = MADT_ENTRIES; off + 2 <= len; off += t[off + 1]) {
+        if (t[off + 1] < 2) break;
+        if (t[off] == MADT_TYPE_LAPIC && t[off + 1] >= 8 &&
+            (*(const uint32_t *)(t + off + 4) & MADT_LAPIC_ENABLED))
+            cpu_add(t[off + 3]);
+    }
+    return found;
+}
+
+/* BIOS data area word; a plain C read of page 0 trips -Warray-bounds. */
+static uint16_t bda_read16(uint32_t addr) {
+    uint16_t v;
+    __asm__ volatile ("movw (%1), %0" : "=r"(v) : "r"(addr));
+    return v;
+}
+
+static const uint8_t *mp_scan(uint32_t start, uint32_t end) {
+    uint32_t a;
+    for (a = start; a + 16 <= end; a += 16) {
+        const uint8_t *p = (const uint8_t *)a;
+        uint8_t sum = 0;
+        int i;
+        if (p[0] != '_' || p[1] != 'M' || p[2] != 'P' || p[3] != '_' || p[8] != 1) continue;
+        for (i = 0; i < 16; i++) sum = (uint8_t)(sum + p[i]);
+        if (sum == 0) return p;
+    }
+    return (const uint8_t *)0;
+}
+
+/* Intel MP floating pointer (EBDA, top of base memory, BIOS ROM) -> PCMP
+ * configuration table -> processor entries. */
+static int mp_parse(uint32_t *base) {
+    uint32_t ebda = (uint32_t)bda_read16(MP_EBDA_SEG_PTR) << 4;
+    const uint8_t *fp = (const uint8_t *)0;
+    uint16_t i, count;
+    if (ebda) fp = mp_scan(ebda, ebda + 1024);
+    if (!fp) fp = mp_scan(MP_BASE_MEM_TOP, MP_BASE_MEM_TOP + 1024);
+    if (!fp) fp = mp_scan(MP_BIOS_START, MP_BIOS_END);
+    if (!fp) return 0;
+    const uint8_t *cfg = (const uint8_t *)*(const uint32_t *)(fp + 4);
+    if (!cfg || cfg[0] != 'P' || cfg[1] != 'C' || cfg[2] != 'M' || cfg[3] != 'P') return 0;
+    *base = *(const uint32_t *)(cfg + MP_CFG_LAPIC);
+    count = *(const uint16_t *)(cfg + MP_CFG_COUNT);
+    const uint8_t *e = cfg + MP_CFG_ENTRIES;
+    for (i = 0; i < count; i++) {
+        if (e[0] == MP_ENTRY_CPU) {
+            if (e[3] & MP_CPU_ENABLED) cpu_add(e[1]);
+            e += 20;
+        } else {
+            e += 8;
+        }
+    }
+    return found;
+}
+
+static uint8_t lapic_read_id(void) {
+    return (uint8_t)(lapic[LAPIC_ID] >> 24);
+}
+
+static void lapic_enable(void) {
+    lapic[LAPIC_SVR] = LAPIC_SVR_ENABLE | IRQ_SPURIOUS_VECTOR;
+    lapic[LAPIC_LVT_TIMER] = LAPIC_LVT_MASKED;
+    lapic[LAPIC_TIMER_DIV] = LAPIC_DIV_16;
+}
+
+static void lapic_ipi(uint8_t apic_id, uint32_t icr) {
+    while (lapic[LAPIC_ICR_LO] & ICR_BUSY) cpu_pause();
+    lapic[LAPIC_ICR_HI] = (uint32_t)apic_id << 24;
+    lapic[LAPIC_ICR_LO] = icr;
+}
+
+/* Busy wait before the scheduler runs: the calibrated clock when there is
+ * one, otherwise the same spin plat_delay_ms uses. */
+static void smp_udelay(uint32_t us) {
+    if (clock_source() != CLOCK_SRC_TICK) {
+        uint64_t end = plat_ticks_us() + us;
+        while (plat_ticks_us() < end) cpu_pause();
+    } else {
+        uint32_t i;
+        for (i = 0; i < us; i++) cpu_pause();
+    }
+}
+
+/* Timer counts per scheduler tick, measured on the BSP's (identical) APIC. */
+static void lapic_timer_calibrate(void) {
+    if (clock_source() == CLOCK_SRC_TICK) {
+        lapic_per_tick = LAPIC_DEFAULT_PER_MS * SCHED_TICK_MS;
+        return;
+    }
+    lapic[LAPIC_TIMER_INIT] = 0xFFFFFFFFu;
+    smp_udelay(LAPIC_CAL_MS * 1000);
+    uint32_t used = 0xFFFFFFFFu - lapic[LAPIC_TIMER_CUR];
+    lapic[LAPIC_TIMER_INIT] = 0;
+    lapic_per_tick = used / LAPIC_CAL_MS * SCHED_TICK_MS;
+    if (!lapic_per_tick) lapic_per_tick = LAPIC_DEFAULT_PER_MS * SCHED_TICK_MS;
+}
+
+int smp_cpu_count(void) {
+    return cpus_online;
+}
+
+int smp_cpu_id(void) {
+    if (!smp_active) return 0;
+    return apic_cpu[lapic_read_id()];
+}
+
+uint8_t smp_apic_id(int cpu) {
+    return (cpu >= 0 && cpu < cpus_online) ? cpu_apic[cpu] : 0;
+}
+
+void smp_send_resched(int cpu) {
+    if (!smp_active || cpu < 0 || cpu >= cpus_online) return;
+    lapic_ipi(cpu_apic[cpu], ICR_FIXED | IRQ_RESCHED_VECTOR);
+}
+
+void lapic_eoi(void) {
+    if (lapic) lapic[LAPIC_EOI] = 0;
+}
+
+void smp_timer_start(void) {
+    lapic[LAPIC_TIMER_DIV] = LAPIC_DIV_16;
+    lapic[LAPIC_LVT_TIMER] = LAPIC_TIMER_PERIODIC | IRQ_LAPIC_TIMER_VECTOR;
+    lapic[LAPIC_TIMER_INIT] = lapic_per_tick;
+}
+
+void smp_timer_stop(void) {
+    lapic[LAPIC_LVT_TIMER] = LAPIC_LVT_MASKED;
+    lapic[LAPIC_TIMER_INIT] = 0;
+}
+
+/* First C code on an AP, on the stack the BSP allocated for it. */
+void smp_ap_main(uint32_t cpu) {
+    irq_init_ap();
+    lapic_enable();
+    ap_booted = 1;
+    sched_start_ap((int)cpu);
+}
+
+/* INIT, then up to two STARTUPs at the trampoline page (MP spec B.4). */
+static int ap_start(int cpu, uint8_t apic_id, smp_tr_params_t *params) {
+    uint8_t *stack = (uint8_t *)page_alloc(SMP_AP_STACK_ORDER);
+    int tries;
+    uint32_t waited;
+    if (!stack) return -1;
+    params->stack = (uint32_t)(stack + ((uint32_t)PAGE_SIZE << SMP_AP_STACK_ORDER));
+    params->cpu = (uint32_t)cpu;
+    cpu_apic[cpu] = apic_id;
+    apic_cpu[apic_id] = (uint8_t)cpu;
+    ap_booted = 0;
+    lapic_ipi(apic_id, ICR_INIT);
+    smp_udelay(10000);
+    for (tries = 0; tries < 2 && !ap_booted; tries++) {
+        lapic_ipi(apic_id, ICR_STARTUP | (SMP_TRAMPOLINE_PHYS >> 12));
+        smp_udelay(200);
+    }
+    for (waited = 0; !ap_booted && waited < SMP_AP_START_MS; waited++)
+        smp_udelay(1000);
+    if (!ap_booted) {
+        apic_cpu[apic_id] = 0;
+        page_free(stack, SMP_AP_STACK_ORDER);
+        return -1;
+    }
+    return 0;
+}
+
+int smp_init(void) {
+    uint32_t base = LAPIC_DEFAULT_BASE;
+    uint32_t i;
+    if (!cpu_has_apic() || (!madt_parse(&base) && !mp_parse(&base))) {
+        kprint("SMP: no APIC/MP tables, 1 CPU\n");
+        return 1;
+    }
+    lapic = (volatile uint32_t *)(base ? base : LAPIC_DEFAULT_BASE);
+    lapic_enable();
+    cpu_apic[0] = lapic_read_id();
+    apic_cpu[cpu_apic[0]] = 0;
+    if (found <= 1) {
+        kprint("SMP: 1 CPU\n");
+        return 1;
+    }
+    lapic_timer_calibrate();
+
+    uint32_t len = (uint32_t)(smp_trampoline_end - smp_trampoline_start);
+    uint8_t *dst = (uint8_t *)SMP_TRAMPOLINE_PHYS;
+    for (i = 0; i < len; i++) dst[i] = smp_trampoline_start[i];
+    smp_tr_params_t *params = (smp_tr_params_t *)(dst + (smp_tr_params - smp_trampoline_start));
+    struct { uint16_t limit; uint32_t base; } __attribute__((packed)) gdtr;
+    __asm__ volatile ("sgdt %0" : "=m"(gdtr));
+    params->gdt_limit = gdtr.limit;
+    params->gdt_base = gdtr.base;
+    params->entry = (uint32_t)smp_ap_entry;
+    params->cs = irq_kernel_cs();
+    params->ds = irq_kernel_ds();
+
+    smp_active = 1;
+    for (i = 0; i < (uint32_t)found && cpus_online < SMP_MAX_CPUS; i++) {
+        if (found_apic[i] == cpu_apic[0]) continue;
+        if (ap_start(cpus_online, found_apic[i], params) != 0) {
+            kprintf("SMP: APIC %d did not start\n", (int)found_apic[i]);
+            continue;
+        }
+        cpus_online++;
+    }
+    kprintf("SMP: %d of %d CPUs online (LAPIC %x, %d counts/tick)\n",
+            cpus_online, found, (uint32_t)lapic, (int)lapic_per_tick);
+    return cpus_online;
+}
@@ -1,29 +1,69 @@
-/* x86 platform HAL — storage (FAT12 file ops on top of ASM sector I/O). */
+/* x86 platform HAL — storage (FAT12 file ops on the sector cache over
+ * the ATA driver). Physically contiguous clusters go down as one
+ * multi-sector request straight into the caller's buffer; only partial
+ * sectors bounce. */
 
 #include "platform.h"
 #include "kernel.h"
+#include "arch_x86.h"
+#include "bcache.h"
+#include "scheduler.h"
 #include <stdint.h>
 
 extern void init_fat12(void);
-extern int fat12_read_sector(uint32_t lba, void *buf);
-extern int fat12_write_sector(uint32_t lba, const void *buf);
 
 #define FAT_ROOT_LBA       51
 #define FAT_ROOT_SECTORS   14
 #define FAT_ROOT_ENTRIES   224
 #define FAT_DATA_START     65
 #define FAT_SECTORS        9
+#define FAT_LBA            33
 #define FAT_END            0xFF8
+#define FAT_EOC            0xFFF
+#define FAT_TOTAL_SECTORS  2880
+#define FAT_MAX_CLUSTER    (FAT_TOTAL_SECTORS - FAT_DATA_START + 2)
 
 static uint8_t fat_cache[FAT_SECTORS * 512];
 static uint8_t root_cache[FAT_ROOT_SECTORS * 512];
 static int fs_ready;
 
+/* Free clusters, one bit each (set = free), kept in step with fat_cache
+ * by fat_set_cluster; allocation never scans the FAT itself. */
+static uint32_t free_map[(FAT_MAX_CLUSTER + 31) / 32];
+static uint32_t free_count;
+/* Sectors of fat_cache / root_cache changed since the last fat_commit. */
+static uint32_t fat_dirty, root_dirty;
+
+/* Held across every plat_fs_* call that touches the tables, the root
+ * directory or the handles: ATA waits sleep, so another task (or the
+ * swap tick) could otherwise run in the middle of an update. */
+static task_mutex_t fs_lock = TASK_MUTEX_INIT;
+
+static int disk_dev_read(void *ctx, uint32_t lba, uint32_t count, void *buf) {
+    (void)ctx;
+    return disk_read_sectors(lba, count, buf);
+}
+
+static int disk_dev_write(void *ctx, uint32_t lba, uint32_t count, const void *buf) {
+    (void)ctx;
+    return disk_write_sectors(lba, count, buf);
+}
+
+static const bcache_dev_t disk_dev = { disk_dev_read, disk_dev_write, 0 };
+static int cache_ready;
+
+static void fat_attach_cache(void) {
+    if (cache_ready) return;
+    bcache_attach(&disk_dev);
+    cache_ready = 1;
+}
+
 static void fat_normalize(const char *src, char *dest83) {
     int i, j = 0;
     for (i = 0; i < 8; i++) dest83[j++] = ' ';
     for (i = 0; i < 3; i++) dest83[8 + i] = ' ';
     i = 0;
+    j = 0;
     while (src[i] && src[i] != '.' && j < 8) {
         char c = src[i++];
         if (c >= 'a' && c <= 'z') c -= 32;
@@ -38,34 +78,206 @@ static void fat_normalize(const char *src, char *dest83) {
     }
 }
 
+static int fat_is_free(uint32_t c) {
+    return (free_map[c >> 5] >> (c & 31)) & 1;
+}
+
+static uint16_t fat_next_cluster(uint16_t cluster) {
+    uint32_t off = cluster + (cluster >> 1);
+    uint16_t val = *(uint16_t *)(fat_cache + off);
+    if (cluster & 1) val >>= 4;
+    else val &= 0x0FFF;
+    return val;
+}
+
+static void fat_set_cluster(uint16_t cluster, uint16_t val) {
+    uint32_t off = cluster + (cluster >> 1);
+    uint16_t *p = (uint16_t *)(fat_cache + off);
+    if (cluster & 1) *p = (uint16_t)((*p & 0x000F) | (val << 4));
+    else *p = (uint16_t)((*p & 0xF000) | (val & 0x0FFF));
+    fat_dirty |= (1u << (off / 512)) | (1u << ((off + 1) / 512));
+    if (cluster >= FAT_MAX_CLUSTER || fat_is_free(cluster) == (val == 0)) return;
+    free_map[cluster >> 5] ^= 1u << (cluster & 31);
+    if (val == 0) free_count++;
+    else free_count--;
+}
+
+static void fat_root_changed(int slot) {
+    root_dirty |= 1u << (slot * 32 / 512);
+}
+
+static void fat_build_free_map(void) {
+    uint32_t c;
+    for (c = 0; c < sizeof(free_map) / sizeof(free_map[0]); c++) free_map[c] = 0;
+    free_count = 0;
+    for (c = 2; c < FAT_MAX_CLUSTER; c++) {
+        if (fat_next_cluster((uint16_t)c) != 0) continue;
+        free_map[c >> 5] |= 1u << (c & 31);
+        free_count++;
+    }
+}
+
 static int fat_load_tables(void) {
-    int s;
-    for (s = 0; s < FAT_SECTORS; s++) {
-        if (fat12_read_sector(33 + s, fat_cache + s * 512) != 0)
+    if (bcache_read(FAT_LBA, FAT_SECTORS, fat_cache) != 0) return -1;
+    if (bcache_read(FAT_ROOT_LBA, FAT_ROOT_SECTORS, root_cache) != 0) return -1;
+    fat_dirty = root_dirty = 0;
+    fat_build_free_map();
+    return 0;
+}
+
+/* The dirty sectors of one table at lba, consecutive ones as one write. */
+static int fat_write_dirty(uint32_t lba, const uint8_t *table, uint32_t dirty, int sectors) {
+    int s = 0, e;
+    while (s < sectors) {
+        if (!(dirty & (1u << s))) {
+            s++;
+            continue;
+        }
+        for (e = s; e < sectors && (dirty & (1u << e)); e++) ;
+        if (bcache_write(lba + s, (uint32_t)(e - s), table + s * 512) != 0) return -1;
+        s = e;
+    }
+    return 0;
+}
+
+/* Hand the changed FAT (both copies) and root directory sectors to the
+ * sector cache; they reach the disk together at its next sync. */
+static int fat_commit(void) {
+    if (fat_dirty) {
+        if (fat_write_dirty(FAT_LBA, fat_cache, fat_dirty, FAT_SECTORS) != 0) return -1;
+        if (fat_write_dirty(FAT_LBA + FAT_SECTORS, fat_cache, fat_dirty, FAT_SECTORS) != 0)
             return -1;
+        fat_dirty = 0;
     }
-    for (s = 0; s < FAT_ROOT_SECTORS; s++) {
-        if (fat12_read_sector(FAT_ROOT_LBA + s, root_cache + s * 512) != 0)
+    if (root_dirty) {
+        if (fat_write_dirty(FAT_ROOT_LBA, root_cache, root_dirty, FAT_ROOT_SECTORS) != 0)
             return -1;
+        root_dirty = 0;
     }
     return 0;
 }
 
-static int fat_flush_root(void) {
-    int s;
-    for (s = 0; s < FAT_ROOT_SECTORS; s++) {
-        if (fat12_write_sector(FAT_ROOT_LBA + s, root_cache + s * 512) != 0)
-            return -1;
+/* Clusters in the chain from cluster (bounded, in case the FAT loops). */
+static uint32_t fat_chain_length(uint16_t cluster) {
+    uint32_t n = 0;
+    while (cluster >= 2 && cluster < FAT_END && n < FAT_MAX_CLUSTER) {
+        cluster = fat_next_cluster(cluster);
+        n++;
     }
-    return 0;
+    return n;
 }
 
-static uint16_t fat_next_cluster(uint16_t cluster) {
-    uint32_t off = cluster + (cluster >> 1);
-    uint16_t val = *(uint16_t *)(fat_cache + off);
-    if (cluster & 1) val >>= 4;
-    else val &= 0x0FFF;
-    return val;
+static void fat_free_chain(uint16_t cluster) {
+    while (cluster >= 2 && cluster < FAT_END) {
+        uint16_t next = fat_next_cluster(cluster);
+        fat_set_cluster(cluster, 0);
+        cluster = next;
+    }
+}
+
+/* Free run for an allocation of want clusters: the shortest run that
+ * holds all of them (best fit), or with want 0 the longest run. Returns
+ * its length and sets *start; 0 if there is none. */
+static uint32_t fat_find_run(uint32_t want, uint16_t *start) {
+    uint32_t best = 0, c = 2, s, len;
+    while (c < FAT_MAX_CLUSTER) {
+        if (!fat_is_free(c)) {
+            c = free_map[c >> 5] >> (c & 31) ? c + 1 : (c | 31) + 1;
+            continue;
+        }
+        for (s = c; c < FAT_MAX_CLUSTER && fat_is_free(c); c++) ;
+        len = c - s;
+        if (want ? (len >= want && (!best || len < best)) : len > best) {
+            best = len;
+            *start = (uint16_t)s;
+            if (len == want) break;
+        }
+    }
+    return best;
+}
+
+/* Link count free clusters into a chain; returns first cluster or 0.
+ * With a hint (a file's last cluster, or 0) the chain is linked onto it
+ * and runs on right after it when that space is free. Otherwise it takes
+ * best-fit extents, so files stay contiguous for multi-sector transfers;
+ * only a fragmented disk splits a file, into the largest runs left. */
+static uint16_t fat_alloc_chain(uint32_t count, uint16_t hint) {
+    uint16_t first = 0, prev = hint, start;
+    uint32_t len, i;
+    if (count == 0 || count > free_count) return 0;
+    while (count) {
+        start = (uint16_t)(prev + 1);
+        if (prev >= 2 && start < FAT_MAX_CLUSTER && fat_is_free(start)) {
+            for (len = 1; len < count && start + len < FAT_MAX_CLUSTER &&
+                          fat_is_free(start + len); len++) ;
+        } else {
+            len = fat_find_run(count, &start);
+            if (!len) len = fat_find_run(0, &start);
+            if (len > count) len = count;
+        }
+        for (i = 0; i < len; i++) {
+            uint16_t c = (uint16_t)(start + i);
+            if (prev >= 2) fat_set_cluster(prev, c);
+            if (!first) first = c;
+            fat_set_cluster(c, FAT_EOC);
+            prev = c;
+        }
+        count -= len;
+    }
+    return first;
+}
+
+/* Follow the chain index clusters from cluster; FAT_END on a short chain. */
+static uint16_t fat_chain_seek(uint16_t cluster, uint32_t index) {
+    while (index-- && cluster >= 2 && cluster < FAT_END)
+        cluster = fat_next_cluster(cluster);
+    return (cluster >= 2) ? cluster : FAT_END;
+}
+
+/* Length of the physically contiguous run starting at cluster, at most max. */
+static uint32_t fat_run_length(uint16_t cluster, uint32_t max) {
+    uint32_t n = 1;
+    while (n < max && fat_next_cluster(cluster) == cluster + 1) {
+        cluster++;
+        n++;
+    }
+    return n;
+}
+
+/* Where a handle is in its file's cluster chain: cluster is chain entry
+ * index. Sequential I/O resumes from here; a seek backwards restarts
+ * from the first cluster, so no call walks the FAT more than once. */
+typedef struct {
+    int slot;               /* root directory entry, -1 = file deleted */
+    uint16_t cluster;       /* 0 = no position yet */
+    uint32_t index;
+    int open;
+} fat_cursor_t;
+
+static fat_cursor_t handles[PLAT_FS_MAX_OPEN];
+
+/* Cluster at chain position index; FAT_END past the end of the chain. */
+static uint16_t fat_cursor_seek(fat_cursor_t *h, uint32_t index) {
+    uint16_t first = *(uint16_t *)(root_cache + h->slot * 32 + 26);
+    if (!h->cluster || index < h->index) {
+        h->cluster = first;
+        h->index = 0;
+    }
+    h->cluster = fat_chain_seek(h->cluster, index - h->index);
+    h->index = index;
+    if (h->cluster >= FAT_END) h->cluster = 0;
+    return h->cluster ? h->cluster : FAT_END;
+}
+
+/* The chain of slot (-1: every file) changed or went away: drop cached
+ * positions. */
+static void fat_cursors_reset(int slot, int deleted) {
+    int i;
+    for (i = 0; i < PLAT_FS_MAX_OPEN; i++) {
+        if (!handles[i].open || (slot >= 0 && handles[i].slot != slot)) continue;
+        handles[i].cluster = 0;
+        if (deleted) handles[i].slot = -1;
+    }
 }
 
 static int fat_find_entry(const char *name83, int *slot_out) {
@@ -83,6 +295,33 @@ static int fat_find_entry(const char *name83, int *slot_out) {
     return -1;
 }
 
+/* Before fat_normalize reset its index, every name was stored as eight
+ * spaces and the first three characters of the whole name ("SWAP.BIN"
+ * became "        SWA"). legacy83 is that form of name83. */
+static void fat_legacy_name(const char *name83, char *legacy83) {
+    char full[12];
+    int i, n = 0;
+    for (i = 0; i < 8 && name83[i] != ' '; i++) full[n++] = name83[i];
+    if (name83[8] != ' ') {
+        if (n) full[n++] = '.';             /* a leading dot was skipped */
+        for (i = 8; i < 11 && name83[i] != ' '; i++) full[n++] = name83[i];
+    }
+    for (i = 0; i < 11; i++) legacy83[i] = ' ';
+    for (i = 0; i < 3 && i < n; i++) legacy83[8 + i] = full[i];
+}
+
+/* Slot of an existing file, falling back to its legacy name so files
+ * written by older kernels stay reachable. New files always get the
+ * proper 8.3 name. */
+static int fat_lookup(const char *name) {
+    char name83[11], legacy83[11];
+    fat_normalize(name, name83);
+    int slot = fat_find_entry(name83, 0);
+    if (slot >= 0) return slot;
+    fat_legacy_name(name83, legacy83);
+    return fat_find_entry(legacy83, 0);
+}
+
 static int fat_find_free_entry(void) {
     int i;
     for (i = 0; i < FAT_ROOT_ENTRIES; i++) {
@@ -93,8 +332,12 @@ static int fat_find_free_entry(void) {
 }
 
 int plat_fs_init(void) {
+    task_mutex_lock(&fs_lock);
+    fat_attach_cache();
     init_fat12();
     fs_ready = (fat_load_tables() == 0);
+    fat_cursors_reset(-1, 0);
+    task_mutex_unlock(&fs_lock);
     return fs_ready ? 0 : -1;
 }
 
@@ -115,6 +358,7 @@ int plat_fs_list(plat_file_info_t *out, unsigned int max) {
     unsigned int n = 0;
     if (!fs_ready && plat_fs_init() != 0) return -1;
     int i;
+    task_mutex_lock(&fs_lock);
     for (i = 0; i < FAT_ROOT_ENTRIES && n < max; i++) {
         uint8_t *e = root_cache + i * 32;
         if (e[0] == 0x00 || e[0] == 0xE5) continue;
@@ -130,94 +374,348 @@ int plat_fs_list(plat_file_info_t *out, unsigned int max) {
         out[n].cluster = *(uint16_t *)(e + 26);
         n++;
     }
+    task_mutex_unlock(&fs_lock);
     return (int)n;
 }
 
-int plat_fs_read(const char *name, void *buf, uint32_t buf_size, uint32_t *out_size) {
-    char name83[11];
+static int fat_read_file(const char *name, void *buf, uint32_t buf_size, uint32_t *out_size) {
     int slot;
     if (!fs_ready && plat_fs_init() != 0) return -1;
-    fat_normalize(name, name83);
-    slot = fat_find_entry(name83, 0);
+    slot = fat_lookup(name);
     if (slot < 0) return -1;
     uint8_t *e = root_cache + slot * 32;
     uint32_t fsize = *(uint32_t *)(e + 28);
     uint16_t cluster = *(uint16_t *)(e + 26);
+    uint32_t want = fsize < buf_size ? fsize : buf_size;
     uint32_t copied = 0;
     uint8_t sector[512];
-    while (cluster < FAT_END && copied < fsize && copied < buf_size) {
-        if (fat12_read_sector(FAT_DATA_START + cluster - 2, sector) != 0) return -1;
-        uint32_t n = 512;
-        if (copied + n > fsize) n = fsize - copied;
-        if (copied + n > buf_size) n = buf_size - copied;
-        uint32_t j;
-        for (j = 0; j < n; j++) ((uint8_t *)buf)[copied + j] = sector[j];
-        copied += n;
-        cluster = fat_next_cluster(cluster);
+    while (cluster >= 2 && cluster < FAT_END && copied < want) {
+        uint32_t whole = (want - copied) / 512;
+        if (whole) {
+            uint32_t n = fat_run_length(cluster, whole);
+            if (bcache_read(FAT_DATA_START + cluster - 2, n,
+                                  (uint8_t *)buf + copied) != 0) return -1;
+            copied += n * 512;
+            cluster = fat_chain_seek(cluster, n);
+        } else {
+            uint32_t j, n = want - copied;
+            if (bcache_read(FAT_DATA_START + cluster - 2, 1, sector) != 0) return -1;
+            for (j = 0; j < n; j++) ((uint8_t *)buf)[copied + j] = sector[j];
+            copied += n;
+        }
     }
     if (out_size) *out_size = copied;
     return 0;
 }
 
-int plat_fs_write(const char *name, const void *data, uint32_t size) {
+int plat_fs_read(const char *name, void *buf, uint32_t buf_size, uint32_t *out_size) {
+    task_mutex_lock(&fs_lock);
+    int rc = fat_read_file(name, buf, buf_size, out_size);
+    task_mutex_unlock(&fs_lock);
+    return rc;
+}
+
+/* Replace name's contents: link a fresh chain, release the old one and
+ * write data (or leave the clusters as-is when data is NULL). When the
+ * disk cannot hold the new contents the file is left as it was. */
+static int fat_store_file(const char *name, const void *data, uint32_t size) {
     char name83[11];
     if (!fs_ready && plat_fs_init() != 0) return -1;
     fat_normalize(name, name83);
-    int slot = fat_find_entry(name83, 0);
+    int slot = fat_lookup(name);
+    uint16_t old = 0;
+    uint32_t need = (size + 511) / 512;
+    if (slot >= 0) old = *(uint16_t *)(root_cache + slot * 32 + 26);
+    if (need > free_count + fat_chain_length(old)) return -1;
     if (slot < 0) {
         slot = fat_find_free_entry();
         if (slot < 0) return -1;
-        uint8_t *e = root_cache + slot * 32;
-        int i;
-        for (i = 0; i < 11; i++) e[i] = (uint8_t)name83[i];
-        e[11] = 0x20;
+        root_cache[slot * 32 + 11] = 0x20;
+        *(uint16_t *)(root_cache + slot * 32 + 26) = 0;
     }
     uint8_t *e = root_cache + slot * 32;
+    int i;
+    for (i = 0; i < 11; i++) e[i] = (uint8_t)name83[i];    /* also renames a legacy entry */
+    uint16_t cluster = 0;
+    /* Only when the new contents need the old clusters too are those
+     * released first; then the allocation cannot fail. */
+    if (need > free_count) {
+        fat_free_chain(old);
+        old = 0;
+    }
+    if (need) cluster = fat_alloc_chain(need, 0);
+    fat_free_chain(old);
+    fat_cursors_reset(slot, 0);
     *(uint32_t *)(e + 28) = size;
-    uint16_t cluster = 2;
     *(uint16_t *)(e + 26) = cluster;
+    fat_root_changed(slot);
     const uint8_t *src = (const uint8_t *)data;
-    uint32_t remaining = size;
+    uint32_t remaining = data ? size : 0;
     uint8_t sector[512];
-    while (remaining > 0 && cluster < FAT_END) {
-        uint32_t n = remaining > 512 ? 512 : remaining;
+    while (remaining > 0 && cluster >= 2 && cluster < FAT_END) {
+        uint32_t lba = FAT_DATA_START + cluster - 2;
+        if (remaining >= 512) {
+            uint32_t n = fat_run_length(cluster, remaining / 512);
+            if (bcache_write(lba, n, src) != 0) return -1;
+            src += n * 512;
+            remaining -= n * 512;
+            cluster = fat_chain_seek(cluster, n);
+        } else {
+            uint32_t j;
+            for (j = 0; j < 512; j++) sector[j] = (j < remaining) ? src[j] : 0;
+            if (bcache_write(lba, 1, sector) != 0) return -1;
+            remaining = 0;
+        }
+    }
+    return fat_commit();
+}
+
+int plat_fs_write(const char *name, const void *data, uint32_t size) {
+    task_mutex_lock(&fs_lock);
+    int rc = fat_store_file(name, data, size);
+    task_mutex_unlock(&fs_lock);
+    return rc;
+}
+
+int plat_fs_create(const char *name, uint32_t size) {
+    task_mutex_lock(&fs_lock);
+    int rc = fat_store_file(name, 0, size);
+    task_mutex_unlock(&fs_lock);
+    return rc;
+}
+
+/* Seek h to the sector holding offset; whole sectors move in contiguous
+ * runs, partial ones through a bounce sector (read-modify-write for
+ * writes). Writes stay inside the current file size. */
+static int fat_file_io(fat_cursor_t *h, uint32_t offset, uint8_t *buf, uint32_t len,
+                       uint32_t *out_len, int write) {
+    uint8_t *e = root_cache + h->slot * 32;
+    uint32_t fsize = *(uint32_t *)(e + 28);
+    if (offset > fsize) return -1;
+    if (len > fsize - offset) {
+        if (write) return -1;
+        len = fsize - offset;
+    }
+    uint32_t index = offset / 512;
+    uint16_t cluster = len ? fat_cursor_seek(h, index) : FAT_END;
+    uint32_t in_sec = offset % 512;
+    uint32_t done = 0;
+    uint8_t sector[512];
+    while (done < len) {
+        if (cluster < 2 || cluster >= FAT_END) return -1;
+        h->cluster = cluster;
+        h->index = index;
+        uint32_t lba = FAT_DATA_START + cluster - 2;
+        uint32_t n = 512 - in_sec;
         uint32_t j;
-        for (j = 0; j < 512; j++) sector[j] = (j < n) ? src[j] : 0;
-        if (fat12_write_sector(FAT_DATA_START + cluster - 2, sector) != 0) return -1;
-        src += n;
-        remaining -= n;
-        cluster++;
+        if (in_sec == 0 && len - done >= 512) {
+            uint32_t run = fat_run_length(cluster, (len - done) / 512);
+            int rc = write ? bcache_write(lba, run, buf + done)
+                           : bcache_read(lba, run, buf + done);
+            if (rc != 0) return -1;
+            done += run * 512;
+            /* stay on the run's last cluster: the chain may end there */
+            h->cluster = (uint16_t)(cluster + run - 1);
+            h->index = index + run - 1;
+            cluster = fat_next_cluster(h->cluster);
+            index += run;
+            continue;
+        }
+        if (n > len - done) n = len - done;
+        if (bcache_read(lba, 1, sector) != 0) return -1;
+        if (write) {
+            for (j = 0; j < n; j++) sector[in_sec + j] = buf[done + j];
+            if (bcache_write(lba, 1, sector) != 0) return -1;
+        } else {
+            for (j = 0; j < n; j++) buf[done + j] = sector[in_sec + j];
+        }
+        done += n;
+        in_sec = 0;
+        cluster = fat_next_cluster(cluster);
+        index++;
     }
-    return fat_flush_root();
+    if (out_len) *out_len = done;
+    return 0;
 }
 
-int plat_fs_delete(const char *name) {
-    char name83[11];
+/* Grow h's file to size bytes, linking fresh clusters onto its chain.
+ * The bytes from the old end up to from (where the caller's write
+ * starts) are zeroed first, so the file never shows what the old tail
+ * sector or the new clusters held before; the rest is about to be
+ * written. On failure the file is left as it was. */
+static int fat_extend(fat_cursor_t *h, uint32_t size, uint32_t from) {
+    static uint8_t zero[512];
+    uint8_t *e = root_cache + h->slot * 32;
+    uint32_t fsize = *(uint32_t *)(e + 28);
+    uint32_t have = (fsize + 511) / 512, need = (size + 511) / 512;
+    uint16_t last = 0, more = 0;
+    uint32_t at;
+    if (size <= fsize) return 0;
+    if (need > have) {
+        last = have ? fat_cursor_seek(h, have - 1) : 0;
+        if (last >= FAT_END) return -1;         /* chain shorter than the size */
+        more = fat_alloc_chain(need - have, last);
+        if (!more) return -1;
+        if (!have) *(uint16_t *)(e + 26) = more;
+    }
+    *(uint32_t *)(e + 28) = size;
+    if (from > size) from = size;
+    for (at = fsize; at < from; ) {
+        uint32_t n = 512 - at % 512;
+        if (n > from - at) n = from - at;
+        if (fat_file_io(h, at, zero, n, 0, 1) != 0) {
+            *(uint32_t *)(e + 28) = fsize;
+            if (more) {
+                fat_free_chain(more);
+                if (last) fat_set_cluster(last, FAT_EOC);
+                else *(uint16_t *)(e + 26) = 0;
+            }
+            h->cluster = 0;
+            fat_cursors_reset(h->slot, 0);
+            return -1;
+        }
+        at += n;
+    }
+    fat_root_changed(h->slot);
+    return fat_commit();
+}
+
+static int fat_open_slot(const char *name) {
     if (!fs_ready && plat_fs_init() != 0) return -1;
-    fat_normalize(name, name83);
-    int slot = fat_find_entry(name83, 0);
+    return fat_lookup(name);
+}
+
+int plat_fs_read_at(const char *name, uint32_t offset, void *buf, uint32_t len, uint32_t *out_len) {
+    task_mutex_lock(&fs_lock);
+    fat_cursor_t h = { fat_open_slot(name), 0, 0, 1 };
+    int rc = h.slot < 0 ? -1 : fat_file_io(&h, offset, (uint8_t *)buf, len, out_len, 0);
+    task_mutex_unlock(&fs_lock);
+    return rc;
+}
+
+int plat_fs_write_at(const char *name, uint32_t offset, const void *data, uint32_t len) {
+    task_mutex_lock(&fs_lock);
+    fat_cursor_t h = { fat_open_slot(name), 0, 0, 1 };
+    int rc = h.slot < 0 ? -1 : fat_file_io(&h, offset, (uint8_t *)data, len, 0, 1);
+    task_mutex_unlock(&fs_lock);
+    return rc;
+}
+
+int plat_fs_open(const char *name) {
+    task_mutex_lock(&fs_lock);
+    int fd, slot = fat_open_slot(name);
+    for (fd = 0; slot >= 0 && fd < PLAT_FS_MAX_OPEN; fd++) {
+        if (handles[fd].open) continue;
+        handles[fd].slot = slot;
+        handles[fd].cluster = 0;
+        handles[fd].index = 0;
+        handles[fd].open = 1;
+        task_mutex_unlock(&fs_lock);
+        return fd;
+    }
+    task_mutex_unlock(&fs_lock);
+    return -1;
+}
+
+/* Open handle whose file still exists, or NULL. */
+static fat_cursor_t *fat_handle(int fd) {
+    if (fd < 0 || fd >= PLAT_FS_MAX_OPEN || !handles[fd].open) return 0;
+    return handles[fd].slot >= 0 ? &handles[fd] : 0;
+}
+
+int plat_fs_pread(int fd, uint32_t offset, void *buf, uint32_t len, uint32_t *out_len) {
+    task_mutex_lock(&fs_lock);
+    fat_cursor_t *h = fat_handle(fd);
+    int rc = !h ? -1 : fat_file_io(h, offset, (uint8_t *)buf, len, out_len, 0);
+    task_mutex_unlock(&fs_lock);
+    return rc;
+}
+
+int plat_fs_pwrite(int fd, uint32_t offset, const void *data, uint32_t len) {
+    int rc = -1;
+    task_mutex_lock(&fs_lock);
+    fat_cursor_t *h = fat_handle(fd);
+    if (h && offset + len >= offset && fat_extend(h, offset + len, offset) == 0)
+        rc = fat_file_io(h, offset, (uint8_t *)data, len, 0, 1);
+    task_mutex_unlock(&fs_lock);
+    return rc;
+}
+
+int plat_fs_size(int fd, uint32_t *out_size) {
+    task_mutex_lock(&fs_lock);
+    fat_cursor_t *h = fat_handle(fd);
+    if (h) *out_size = *(uint32_t *)(root_cache + h->slot * 32 + 28);
+    task_mutex_unlock(&fs_lock);
+    return h ? 0 : -1;
+}
+
+int plat_fs_close(int fd) {
+    int rc = -1;
+    task_mutex_lock(&fs_lock);
+    if (fd >= 0 && fd < PLAT_FS_MAX_OPEN && handles[fd].open) {
+        handles[fd].open = 0;
+        rc = 0;
+    }
+    task_mutex_unlock(&fs_lock);
+    return rc;
+}
+
+static int fat_delete_file(const char *name) {
+    if (!fs_ready && plat_fs_init() != 0) return -1;
+    int slot = fat_lookup(name);
     if (slot < 0) return -1;
+    fat_free_chain(*(uint16_t *)(root_cache + slot * 32 + 26));
     root_cache[slot * 32] = 0xE5;
-    return fat_flush_root();
+    fat_root_changed(slot);
+    fat_cursors_reset(slot, 1);
+    return fat_commit();
+}
+
+int plat_fs_delete(const char *name) {
+    task_mutex_lock(&fs_lock);
+    int rc = fat_delete_file(name);
+    task_mutex_unlock(&fs_lock);
+    return rc;
 }
 
 int plat_fs_validate(void) {
     uint8_t boot[512];
-    if (fat12_read_sector(0, boot) != 0) return -1;
+    fat_attach_cache();
+    if (bcache_read(0, 1, boot) != 0) return -1;
     return (boot[510] == 0x55 && boot[511] == 0xAA) ? 0 : -1;
 }
 
 int plat_fs_repair(void) {
-    if (plat_fs_init() != 0) return -1;
-    return 0;
+    task_mutex_lock(&fs_lock);
+    fat_attach_cache();
+    bcache_invalidate();                    /* re-read the tables from disk */
+    int rc = plat_fs_init();
+    task_mutex_unlock(&fs_lock);
+    return rc != 0 ? -1 : 0;
 }
 
 int plat_fs_read_sector(uint32_t lba, void *buf) {
-    return fat12_read_sector(lba, buf);
+    fat_attach_cache();
+    return bcache_read(lba, 1, buf);
 }
 
 int plat_fs_write_sector(uint32_t lba, const void *buf) {
-    return fat12_write_sector(lba, buf);
+    fat_attach_cache();
+    return bcache_write(lba, 1, buf);
+}
+
+int plat_fs_read_sectors(uint32_t lba, uint32_t count, void *buf) {
+    fat_attach_cache();
+    return bcache_read(lba, count, buf);
+}
+
+int plat_fs_write_sectors(uint32_t lba, uint32_t count, const void *buf) {
+    fat_attach_cache();
+    return bcache_write(lba, count, buf);
+}
+
+int plat_fs_sync(void) {
+    return bcache_sync();
 }
 
 /* C wrappers for legacy fs.h API */
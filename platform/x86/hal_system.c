@@ -2,17 +2,37 @@
 
 #include "platform.h"
 #include "memory_manager.h"
+#include "page_alloc.h"
 #include "kernel.h"
 #include "syscalls.h"
+#include "boot_params.h"
+#include "irq.h"
+#include "clock.h"
+#include "ata.h"
+#include "scheduler.h"
+#include "arch_x86.h"
 #include <stdint.h>
 
 extern uint32_t detect_ps2_memory(void);
+extern char _kernel_end[];
+
+#define LOW_MEM_END  0x00100000u
+
+#define PIT_CH0      0x40
+#define PIT_CMD      0x43
+#define PIT_MODE_ONESHOT   0x30     /* channel 0, lo/hi byte, mode 0 */
+#define PIT_MODE_PERIODIC  0x34     /* channel 0, lo/hi byte, mode 2 */
+#define PIT_LATCH_CH0      0x00
 
 static uint32_t tick_ms;
 
 void plat_init(void) {
     tick_ms = 0;
+    disable_interrupts_asm();
+    irq_init();
     sys_timer_init();
+    clock_init();
+    ata_init();
 }
 
 const char *plat_model_string(void) {
@@ -30,9 +50,47 @@ uint32_t plat_mem_total_kb(void) {
     return mb * 1024;
 }
 
+/* E820 usable ranges above 1MB, minus the kernel image and its stack.
+ * Falls back to [kernel end, detected size) when the probe found nothing. */
+int plat_mem_map(plat_mem_region_t *out, unsigned int max) {
+    const boot_params_t *bp = get_boot_params();
+    uint32_t kend = (uint32_t)_kernel_end;
+    uint32_t count = bp->e820_count;
+    unsigned int n = 0;
+    uint32_t i;
+    if (count > BOOT_E820_MAX) count = BOOT_E820_MAX;
+    for (i = 0; i < count && n < max; i++) {
+        const boot_e820_entry_t *e = &bp->e820[i];
+        if (e->type != BOOT_E820_USABLE || (e->base >> 32)) continue;
+        uint64_t end64 = e->base + e->length;
+        uint32_t base = (uint32_t)e->base;
+        uint32_t end = (end64 >> 32) ? 0xFFFFF000u : (uint32_t)end64;
+        if (base < LOW_MEM_END) base = LOW_MEM_END;
+        if (base < kend) base = kend;
+        if (end <= base) continue;
+        out[n].base = base;
+        out[n].length = end - base;
+        n++;
+    }
+    if (n == 0 && max > 0) {
+        uint32_t end = plat_mem_total_kb() * 1024;
+        if (end > kend) {
+            out[0].base = kend;
+            out[0].length = end - kend;
+            n = 1;
+        }
+    }
+    return (int)n;
+}
+
+/* Everything not sitting free in the page allocator or the heap. */
 uint32_t plat_mem_used_kb(void) {
-    unsigned int pct = get_memory_usage_percent();
-    return (plat_mem_total_kb() * pct) / 100;
+    heap_stats_t hs;
+    heap_get_stats(&hs);
+    uint32_t free_kb = page_alloc_free_pages() * (PAGE_SIZE / 1024) +
+                       (uint32_t)(hs.free_bytes / 1024);
+    uint32_t t = plat_mem_total_kb();
+    return (free_kb < t) ? (t - free_kb) : 0;
 }
 
 uint32_t plat_mem_free_kb(void) {
@@ -41,20 +99,64 @@ uint32_t plat_mem_free_kb(void) {
     return (u < t) ? (t - u) : 0;
 }
 
-uint32_t plat_ticks_ms(void) {
-    return sys_timer_get();
-}
-
 extern void cpu_pause(void);
 extern void system_reboot(void);
 
+static void pit_write_count(uint8_t mode, uint32_t count) {
+    outb(PIT_CMD, mode);
+    outb(PIT_CH0, (uint8_t)(count & 0xFF));
+    outb(PIT_CH0, (uint8_t)(count >> 8));
+}
+
+void pit_set_periodic(void) {
+    pit_write_count(PIT_MODE_PERIODIC, PIT_DIVISOR);
+}
+
+void pit_set_oneshot(uint32_t ticks) {
+    if (ticks < 1) ticks = 1;
+    if (ticks > PIT_ONESHOT_MAX_TICKS) ticks = PIT_ONESHOT_MAX_TICKS;
+    pit_write_count(PIT_MODE_ONESHOT, ticks * PIT_DIVISOR);
+}
+
+/* Mode 0 keeps counting down past zero, so a count above the programmed one
+ * means the one-shot has already fired. */
+uint32_t pit_oneshot_elapsed(uint32_t ticks) {
+    uint32_t total = ticks * PIT_DIVISOR;
+    uint32_t left;
+    outb(PIT_CMD, PIT_LATCH_CH0);
+    left = inb(PIT_CH0);
+    left |= (uint32_t)inb(PIT_CH0) << 8;
+    if (left == 0 || left > total) return ticks;
+    return (total - left) / PIT_DIVISOR;
+}
+
+/* Tasks sleep (the idle task halts the CPU meanwhile); spin only before the
+ * scheduler runs or where sleeping is not allowed. */
+static int delay_can_sleep(void) {
+    uint32_t flags;
+    if (!sched_preemptive() || irq_in_handler()) return 0;
+    flags = plat_irq_save();
+    plat_irq_restore(flags);
+    return (flags & 0x200) != 0;
+}
+
 void plat_delay_ms(uint32_t ms) {
-    for (uint32_t i = 0; i < ms * 1000; i++)
-        cpu_pause();
+    if (delay_can_sleep()) {
+        task_sleep_ms(ms);
+    } else {
+        for (uint32_t i = 0; i < ms * 1000; i++)
+            cpu_pause();
+    }
     tick_ms += ms;
 }
 
+void plat_idle(void) {
+    if (delay_can_sleep()) task_sleep_ms(SCHED_TICK_MS);
+    else cpu_pause();
+}
+
 void plat_reboot(void) {
+    plat_fs_sync();
     system_reboot();
 }
 
@@ -0,0 +1,244 @@
+/* Sector buffer cache, see bcache.h. */
+
+#include "bcache.h"
+#include "platform.h"
+#include "scheduler.h"
+#include <stdint.h>
+
+#define BC_NONE  (-1)
+
+typedef struct {
+    uint32_t lba;
+    int16_t hnext;          /* hash chain */
+    int16_t prev, next;     /* LRU list, most recent first; free slots at the tail */
+    uint8_t valid;
+    uint8_t dirty;
+} bc_entry_t;
+
+static bc_entry_t entries[BCACHE_ENTRIES];
+static uint32_t data[BCACHE_ENTRIES][BCACHE_SECTOR_SIZE / 4];
+static uint32_t stage[BCACHE_WRITE_MAX][BCACHE_SECTOR_SIZE / 4];   /* write-back runs */
+static int16_t hash[BCACHE_HASH];
+static int16_t lru_head, lru_tail;
+static bcache_dev_t dev;
+static int attached;
+static uint32_t dirty_since;            /* ms when the cache last went dirty */
+static bcache_stats_t stats;
+/* Held across device requests too: an ATA wait sleeps, and a sector
+ * rewritten while its old contents sit in stage[] must stay dirty. */
+static task_mutex_t bc_lock = TASK_MUTEX_INIT;
+
+static int bc_sync(void);
+
+static void bc_copy(void *dst, const void *src) {
+    uint32_t *d = (uint32_t *)dst;
+    const uint32_t *s = (const uint32_t *)src;
+    int n = BCACHE_SECTOR_SIZE / 4;
+    while (n--) *d++ = *s++;
+}
+
+static int bc_find(uint32_t lba) {
+    int i = hash[lba & (BCACHE_HASH - 1)];
+    while (i != BC_NONE && entries[i].lba != lba) i = entries[i].hnext;
+    return i;
+}
+
+static void bc_hash_remove(int i) {
+    int16_t *p = &hash[entries[i].lba & (BCACHE_HASH - 1)];
+    while (*p != i) p = &entries[*p].hnext;
+    *p = entries[i].hnext;
+}
+
+static void bc_lru_unlink(int i) {
+    if (entries[i].prev != BC_NONE) entries[entries[i].prev].next = entries[i].next;
+    else lru_head = entries[i].next;
+    if (entries[i].next != BC_NONE) entries[entries[i].next].prev = entries[i].prev;
+    else lru_tail = entries[i].prev;
+}
+
+/* Most recently used. */
+static void bc_touch(int i) {
+    bc_lru_unlink(i);
+    entries[i].prev = BC_NONE;
+    entries[i].next = lru_head;
+    if (lru_head != BC_NONE) entries[lru_head].prev = (int16_t)i;
+    else lru_tail = (int16_t)i;
+    lru_head = (int16_t)i;
+}
+
+static void bc_reset(void) {
+    int i;
+    for (i = 0; i < BCACHE_HASH; i++) hash[i] = BC_NONE;
+    for (i = 0; i < BCACHE_ENTRIES; i++) {
+        entries[i].valid = 0;
+        entries[i].dirty = 0;
+        entries[i].hnext = BC_NONE;
+        entries[i].prev = (int16_t)(i - 1);
+        entries[i].next = (int16_t)(i + 1 < BCACHE_ENTRIES ? i + 1 : BC_NONE);
+    }
+    lru_head = 0;
+    lru_tail = BCACHE_ENTRIES - 1;
+    stats.dirty = 0;
+    stats.cached = 0;
+}
+
+/* Take the least recently used slot for lba (contents undefined); a
+ * dirty victim is synced first. BC_NONE if that write-back fails. */
+static int bc_alloc(uint32_t lba) {
+    int i = lru_tail;
+    if (entries[i].valid) {
+        if (entries[i].dirty && bc_sync() != 0) return BC_NONE;
+        bc_hash_remove(i);
+        stats.evictions++;
+        stats.cached--;
+    }
+    entries[i].lba = lba;
+    entries[i].valid = 1;
+    entries[i].dirty = 0;
+    entries[i].hnext = hash[lba & (BCACHE_HASH - 1)];
+    hash[lba & (BCACHE_HASH - 1)] = (int16_t)i;
+    stats.cached++;
+    bc_touch(i);
+    return i;
+}
+
+void bcache_attach(const bcache_dev_t *d) {
+    task_mutex_lock(&bc_lock);
+    if (attached) bc_sync();
+    dev = *d;
+    attached = 1;
+    bc_reset();
+    task_mutex_unlock(&bc_lock);
+}
+
+static int bc_read(uint32_t lba, uint32_t count, void *buf) {
+    uint8_t *p = (uint8_t *)buf;
+    uint32_t k = 0, j;
+    if (!attached) return -1;
+    while (k < count) {
+        int i = bc_find(lba + k);
+        if (i != BC_NONE) {
+            bc_copy(p + k * BCACHE_SECTOR_SIZE, data[i]);
+            bc_touch(i);
+            stats.hits++;
+            k++;
+            continue;
+        }
+        uint32_t run = 1;
+        while (k + run < count && bc_find(lba + k + run) == BC_NONE) run++;
+        if (dev.read(dev.ctx, lba + k, run, p + k * BCACHE_SECTOR_SIZE) != 0) return -1;
+        stats.misses += run;
+        for (j = 0; j < run && run <= BCACHE_FILL_MAX; j++) {
+            i = bc_alloc(lba + k + j);
+            if (i != BC_NONE) bc_copy(data[i], p + (k + j) * BCACHE_SECTOR_SIZE);
+        }
+        k += run;
+    }
+    return 0;
+}
+
+int bcache_read(uint32_t lba, uint32_t count, void *buf) {
+    task_mutex_lock(&bc_lock);
+    int rc = bc_read(lba, count, buf);
+    task_mutex_unlock(&bc_lock);
+    return rc;
+}
+
+static int bc_write(uint32_t lba, uint32_t count, const void *buf) {
+    const uint8_t *p = (const uint8_t *)buf;
+    uint32_t k;
+    if (!attached) return -1;
+    if (count > BCACHE_WRITE_MAX) {
+        if (dev.write(dev.ctx, lba, count, buf) != 0) return -1;
+        for (k = 0; k < count; k++) {
+            int i = bc_find(lba + k);
+            if (i == BC_NONE) continue;
+            bc_copy(data[i], p + k * BCACHE_SECTOR_SIZE);
+            if (entries[i].dirty) {
+                entries[i].dirty = 0;
+                stats.dirty--;
+            }
+        }
+        return 0;
+    }
+    for (k = 0; k < count; k++) {
+        int i = bc_find(lba + k);
+        if (i == BC_NONE) i = bc_alloc(lba + k);
+        else bc_touch(i);
+        if (i == BC_NONE) return -1;
+        bc_copy(data[i], p + k * BCACHE_SECTOR_SIZE);
+        if (!entries[i].dirty) {
+            entries[i].dirty = 1;
+            if (stats.dirty++ == 0) dirty_since = plat_ticks_ms();
+        }
+    }
+    return 0;
+}
+
+int bcache_write(uint32_t lba, uint32_t count, const void *buf) {
+    task_mutex_lock(&bc_lock);
+    int rc = bc_write(lba, count, buf);
+    task_mutex_unlock(&bc_lock);
+    return rc;
+}
+
+/* Dirty sectors sorted by LBA, written as runs of up to BCACHE_WRITE_MAX. */
+static int bc_sync(void) {
+    int16_t order[BCACHE_ENTRIES];
+    int n = 0, a, b, i, rc = 0;
+    if (!attached || stats.dirty == 0) return 0;
+    for (i = 0; i < BCACHE_ENTRIES; i++) {
+        if (!entries[i].dirty) continue;
+        for (a = n++; a > 0 && entries[order[a - 1]].lba > entries[i].lba; a--)
+            order[a] = order[a - 1];
+        order[a] = (int16_t)i;
+    }
+    for (a = 0; a < n; a = b) {
+        uint32_t first = entries[order[a]].lba;
+        for (b = a; b < n && b - a < BCACHE_WRITE_MAX &&
+                    entries[order[b]].lba == first + (uint32_t)(b - a); b++)
+            bc_copy(stage[b - a], data[order[b]]);
+        if (dev.write(dev.ctx, first, (uint32_t)(b - a), stage) != 0) {
+            rc = -1;
+            continue;
+        }
+        for (i = a; i < b; i++) entries[order[i]].dirty = 0;
+        stats.dirty -= (uint32_t)(b - a);
+        stats.writebacks += (uint32_t)(b - a);
+    }
+    if (stats.dirty) dirty_since = plat_ticks_ms();
+    return rc;
+}
+
+int bcache_sync(void) {
+    task_mutex_lock(&bc_lock);
+    int rc = bc_sync();
+    task_mutex_unlock(&bc_lock);
+    return rc;
+}
+
+int bcache_invalidate(void) {
+    int rc = -1;
+    task_mutex_lock(&bc_lock);
+    if (bc_sync() == 0) {
+        bc_reset();
+        rc = 0;
+    }
+    task_mutex_unlock(&bc_lock);
+    return rc;
+}
+
+/* Housekeeping: a foreground request in flight keeps the data for the
+ * next tick. */
+void bcache_tick(void) {
+    if (task_mutex_trylock(&bc_lock) != 0) return;
+    if (stats.dirty && plat_ticks_ms() - dirty_since >= BCACHE_WRITEBACK_MS)
+        bc_sync();
+    task_mutex_unlock(&bc_lock);
+}
+
+void bcache_get_stats(bcache_stats_t *out) {
+    task_mutex_lock(&bc_lock);
+    *out = stats;
+    task_mutex_unlock(&bc_lock);
+}
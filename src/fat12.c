@@ -1,12 +1,14 @@
 /* Unified FAT12 implementation for boot stage2 and kernel HAL. */
 
 #include "fat12.h"
+#include "bcache.h"
 
 void fat12_normalize_name(const char *src, char *dest83) {
     int i, j = 0;
     for (i = 0; i < 8; i++) dest83[j++] = ' ';
     for (i = 0; i < 3; i++) dest83[8 + i] = ' ';
     i = 0;
+    j = 0;
     while (src[i] && src[i] != '.' && j < 8) {
         char c = src[i++];
         if (c >= 'a' && c <= 'z') c -= 32;
@@ -25,29 +27,69 @@ void fat12_init(fat12_fs_t *fs, block_dev_t *dev) {
     if (!fs) return;
     fs->dev = dev;
     fs->ready = 0;
+    fs->fat_dirty = 0;
+}
+
+/* Sector cache backend: the BIOS device takes one sector per call. */
+static int fat12_dev_read(void *ctx, uint32_t lba, uint32_t count, void *buf) {
+    uint8_t *p = (uint8_t *)buf;
+    while (count--) {
+        if (block_dev_read((block_dev_t *)ctx, lba++, p) != 0) return -1;
+        p += BLOCK_SECTOR_SIZE;
+    }
+    return 0;
+}
+
+static int fat12_dev_write(void *ctx, uint32_t lba, uint32_t count, const void *buf) {
+    const uint8_t *p = (const uint8_t *)buf;
+    while (count--) {
+        if (block_dev_write((block_dev_t *)ctx, lba++, p) != 0) return -1;
+        p += BLOCK_SECTOR_SIZE;
+    }
+    return 0;
 }
 
 int fat12_read_sector(const fat12_fs_t *fs, uint32_t lba, void *buf) {
     if (!fs || !fs->dev) return -1;
-    return block_dev_read(fs->dev, lba, buf);
+    return bcache_read(lba, 1, buf);
 }
 
 int fat12_write_sector(fat12_fs_t *fs, uint32_t lba, const void *buf) {
     if (!fs || !fs->dev) return -1;
-    int r = block_dev_write(fs->dev, lba, buf);
+    int r = bcache_write(lba, 1, buf);
     if (r != 0) return r;
-    /* Mirror FAT copy 2 when writing FAT copy 1 */
+    /* FAT copy 1: copy 2 follows at fat12_sync */
     if (lba >= FAT12_RESERVED_SECTORS &&
-        lba < (uint32_t)(FAT12_RESERVED_SECTORS + FAT12_SECTORS_PER_FAT)) {
-        uint32_t mirror = lba + FAT12_SECTORS_PER_FAT;
-        block_dev_write(fs->dev, mirror, buf);
-    }
+        lba < (uint32_t)(FAT12_RESERVED_SECTORS + FAT12_SECTORS_PER_FAT))
+        fs->fat_dirty |= 1u << (lba - FAT12_RESERVED_SECTORS);
     return 0;
 }
 
+/* Mirror the FAT sectors changed since the last sync into copy 2, then
+ * write the cache back; the cache sends both copies' consecutive dirty
+ * sectors as single writes. */
+int fat12_sync(fat12_fs_t *fs) {
+    uint8_t sector[BLOCK_SECTOR_SIZE];
+    int s;
+    if (!fs || !fs->dev) return -1;
+    for (s = 0; s < FAT12_SECTORS_PER_FAT; s++) {
+        if (!(fs->fat_dirty & (1u << s))) continue;
+        if (bcache_read(FAT12_RESERVED_SECTORS + s, 1, sector) != 0 ||
+            bcache_write(FAT12_RESERVED_SECTORS + FAT12_SECTORS_PER_FAT + s, 1, sector) != 0)
+            return -1;
+        fs->fat_dirty &= ~(1u << s);
+    }
+    return bcache_sync();
+}
+
 int fat12_mount(fat12_fs_t *fs) {
     int s;
+    bcache_dev_t bd;
     if (!fs || !fs->dev) return -1;
+    bd.read = fat12_dev_read;
+    bd.write = fat12_dev_write;
+    bd.ctx = fs->dev;
+    bcache_attach(&bd);
     for (s = 0; s < FAT12_SECTORS_PER_FAT; s++) {
         if (fat12_read_sector(fs, FAT12_RESERVED_SECTORS + s,
                               fs->fat + s * BLOCK_SECTOR_SIZE) != 0)
@@ -76,7 +118,21 @@ int fat12_read_cluster(const fat12_fs_t *fs, uint16_t cluster, void *buf) {
     return fat12_read_sector(fs, lba, buf);
 }
 
-int fat12_find_entry(const fat12_fs_t *fs, const char *name83, int *slot_out) {
+/* Names stored before fat12_normalize_name reset its index: eight
+ * spaces and the first three characters of the whole name. */
+static void fat12_legacy_name(const char *name83, char *legacy83) {
+    char full[12];
+    int i, n = 0;
+    for (i = 0; i < 8 && name83[i] != ' '; i++) full[n++] = name83[i];
+    if (name83[8] != ' ') {
+        if (n) full[n++] = '.';
+        for (i = 8; i < 11 && name83[i] != ' '; i++) full[n++] = name83[i];
+    }
+    for (i = 0; i < 11; i++) legacy83[i] = ' ';
+    for (i = 0; i < 3 && i < n; i++) legacy83[8 + i] = full[i];
+}
+
+static int fat12_match_entry(const fat12_fs_t *fs, const char *name83, int *slot_out) {
     int i;
     for (i = 0; i < FAT12_ROOT_ENTRIES; i++) {
         uint8_t *e = fs->root + i * 32;
@@ -93,6 +149,15 @@ int fat12_find_entry(const fat12_fs_t *fs, const char *name83, int *slot_out) {
     return -1;
 }
 
+/* Falls back to the legacy form, so files written by older kernels
+ * stay readable. */
+int fat12_find_entry(const fat12_fs_t *fs, const char *name83, int *slot_out) {
+    char legacy83[11];
+    if (fat12_match_entry(fs, name83, slot_out) == 0) return 0;
+    fat12_legacy_name(name83, legacy83);
+    return fat12_match_entry(fs, legacy83, slot_out);
+}
+
 int fat12_read_file(const fat12_fs_t *fs, const char *name83, void *buf, uint32_t max, uint32_t *out_size) {
     int slot;
     if (!fs || !fs->ready || fat12_find_entry(fs, name83, &slot) != 0) return -1;
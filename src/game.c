@@ -142,6 +142,18 @@ const char* get_game_type_name(uint32_t type) {
     }
 }
 
+/* Frame pacing on the real-time clock: sleep until the next frame boundary
+ * so a frame lasts period_ms however long update and draw took. A frame
+ * that overran by a whole period resynchronises instead of bursting. */
+static void game_frame_wait(uint32_t *next_ms, uint32_t period_ms) {
+    uint32_t now = plat_ticks_ms();
+    if (*next_ms == 0 || (int32_t)(now - *next_ms) >= (int32_t)period_ms)
+        *next_ms = now;
+    *next_ms += period_ms;
+    if ((int32_t)(*next_ms - now) > 0)
+        plat_delay_ms(*next_ms - now);
+}
+
 /* Snake: grid 16x10, cell 20x20 pixels. Max length 64. */
 #define SNAKE_GRID_W   16
 #define SNAKE_GRID_H   10
@@ -244,6 +256,7 @@ static void snake_draw(void) {
 }
 
 void snake_run(void) {
+    uint32_t frame_next = 0;
     while (!snake_game_over) {
         uint8_t sc;
         while ((sc = keyboard_get_scancode()) != 0) {
@@ -257,7 +270,7 @@ void snake_run(void) {
         game_history_tick();
         if (snake_game_over) break;
         snake_draw();
-        for (volatile int d = 0; d < 80000; d++) ;
+        game_frame_wait(&frame_next, 100);
     }
 
     snake_draw();
@@ -265,7 +278,7 @@ void snake_run(void) {
     draw_text(60, 105, "Score:", 0xFFFFFF);
     draw_number(110, 105, (uint32_t)snake_score, 0xFFFFFF);
     draw_text(50, 125, "Press any key", 0xAAAAAA);
-    while (!keyboard_has_key()) { for (volatile int d = 0; d < 5000; d++) ; }
+    while (!keyboard_has_key()) plat_idle();
     while (keyboard_get_scancode() != 0) ;
 }
 
@@ -337,6 +350,7 @@ static void pong_draw(void) {
 }
 
 void pong_run(void) {
+    uint32_t frame_next = 0;
     while (!pong_quit) {
         uint8_t sc;
         while ((sc = keyboard_get_scancode()) != 0) {
@@ -350,10 +364,10 @@ void pong_run(void) {
         pong_tick();
         game_history_tick();
         pong_draw();
-        for (volatile int d = 0; d < 40000; d++) ;
+        game_frame_wait(&frame_next, 50);
     }
     draw_text(100, 95, "Press any key", 0xAAAAAA);
-    while (!keyboard_has_key()) { for (volatile int d = 0; d < 5000; d++) ; }
+    while (!keyboard_has_key()) plat_idle();
     while (keyboard_get_scancode() != 0) ;
 }
 
@@ -463,6 +477,7 @@ static void tetris_draw(void) {
 }
 
 void tetris_run(void) {
+    uint32_t frame_next = 0;
     while (!tetris_quit) {
         uint8_t sc;
         while ((sc = keyboard_get_scancode()) != 0) {
@@ -481,14 +496,14 @@ void tetris_run(void) {
             else tetris_lock();
         }
         tetris_draw();
-        for (volatile int d = 0; d < 12000; d++) ;
+        game_frame_wait(&frame_next, 15);
     }
     tetris_draw();
     draw_text(95, 80, "Game Over", 0xFFFFFF);
     draw_text(80, 95, "Score:", 0xAAAAAA);
     draw_number(130, 95, (uint32_t)tetris_score, 0xFFFFFF);
     draw_text(70, 120, "Press any key", 0xAAAAAA);
-    while (!keyboard_has_key()) { for (volatile int d = 0; d < 5000; d++) ; }
+    while (!keyboard_has_key()) plat_idle();
     while (keyboard_get_scancode() != 0) ;
 }
 
@@ -613,6 +628,7 @@ static void space_invaders_draw(void) {
 }
 
 void space_invaders_run(void) {
+    uint32_t frame_next = 0;
     while (!si_quit) {
         uint8_t sc;
         while ((sc = keyboard_get_scancode()) != 0) {
@@ -625,7 +641,7 @@ void space_invaders_run(void) {
         space_invaders_tick();
         game_history_tick();
         space_invaders_draw();
-        for (volatile int d = 0; d < 15000; d++) ;
+        game_frame_wait(&frame_next, 20);
     }
     space_invaders_draw();
     if (si_win) draw_text(100, 90, "You Win!", 0x00FF00);
@@ -633,7 +649,7 @@ void space_invaders_run(void) {
     draw_text(80, 105, "Score:", 0xAAAAAA);
     draw_number(130, 105, (uint32_t)si_score, 0xFFFFFF);
     draw_text(70, 125, "Press any key", 0xAAAAAA);
-    while (!keyboard_has_key()) { for (volatile int d = 0; d < 5000; d++) ; }
+    while (!keyboard_has_key()) plat_idle();
     while (keyboard_get_scancode() != 0) ;
 }
 
@@ -725,6 +741,7 @@ static void racing_draw(void) {
 }
 
 void racing_run(void) {
+    uint32_t frame_next = 0;
     while (!race_quit) {
         uint8_t sc;
         while ((sc = keyboard_get_scancode()) != 0) {
@@ -736,14 +753,14 @@ void racing_run(void) {
         racing_tick();
         game_history_tick();
         racing_draw();
-        for (volatile int d = 0; d < 35000; d++) ;
+        game_frame_wait(&frame_next, 40);
     }
     racing_draw();
     draw_text(95, 85, "Game Over", 0xFF0000);
     draw_text(80, 100, "Score:", 0xAAAAAA);
     draw_number(130, 100, (uint32_t)race_score, 0xFFFFFF);
     draw_text(70, 120, "Press any key", 0xAAAAAA);
-    while (!keyboard_has_key()) { for (volatile int d = 0; d < 5000; d++) ; }
+    while (!keyboard_has_key()) plat_idle();
     while (keyboard_get_scancode() != 0) ;
 }
 
@@ -4,13 +4,62 @@
 #include "platform.h"
 #include "kernel.h"
 #include "memory_manager.h"
+#include "scheduler.h"
+#include "subsys.h"
 #include <stddef.h>
 
+/* Busy share of all cores since the previous call (scheduler accounting). */
+static uint32_t cpu_load_percent(void) {
+    static uint32_t last_busy, last_idle;
+    uint32_t busy = 0, idle = 0;
+    int cpu;
+    for (cpu = 0; cpu < sched_cpu_count(); cpu++) {
+        sched_cpu_info_t ci;
+        if (sched_get_cpu_info(cpu, &ci) != 0) continue;
+        busy += ci.busy_time;
+        idle += ci.idle_time;
+    }
+    uint32_t db = busy - last_busy, total = db + (idle - last_idle);
+    last_busy = busy;
+    last_idle = idle;
+    if (total < 100) return 0;
+    db /= total / 100;
+    return db > 100 ? 100 : db;
+}
+
+/* Share of wall time spent in the I/O side's subsystem ticks (storage,
+ * network, input, audio, IOP) since the previous call. */
+static uint32_t io_load_percent(void) {
+    static const subsys_id_t io[] = {
+        SUBSYS_STORAGE, SUBSYS_NET, SUBSYS_INPUT, SUBSYS_AUDIO, SUBSYS_IOP
+    };
+    static uint32_t last_spent, last_wall;
+    uint32_t spent = 0, wall = (uint32_t)(plat_ticks_ns() >> 10);
+    unsigned int i;
+    for (i = 0; i < sizeof(io) / sizeof(io[0]); i++) {
+        subsys_stats_t st;
+        if (subsys_get_stats(io[i], &st) == 0) spent += st.total_time;
+    }
+    uint32_t ds = spent - last_spent, dw = wall - last_wall;
+    last_spent = spent;
+    last_wall = wall;
+    if (dw < 100) return 0;
+    ds /= dw / 100;
+    return ds > 100 ? 100 : ds;
+}
+
 static void memstat_from_system(hw_memstat_t *out) {
     out->total_kb = plat_mem_total_kb();
     out->used_kb = plat_mem_used_kb();
     out->free_kb = plat_mem_free_kb();
     out->kernel_kb = 512;
+    heap_stats_t hs;
+    heap_get_stats(&hs);
+    out->heap_used_kb = (uint32_t)(hs.in_use / 1024);
+    out->heap_peak_kb = (uint32_t)(hs.peak / 1024);
+    out->heap_largest_free_kb = (uint32_t)(hs.largest_free / 1024);
+    out->heap_frag_pct = hs.frag_pct;
+    out->heap_failed = hs.failed;
 }
 
 void hw_status_get_memstat(hw_memstat_t *out) {
@@ -36,7 +85,7 @@ void hw_status_get_ports(hw_port_status_t *out, unsigned int max) {
 void hw_status_get_iop(hw_iop_status_t *out) {
     if (!out) return;
     out->running = 1;
-    out->load_percent = (uint8_t)(get_memory_usage_percent() / 4 + 5);
+    out->load_percent = io_load_percent();
     const char *s = "running";
     unsigned int i = 0;
     while (s[i] && i < sizeof(out->status) - 1) { out->status[i] = s[i]; i++; }
@@ -77,7 +126,7 @@ void hw_status_get_sysinfo(hw_sysinfo_t *out) {
     out->model[i] = '\0';
     out->ee_mhz = 294;
     out->ram_mb = plat_mem_total_kb() / 1024;
-    out->ee_load_percent = (uint8_t)(get_memory_usage_percent() / 2 + 5);
+    out->ee_load_percent = cpu_load_percent();
     memstat_from_system(&out->memstat);
     hw_status_get_ports(out->ports, HW_STATUS_MAX_PORTS);
     hw_status_get_iop(&out->iop);
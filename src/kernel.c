@@ -1,7 +1,9 @@
 #include "msp.h"
 #include "shell.h"
 #include "memory_manager.h"
+#include "page_alloc.h"
 #include "scheduler.h"
+#include "ktimer.h"
 #include "fs.h"
 #include "kernel.h"
 #include "platform.h"
@@ -16,6 +18,9 @@
 #include "pause_engine.h"
 #include "memory_budget.h"
 #include "subsys.h"
+#ifndef PLATFORM_PS2
+#include "smp.h"
+#endif
 #include <stdarg.h>
 #include <stdint.h>
 #include "arch_x86.h"
@@ -35,6 +40,22 @@ static struct {
     uint8_t network_support;
 } ps2_info = {0};
 
+#ifndef PLATFORM_PS2
+/* Subsystem ticks (heartbeats, swap balance, party poll) every
+ * HOUSEKEEPING_MS, whatever the foreground is doing: the timer task runs at
+ * TASK_PRIO_HIGH and preempts a game loop that never returns to the shell
+ * prompt. The period is long enough for the idle task to skip timer ticks
+ * in between. */
+#define HOUSEKEEPING_MS  50
+
+static ktimer_t housekeeping_timer;
+
+static void housekeeping(void *arg) {
+    (void)arg;
+    subsys_tick_all();
+}
+#endif
+
 // Enhanced kernel entry point with PS2 optimizations
 void kernel_main(void) {
     plat_init();
@@ -56,6 +77,8 @@ void kernel_main(void) {
     }
 
     kprint("Initializing memory manager...\n");
+    page_alloc_init();
+    kprintf("Page allocator: %d KB free\n", (int)(page_alloc_free_pages() * (PAGE_SIZE / 1024)));
     init_memory_manager();
 
     kprint("Initializing scheduler and filesystem...\n");
@@ -66,6 +89,17 @@ void kernel_main(void) {
     kprint("Initializing subsystems...\n");
     subsys_init_all();
     net_init();
+#ifndef PLATFORM_PS2
+    ktimer_init(&housekeeping_timer, housekeeping, (void *)0);
+    ktimer_start(&housekeeping_timer, HOUSEKEEPING_MS, HOUSEKEEPING_MS);
+    {
+        /* Timer callbacks run on the BSP: pin the timer task so an
+         * idle AP cannot steal it. */
+        task_id_t timer_id = add_task(ktimer_task);
+        task_set_priority(timer_id, TASK_PRIO_HIGH);
+        task_set_cpu(timer_id, 0);
+    }
+#endif
     
     storage_init();
     pause_engine_init();
@@ -83,6 +117,7 @@ void kernel_main(void) {
     show_enhanced_boot_splash(); 
     
 #ifndef PLATFORM_PS2
+    smp_init();
     enable_interrupts_asm();
 #endif
     kprint("ASMOS Kernel v2.0 - Ready!\n");
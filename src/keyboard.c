@@ -1,5 +1,7 @@
 /*
- * PC keyboard driver: poll port 0x60 (data) and 0x64 (status).
+ * PC keyboard driver: IRQ1 queues scancodes from port 0x60 in a ring that
+ * keyboard_has_key/keyboard_get_scancode consume. Until keyboard_init the
+ * controller is polled through port 0x64 (status) directly.
  * Used when not building for PS2 (no PS2_HARDWARE).
  */
 #include "keyboard.h"
@@ -7,20 +9,100 @@
 
 #ifndef PS2_HARDWARE
 
-/* Bit 0 of status = output buffer full (data available at 0x60) */
+#include "irq.h"
+#include "platform.h"
+#include "scheduler.h"
+
+#define KBD_STATUS_FULL  0x01   /* output buffer full (data at 0x60) */
+#define KBD_STATUS_AUX   0x20   /* ... and it came from the mouse port */
+
+/* Single producer (the IRQ1 handler, on the BSP) and single consumer (the
+ * foreground task, any core). head is written only by the producer, tail
+ * only by the consumer; each publishes its slot update after the data. */
+static kbd_event_t ring[KBD_RING_SIZE];
+static volatile uint32_t ring_head;
+static volatile uint32_t ring_tail;
+static volatile uint32_t ring_dropped;
+static volatile int waiter = -1;        /* task in keyboard_wait */
+static int irq_mode;
+
+#define barrier()  __asm__ volatile ("" ::: "memory")
+
+static irq_frame_t *keyboard_irq(irq_frame_t *f) {
+    uint8_t st;
+    while ((st = inb(0x64)) & KBD_STATUS_FULL) {
+        uint8_t sc = inb(0x60);
+        uint32_t head = ring_head;
+        if (st & KBD_STATUS_AUX) continue;
+        if (head - ring_tail >= KBD_RING_SIZE) {
+            ring_dropped++;
+            continue;
+        }
+        ring[head & (KBD_RING_SIZE - 1)].scancode = sc;
+        ring[head & (KBD_RING_SIZE - 1)].time_us = plat_ticks_us();
+        barrier();
+        ring_head = head + 1;
+    }
+    if (waiter >= 0) task_wake(waiter);
+    return f;
+}
+
+void keyboard_init(void) {
+    while (inb(0x64) & KBD_STATUS_FULL) (void)inb(0x60);
+    irq_mode = 1;
+    irq_register(IRQ_KEYBOARD, keyboard_irq);
+}
+
 int keyboard_has_key(void) {
-    return (inb(0x64) & 1) != 0;
+    if (!irq_mode) return (inb(0x64) & KBD_STATUS_FULL) != 0;
+    return ring_head != ring_tail;
+}
+
+int keyboard_get_event(kbd_event_t *out) {
+    uint32_t tail = ring_tail;
+    if (!irq_mode) {
+        if (!(inb(0x64) & KBD_STATUS_FULL)) return 0;
+        out->scancode = inb(0x60);
+        out->time_us = plat_ticks_us();
+        return 1;
+    }
+    if (tail == ring_head) return 0;
+    barrier();
+    *out = ring[tail & (KBD_RING_SIZE - 1)];
+    barrier();
+    ring_tail = tail + 1;
+    return 1;
 }
 
 uint8_t keyboard_get_scancode(void) {
-    if (!keyboard_has_key())
-        return 0;
-    return inb(0x60);
+    kbd_event_t ev;
+    return keyboard_get_event(&ev) ? ev.scancode : 0;
+}
+
+/* Block until IRQ1 queues something; task_wake before task_block is not
+ * lost, so a key arriving between the check and the block still wakes. */
+void keyboard_wait(void) {
+    task_id_t self = task_current();
+    if (!irq_mode || self < 0 || !sched_preemptive()) {
+        plat_idle();
+        return;
+    }
+    waiter = self;
+    while (ring_head == ring_tail) task_block();
+    waiter = -1;
+}
+
+uint32_t keyboard_dropped(void) {
+    return ring_dropped;
 }
 
 #else
 
+void keyboard_init(void) { (void)0; }
 int keyboard_has_key(void) { (void)0; return 0; }
+int keyboard_get_event(kbd_event_t *out) { (void)out; return 0; }
 uint8_t keyboard_get_scancode(void) { (void)0; return 0; }
+void keyboard_wait(void) { (void)0; }
+uint32_t keyboard_dropped(void) { return 0; }
 
 #endif
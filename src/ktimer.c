@@ -0,0 +1,163 @@
+/* Hashed timer wheel — see ktimer.h. Slot = expiry tick mod KTIMER_SLOTS;
+ * timers more than one revolution out share a slot with nearer ones and are
+ * skipped until their tick comes round. Times are plat_ticks_ms values
+ * rounded up to tick boundaries and compared wrap-safely. */
+
+#include "ktimer.h"
+#include "platform.h"
+#include "scheduler.h"
+
+#define KTIMER_MASK  (KTIMER_SLOTS - 1)
+#define SLOT_OF(ms)  (((ms) >> KTIMER_TICK_SHIFT) & KTIMER_MASK)
+#define TICK_ALIGN_UP(ms)  (((ms) + KTIMER_TICK_MS - 1) & ~(KTIMER_TICK_MS - 1))
+
+/* Wrap-safe "a is before b" in milliseconds. */
+#define TICK_BEFORE(a, b)  ((int32_t)((a) - (b)) < 0)
+
+static ktimer_t *wheel[KTIMER_SLOTS];
+static uint32_t wheel_ms;           /* start of the next tick ktimer_run processes */
+static int wheel_ready;
+static task_id_t runner = -1;       /* timer task, woken when a timer starts */
+static plat_lock_t wheel_lock = PLAT_LOCK_INIT;
+
+/* Whole ticks, at least one. */
+static uint32_t ms_round(uint32_t ms) {
+    ms = TICK_ALIGN_UP(ms);
+    return ms ? ms : KTIMER_TICK_MS;
+}
+
+static void wheel_insert(ktimer_t *t) {
+    ktimer_t **slot = &wheel[SLOT_OF(t->expires)];
+    t->next = *slot;
+    *slot = t;
+    t->active = 1;
+}
+
+static int wheel_remove(ktimer_t *t) {
+    ktimer_t **pp;
+    if (!t->active) return 0;
+    for (pp = &wheel[SLOT_OF(t->expires)]; *pp; pp = &(*pp)->next) {
+        if (*pp == t) {
+            *pp = t->next;
+            break;
+        }
+    }
+    t->next = (ktimer_t *)0;
+    t->active = 0;
+    return 1;
+}
+
+void ktimer_init(ktimer_t *t, ktimer_fn_t fn, void *arg) {
+    if (!t) return;
+    t->fn = fn;
+    t->arg = arg;
+    t->expires = 0;
+    t->period = 0;
+    t->next = (ktimer_t *)0;
+    t->active = 0;
+}
+
+void ktimer_start(ktimer_t *t, uint32_t delay_ms, uint32_t period_ms) {
+    if (!t || !t->fn) return;
+    uint32_t flags = plat_lock_irqsave(&wheel_lock);
+    uint32_t now = plat_ticks_ms();
+    if (!wheel_ready) {
+        wheel_ms = now & ~(KTIMER_TICK_MS - 1);
+        wheel_ready = 1;
+    }
+    wheel_remove(t);
+    t->expires = TICK_ALIGN_UP(now + (delay_ms ? delay_ms : 1));
+    t->period = period_ms ? ms_round(period_ms) : 0;
+    wheel_insert(t);
+    plat_unlock_irqrestore(&wheel_lock, flags);
+    if (runner >= 0 && runner != task_current()) task_wake(runner);
+}
+
+int ktimer_cancel(ktimer_t *t) {
+    if (!t) return 0;
+    uint32_t flags = plat_lock_irqsave(&wheel_lock);
+    int was = wheel_remove(t);
+    plat_unlock_irqrestore(&wheel_lock, flags);
+    return was;
+}
+
+int ktimer_pending(const ktimer_t *t) {
+    return t && t->active;
+}
+
+/* Walk each tick since the last run (at most one revolution: every slot is
+ * then visited once, and anything due in it fires). Callbacks run with the
+ * caller's interrupt state; the slot is rescanned after each one because
+ * the callback may have changed the wheel. */
+int ktimer_run(void) {
+    int ran = 0;
+    uint32_t flags = plat_lock_irqsave(&wheel_lock);
+    if (!wheel_ready) {
+        plat_unlock_irqrestore(&wheel_lock, flags);
+        return 0;
+    }
+    uint32_t now = plat_ticks_ms();
+    if ((int32_t)(now - wheel_ms) >= (int32_t)(KTIMER_SLOTS * KTIMER_TICK_MS))
+        wheel_ms = (now & ~(KTIMER_TICK_MS - 1)) - (KTIMER_SLOTS - 1) * KTIMER_TICK_MS;
+    while (!TICK_BEFORE(now, wheel_ms)) {
+        ktimer_t **pp = &wheel[SLOT_OF(wheel_ms)];
+        while (*pp) {
+            ktimer_t *t = *pp;
+            if (TICK_BEFORE(now, t->expires)) {
+                pp = &t->next;
+                continue;
+            }
+            *pp = t->next;
+            t->next = (ktimer_t *)0;
+            t->active = 0;
+            if (t->period) {
+                t->expires += t->period;
+                if (!TICK_BEFORE(now, t->expires))  /* fell behind: skip missed periods */
+                    t->expires = TICK_ALIGN_UP(now + t->period);
+                wheel_insert(t);
+            }
+            ktimer_fn_t fn = t->fn;
+            void *arg = t->arg;
+            plat_unlock_irqrestore(&wheel_lock, flags);
+            fn(arg);
+            ran++;
+            flags = plat_lock_irqsave(&wheel_lock);
+            pp = &wheel[SLOT_OF(wheel_ms)];
+        }
+        wheel_ms += KTIMER_TICK_MS;
+    }
+    plat_unlock_irqrestore(&wheel_lock, flags);
+    return ran;
+}
+
+uint32_t ktimer_next_ms(void) {
+    uint32_t flags = plat_lock_irqsave(&wheel_lock);
+    uint32_t now = plat_ticks_ms(), best = 0;
+    int found = 0, i;
+    for (i = 0; i < KTIMER_SLOTS; i++) {
+        ktimer_t *t;
+        for (t = wheel[i]; t; t = t->next) {
+            if (!found || TICK_BEFORE(t->expires, best)) {
+                best = t->expires;
+                found = 1;
+            }
+        }
+    }
+    plat_unlock_irqrestore(&wheel_lock, flags);
+    if (!found) return KTIMER_NONE;
+    if (!TICK_BEFORE(now, best)) return 0;
+    return best - now;
+}
+
+/* A ktimer_start between ktimer_next_ms and going to sleep cannot be
+ * missed, even from another core: its task_wake either ends the sleep or
+ * is left pending and makes the block return at once. */
+void ktimer_task(void) {
+    runner = task_current();
+    for (;;) {
+        ktimer_run();
+        uint32_t ms = ktimer_next_ms();
+        if (ms == KTIMER_NONE) task_block();
+        else if (ms) task_block_timeout(ms);
+    }
+}
@@ -0,0 +1,141 @@
+/* LZ block codec — greedy single-probe LZ77 with LZ4-style sequences. */
+
+#include "lz.h"
+
+#define LZ_HASH_BITS   12
+#define LZ_MIN_MATCH   4
+#define LZ_MAX_OFFSET  0xFFFF
+#define LZ_SKIP_SHIFT  6    /* search step grows through incompressible runs */
+
+static uint32_t lz_table[1u << LZ_HASH_BITS];   /* position + 1, 0 = empty */
+
+static void lz_copy(uint8_t *d, const uint8_t *s, size_t n) {
+    while (n--) *d++ = *s++;
+}
+
+/* Byte loads: the PS2 EE faults on unaligned 32-bit reads. */
+static uint32_t lz_read32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+           ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint32_t lz_hash(uint32_t v) {
+    return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+static size_t lz_put_length(uint8_t *d, size_t o, size_t n) {
+    while (n >= 255) {
+        d[o++] = 255;
+        n -= 255;
+    }
+    d[o++] = (uint8_t)n;
+    return o;
+}
+
+/* One sequence: literals, then a match (match_len 0 = trailing literals).
+ * Returns the new output position, or 0 once the block would pass limit. */
+static size_t lz_emit(uint8_t *d, size_t o, size_t limit, const uint8_t *lit,
+                      size_t lit_len, size_t offset, size_t match_len) {
+    size_t ml = match_len ? match_len - LZ_MIN_MATCH : 0;
+    size_t need = 1 + lit_len + lit_len / 255 + 1;
+    if (match_len) need += 2 + ml / 255 + 1;
+    if (o + need > limit) return 0;
+    d[o++] = (uint8_t)(((lit_len < 15 ? lit_len : 15) << 4) | (ml < 15 ? ml : 15));
+    if (lit_len >= 15) o = lz_put_length(d, o, lit_len - 15);
+    lz_copy(d + o, lit, lit_len);
+    o += lit_len;
+    if (match_len) {
+        d[o++] = (uint8_t)(offset & 0xFF);
+        d[o++] = (uint8_t)(offset >> 8);
+        if (ml >= 15) o = lz_put_length(d, o, ml - 15);
+    }
+    return o;
+}
+
+size_t lz_compress(const void *src, size_t len, void *dst, size_t dst_cap) {
+    const uint8_t *s = (const uint8_t *)src;
+    uint8_t *d = (uint8_t *)dst;
+    size_t o = 1, i = 0, anchor = 0;
+    unsigned int h;
+    if (!d || dst_cap < LZ_BOUND(len)) return 0;
+    d[0] = LZ_BLOCK_LZ;
+    for (h = 0; h < (1u << LZ_HASH_BITS); h++) lz_table[h] = 0;
+    /* LZ output is only kept while it stays within len bytes. */
+    while (len >= LZ_MIN_MATCH && i <= len - LZ_MIN_MATCH) {
+        uint32_t seq = lz_read32(s + i);
+        h = lz_hash(seq);
+        size_t ref = lz_table[h];
+        lz_table[h] = (uint32_t)(i + 1);
+        if (ref && i - (ref - 1) <= LZ_MAX_OFFSET && lz_read32(s + ref - 1) == seq) {
+            size_t r = ref - 1, m = LZ_MIN_MATCH;
+            while (i + m < len && s[r + m] == s[i + m]) m++;
+            while (i > anchor && r > 0 && s[i - 1] == s[r - 1]) {
+                i--;
+                r--;
+                m++;
+            }
+            o = lz_emit(d, o, len, s + anchor, i - anchor, i - r, m);
+            if (!o) break;
+            i += m;
+            anchor = i;
+        } else {
+            i += 1 + ((i - anchor) >> LZ_SKIP_SHIFT);
+        }
+    }
+    if (o) o = lz_emit(d, o, len, s + anchor, len - anchor, 0, 0);
+    if (o) return o;
+    d[0] = LZ_BLOCK_STORED;
+    lz_copy(d + 1, s, len);
+    return len + 1;
+}
+
+int lz_decompress(const void *src, size_t len, void *dst, size_t dst_cap, size_t *out_len) {
+    const uint8_t *s = (const uint8_t *)src;
+    uint8_t *d = (uint8_t *)dst;
+    size_t ip = 1, op = 0;
+    if (!s || len < 1) return -1;
+    if (s[0] == LZ_BLOCK_STORED) {
+        if (len - 1 > dst_cap) return -1;
+        lz_copy(d, s + 1, len - 1);
+        if (out_len) *out_len = len - 1;
+        return 0;
+    }
+    if (s[0] != LZ_BLOCK_LZ) return -1;
+    for (;;) {
+        size_t lit, match, offset;
+        uint8_t b;
+        if (ip >= len) return -1;
+        uint8_t token = s[ip++];
+        lit = token >> 4;
+        if (lit == 15) {
+            do {
+                if (ip >= len) return -1;
+                b = s[ip++];
+                lit += b;
+            } while (b == 255);
+        }
+        if (lit > len - ip || lit > dst_cap - op) return -1;
+        lz_copy(d + op, s + ip, lit);
+        ip += lit;
+        op += lit;
+        if (ip == len) break;           /* trailing literals end the block */
+        if (len - ip < 2) return -1;
+        offset = (size_t)s[ip] | ((size_t)s[ip + 1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > op) return -1;
+        match = token & 15;
+        if (match == 15) {
+            do {
+                if (ip >= len) return -1;
+                b = s[ip++];
+                match += b;
+            } while (b == 255);
+        }
+        match += LZ_MIN_MATCH;
+        if (match > dst_cap - op) return -1;
+        lz_copy(d + op, d + op - offset, match);   /* overlap = repeat */
+        op += match;
+    }
+    if (out_len) *out_len = op;
+    return 0;
+}
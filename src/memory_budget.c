@@ -3,15 +3,48 @@
 #include "memory_budget.h"
 #include "kernel.h"
 #include "memory_manager.h"
+#include "page_alloc.h"
+#include "storage.h"
+#include "lz.h"
+#include "scheduler.h"
 #include <stddef.h>
 
+/* Budgets, shrinkers and swap slots are shared by every task and by the
+ * housekeeping tick: public entry points hold budget_lock (recursive, so
+ * shrinkers and eviction may re-enter), and the tick skips a round while
+ * the foreground holds it. Order: budget_lock, then the file system. */
+static task_mutex_t budget_lock = TASK_MUTEX_INIT;
+/* The used_bytes counters alone: releasing a charge never sleeps, so the
+ * idle task can free dead tasks' stacks. */
+static plat_lock_t used_lock = PLAT_LOCK_INIT;
+
 static budget_entry_t regions[BUDGET_REGION_MAX];
 static swap_slot_t swap_slots[SWAP_SLOT_MAX];
+static uint8_t swap_chunk_used[SWAP_FILE_CHUNKS];
+static uint16_t swap_chunk_len[SWAP_FILE_CHUNKS];  /* stored bytes; < piece = LZ block */
+static uint8_t swap_zbuf[LZ_BOUND(SWAP_CHUNK_SIZE)];
+static int swap_file_ready = 0;
+static uint32_t swap_clock = 0;          /* LRU stamp source */
+static int swap_last_access = -1;        /* for sequential prefetch */
+static int swap_restoring = -1;          /* slot swap_restore is bringing in */
+static uint32_t swap_high_pct = SWAP_WATERMARK_HIGH;
+static uint32_t swap_low_pct = SWAP_WATERMARK_LOW;
+static uint32_t swap_evictions, swap_refaults, swap_prefetches;
 static const char *region_names[] = {
     "kernel", "network", "fs", "streaming", "app", "pause_cache", "swap_cache", "other"
 };
 static int inited = 0;
 
+typedef struct {
+    budget_region_t region;
+    budget_shrink_fn fn;
+    void *ctx;
+} budget_shrinker_t;
+
+static budget_shrinker_t shrinkers[BUDGET_SHRINKER_MAX];
+static int shrinker_count = 0;
+static int shrinking = 0;
+
 #define DEFAULT_KERNEL_KB     (4 * 1024)
 #define DEFAULT_NETWORK_KB    (2 * 1024)
 #define DEFAULT_FS_KB         (1 * 1024)
@@ -21,11 +54,14 @@ static int inited = 0;
 #define DEFAULT_SWAP_KB       (4 * 1024)
 #define DEFAULT_OTHER_KB      (1 * 1024)
 
+static size_t swap_shrink(size_t want_bytes, void *ctx);
+static int swap_balance_keep(int keep);
+
 void memory_budget_init(void) {
     if (inited) return;
     for (int i = 0; i < BUDGET_REGION_MAX; i++) {
         regions[i].limit_kb = 0;
-        regions[i].used_kb = 0;
+        regions[i].used_bytes = 0;
         regions[i].name = region_names[i];
     }
     memory_budget_set_limit(BUDGET_KERNEL, DEFAULT_KERNEL_KB);
@@ -39,8 +75,12 @@ void memory_budget_init(void) {
     for (int i = 0; i < SWAP_SLOT_MAX; i++) {
         swap_slots[i].in_use = 0;
         swap_slots[i].local_ptr = NULL;
+        swap_slots[i].chunk_count = 0;
     }
+    for (int i = 0; i < SWAP_FILE_CHUNKS; i++)
+        swap_chunk_used[i] = 0;
     inited = 1;
+    memory_budget_register_shrinker(BUDGET_SWAP_CACHE, swap_shrink, NULL);
 }
 
 void memory_budget_set_limit(budget_region_t region, uint32_t limit_kb) {
@@ -48,49 +88,126 @@ void memory_budget_set_limit(budget_region_t region, uint32_t limit_kb) {
     regions[region].limit_kb = limit_kb;
 }
 
+/* Bytes by which region would exceed its limit after adding size_bytes (0 = fits). */
+static uint32_t over_by(budget_region_t region, uint32_t size_bytes) {
+    uint32_t limit = regions[region].limit_kb * 1024;
+    uint32_t after = regions[region].used_bytes + size_bytes;
+    if (regions[region].limit_kb == 0 || after <= limit) return 0;
+    return after - limit;
+}
+
+static void used_add(budget_region_t region, uint32_t size_bytes) {
+    uint32_t flags = plat_lock_irqsave(&used_lock);
+    regions[region].used_bytes += size_bytes;
+    plat_unlock_irqrestore(&used_lock, flags);
+}
+
+int memory_budget_register_shrinker(budget_region_t region, budget_shrink_fn fn, void *ctx) {
+    if (!inited) memory_budget_init();
+    if ((unsigned)region >= BUDGET_REGION_MAX || !fn) return -1;
+    if (shrinker_count >= BUDGET_SHRINKER_MAX) return -2;
+    shrinkers[shrinker_count].region = region;
+    shrinkers[shrinker_count].fn = fn;
+    shrinkers[shrinker_count].ctx = ctx;
+    shrinker_count++;
+    return 0;
+}
+
+size_t memory_budget_shrink(budget_region_t region, size_t want_bytes) {
+    size_t freed = 0;
+    task_mutex_lock(&budget_lock);
+    if (shrinking) {                /* a shrinker must not recurse into reclaim */
+        task_mutex_unlock(&budget_lock);
+        return 0;
+    }
+    shrinking = 1;
+    for (int i = 0; i < shrinker_count && freed < want_bytes; i++) {
+        if (shrinkers[i].region == region)
+            freed += shrinkers[i].fn(want_bytes - freed, shrinkers[i].ctx);
+    }
+    shrinking = 0;
+    task_mutex_unlock(&budget_lock);
+    return freed;
+}
+
+static int budget_charge(budget_region_t region, uint32_t size_bytes) {
+    uint32_t over = over_by(region, size_bytes);
+    if (over) {
+        memory_budget_shrink(region, over);
+        if (over_by(region, size_bytes)) return 0; /* over budget */
+    }
+    used_add(region, size_bytes);
+    return 1;
+}
+
 int memory_budget_alloc(budget_region_t region, uint32_t size_bytes) {
     if (!inited) memory_budget_init();
     if ((unsigned)region >= BUDGET_REGION_MAX) return -1;
-    uint32_t add_kb = (size_bytes + 1023) / 1024;
-    if (regions[region].used_kb + add_kb > regions[region].limit_kb && regions[region].limit_kb != 0)
-        return 0; /* over budget */
-    regions[region].used_kb += add_kb;
-    return 1;
+    task_mutex_lock(&budget_lock);
+    int rc = budget_charge(region, size_bytes);
+    task_mutex_unlock(&budget_lock);
+    return rc;
 }
 
 void memory_budget_free(budget_region_t region, uint32_t size_bytes) {
     if ((unsigned)region >= BUDGET_REGION_MAX) return;
-    uint32_t sub_kb = (size_bytes + 1023) / 1024;
-    if (sub_kb > regions[region].used_kb) regions[region].used_kb = 0;
-    else regions[region].used_kb -= sub_kb;
+    uint32_t flags = plat_lock_irqsave(&used_lock);
+    if (size_bytes > regions[region].used_bytes) regions[region].used_bytes = 0;
+    else regions[region].used_bytes -= size_bytes;
+    plat_unlock_irqrestore(&used_lock, flags);
 }
 
 int memory_budget_can_alloc(budget_region_t region, uint32_t size_bytes) {
     if ((unsigned)region >= BUDGET_REGION_MAX) return 0;
-    uint32_t add_kb = (size_bytes + 1023) / 1024;
-    if (regions[region].limit_kb == 0) return 1;
-    return (regions[region].used_kb + add_kb <= regions[region].limit_kb) ? 1 : 0;
+    return over_by(region, size_bytes) == 0 ? 1 : 0;
 }
 
 uint32_t memory_budget_used_kb(budget_region_t region) {
     if ((unsigned)region >= BUDGET_REGION_MAX) return 0;
-    return regions[region].used_kb;
+    return (regions[region].used_bytes + 1023) / 1024;
 }
 
 uint32_t memory_budget_total_used_kb(void) {
     uint32_t t = 0;
-    for (int i = 0; i < BUDGET_REGION_MAX; i++) t += regions[i].used_kb;
+    for (int i = 0; i < BUDGET_REGION_MAX; i++) t += memory_budget_used_kb((budget_region_t)i);
     return t;
 }
 
-int swap_slot_alloc(size_t size, budget_region_t region, swap_slot_t *out) {
-    if (!out) return -1;
-    void *p = malloc(size);
-    if (!p) return -2;
-    if (!memory_budget_alloc(BUDGET_SWAP_CACHE, (uint32_t)size)) {
-        free(p);
-        return -3; /* over budget */
+static void *budget_alloc(budget_region_t region, size_t size, const void *caller) {
+    uint32_t over = over_by(region, (uint32_t)size);
+    if (over) {
+        memory_budget_shrink(region, over);
+        if (over_by(region, (uint32_t)size)) return NULL; /* over budget */
+    }
+    void *p = malloc_from(size, caller);
+    /* Heap exhausted: every region's caches are fair game. */
+    for (int r = 0; !p && r < BUDGET_REGION_MAX; r++) {
+        if (memory_budget_shrink((budget_region_t)r, size))
+            p = malloc_from(size, caller);
     }
+    if (!p) return NULL;
+    used_add(region, (uint32_t)malloc_usable_size(p));
+    return p;
+}
+
+void *budget_malloc(budget_region_t region, size_t size) {
+    if (!inited) memory_budget_init();
+    if ((unsigned)region >= BUDGET_REGION_MAX || size == 0) return NULL;
+    task_mutex_lock(&budget_lock);
+    void *p = budget_alloc(region, size, __builtin_return_address(0));
+    task_mutex_unlock(&budget_lock);
+    return p;
+}
+
+void budget_free(budget_region_t region, void *ptr) {
+    if (!ptr) return;
+    memory_budget_free(region, (uint32_t)malloc_usable_size(ptr));
+    free(ptr);
+}
+
+static int slot_alloc(size_t size, budget_region_t region, swap_slot_t *out) {
+    void *p = budget_malloc(BUDGET_SWAP_CACHE, size);
+    if (!p) return -3; /* over budget or out of memory */
     for (int i = 0; i < SWAP_SLOT_MAX; i++) {
         if (!swap_slots[i].in_use) {
             swap_slots[i].in_use = 1;
@@ -98,83 +215,278 @@ int swap_slot_alloc(size_t size, budget_region_t region, swap_slot_t *out) {
             swap_slots[i].local_ptr = p;
             swap_slots[i].size = (uint32_t)size;
             swap_slots[i].region = region;
+            swap_slots[i].chunk = 0;
+            swap_slots[i].chunk_count = 0;
+            swap_slots[i].last_use = ++swap_clock;
             *out = swap_slots[i];
+            swap_balance_keep(i);
             return 0;
         }
     }
-    memory_budget_free(BUDGET_SWAP_CACHE, (uint32_t)size);
-    free(p);
+    budget_free(BUDGET_SWAP_CACHE, p);
     return -4; /* no slot */
 }
 
-int swap_evict(swap_slot_t *slot, const char *swap_path) {
-    (void)swap_path;
-    if (!slot) return -1;
-    if (slot->offset >= SWAP_SLOT_MAX) return -1;
+int swap_slot_alloc(size_t size, budget_region_t region, swap_slot_t *out) {
+    if (!out) return -1;
+    task_mutex_lock(&budget_lock);
+    int rc = slot_alloc(size, region, out);
+    task_mutex_unlock(&budget_lock);
+    return rc;
+}
+
+static int swap_open(const char *swap_path) {
+    if (swap_file_ready) return 0;
+    if (storage_swap_open(swap_path ? swap_path : SWAP_PATH_DEFAULT,
+                          SWAP_CHUNK_SIZE, SWAP_FILE_CHUNKS) != 0)
+        return -1;
+    swap_file_ready = 1;
+    return 0;
+}
+
+/* First-fit run of count free chunks; returns first chunk or -1. */
+static int swap_chunks_reserve(uint32_t count) {
+    uint32_t run = 0;
+    for (uint32_t i = 0; i < SWAP_FILE_CHUNKS; i++) {
+        run = swap_chunk_used[i] ? 0 : run + 1;
+        if (run == count) {
+            uint32_t first = i + 1 - count;
+            for (uint32_t j = first; j <= i; j++) swap_chunk_used[j] = 1;
+            return (int)first;
+        }
+    }
+    return -1;
+}
+
+static uint32_t swap_piece_len(const swap_slot_t *s, uint32_t i) {
+    uint32_t left = s->size - i * SWAP_CHUNK_SIZE;
+    return left < SWAP_CHUNK_SIZE ? left : SWAP_CHUNK_SIZE;
+}
+
+static int slot_evict(swap_slot_t *slot, const char *swap_path) {
     swap_slot_t *real = &swap_slots[slot->offset];
     if (!real->local_ptr) return 0; /* already evicted */
-    /* Real impl: write real->local_ptr to swap file at offset slot->offset * SWAP_CHUNK_SIZE. */
-    free(real->local_ptr);
+    uint32_t pieces = (real->size + SWAP_CHUNK_SIZE - 1) / SWAP_CHUNK_SIZE;
+    if (pieces > 0) {
+        if (swap_open(swap_path) != 0) return -2;
+        if (real->chunk_count == 0) {
+            int first = swap_chunks_reserve(pieces);
+            if (first < 0) return -3; /* swap file full */
+            real->chunk = (uint32_t)first;
+            real->chunk_count = pieces;
+        }
+    }
+    const uint8_t *src = (const uint8_t *)real->local_ptr;
+    for (uint32_t i = 0; i < pieces; i++) {
+        uint32_t len = swap_piece_len(real, i);
+        size_t zlen = 0;
+        const void *out = src + i * SWAP_CHUNK_SIZE;
+        swap_compress(out, len, swap_zbuf, &zlen);
+        if (zlen > 0 && zlen < len) {
+            out = swap_zbuf;
+            len = (uint32_t)zlen;
+        }
+        if (storage_swap_write(real->chunk + i, out, len) != 0)
+            return -4; /* data still resident */
+        swap_chunk_len[real->chunk + i] = (uint16_t)len;
+    }
+    budget_free(BUDGET_SWAP_CACHE, real->local_ptr);
     real->local_ptr = NULL;
+    slot->local_ptr = NULL;
+    swap_evictions++;
     return 0;
 }
 
-int swap_restore(swap_slot_t *slot, const char *swap_path) {
-    (void)swap_path;
+int swap_evict(swap_slot_t *slot, const char *swap_path) {
     if (!slot || slot->offset >= SWAP_SLOT_MAX) return -1;
-    swap_slot_t *real = &swap_slots[slot->offset];
-    if (real->local_ptr) return 0; /* already in RAM */
-    void *p = malloc(real->size);
+    task_mutex_lock(&budget_lock);
+    int rc = slot_evict(slot, swap_path);
+    task_mutex_unlock(&budget_lock);
+    return rc;
+}
+
+static int swap_read_in(swap_slot_t *real, const char *swap_path) {
+    if (real->chunk_count > 0 && swap_open(swap_path) != 0) return -1;
+    uint8_t *p = (uint8_t *)budget_malloc(BUDGET_SWAP_CACHE, real->size);
     if (!p) return -2;
+    for (uint32_t i = 0; i < real->chunk_count; i++) {
+        uint32_t len = swap_piece_len(real, i);
+        uint32_t stored = swap_chunk_len[real->chunk + i];
+        uint8_t *dst = p + i * SWAP_CHUNK_SIZE;
+        size_t got = len;
+        if (stored == len) {
+            if (storage_swap_read(real->chunk + i, dst, len) != 0) got = 0;
+        } else if (storage_swap_read(real->chunk + i, swap_zbuf, stored) != 0) {
+            got = 0;
+        } else if (swap_decompress(swap_zbuf, stored, dst, len, &got) != 0) {
+            got = 0;
+        }
+        if (got != len) {
+            budget_free(BUDGET_SWAP_CACHE, p);
+            return -3;
+        }
+    }
     real->local_ptr = p;
-    slot->local_ptr = p;
     return 0;
 }
 
+/* Pressure in percent: swap cache against its budget, and the heap once
+ * the page allocator cannot back another arena. */
+static uint32_t swap_pressure_pct(void) {
+    uint32_t limit = regions[BUDGET_SWAP_CACHE].limit_kb;
+    uint32_t pct = limit ? memory_budget_used_kb(BUDGET_SWAP_CACHE) * 100 / limit : 0;
+    if (!page_alloc_ready() ||
+        page_alloc_free_pages() < MM_ARENA_MIN / PAGE_SIZE) {
+        uint32_t heap = get_memory_usage_percent();
+        if (heap > pct) pct = heap;
+    }
+    return pct;
+}
+
+/* Least recently used resident slot other than keep, or NULL. */
+static swap_slot_t *swap_lru_victim(int keep) {
+    swap_slot_t *victim = NULL;
+    for (int i = 0; i < SWAP_SLOT_MAX; i++) {
+        swap_slot_t *s = &swap_slots[i];
+        if (!s->in_use || !s->local_ptr || i == keep) continue;
+        if (!victim || (int32_t)(s->last_use - victim->last_use) < 0) victim = s;
+    }
+    return victim;
+}
+
+static int swap_balance_keep(int keep) {
+    int evicted = 0;
+    if (!inited || swap_pressure_pct() <= swap_high_pct) return 0;
+    while (swap_pressure_pct() > swap_low_pct) {
+        swap_slot_t *victim = swap_lru_victim(keep);
+        if (!victim || swap_evict(victim, NULL) != 0) break;
+        evicted++;
+    }
+    return evicted;
+}
+
+int swap_balance(void) {
+    task_mutex_lock(&budget_lock);
+    int n = swap_balance_keep(-1);
+    task_mutex_unlock(&budget_lock);
+    return n;
+}
+
+static int slot_restore(swap_slot_t *slot, const char *swap_path) {
+    int idx = (int)slot->offset;
+    swap_slot_t *real = &swap_slots[idx];
+    if (!real->local_ptr) {
+        int rc = swap_read_in(real, swap_path);
+        if (rc != 0) return rc;
+        if (real->chunk_count > 0) swap_refaults++;
+        /* Most recent before the prefetch allocates, and off limits to the
+         * shrinker meanwhile: it must not evict what just faulted in. */
+        real->last_use = ++swap_clock;
+        swap_restoring = idx;
+        /* Faulting on the slot after the last one touched looks like a
+         * sequential scan: read the next slot ahead while under the high
+         * watermark. */
+        swap_slot_t *next = &swap_slots[idx + 1];
+        if (idx == swap_last_access + 1 && idx + 1 < SWAP_SLOT_MAX &&
+            next->in_use && !next->local_ptr && next->chunk_count > 0 &&
+            swap_pressure_pct() < swap_high_pct &&
+            swap_read_in(next, swap_path) == 0) {
+            next->last_use = swap_clock;
+            swap_prefetches++;
+        }
+        swap_restoring = -1;
+    }
+    swap_last_access = idx;
+    real->last_use = ++swap_clock;
+    slot->local_ptr = real->local_ptr;
+    swap_balance_keep(idx);
+    return 0;
+}
+
+int swap_restore(swap_slot_t *slot, const char *swap_path) {
+    if (!slot || slot->offset >= SWAP_SLOT_MAX) return -1;
+    task_mutex_lock(&budget_lock);
+    int rc = slot_restore(slot, swap_path);
+    task_mutex_unlock(&budget_lock);
+    return rc;
+}
+
+void swap_touch(swap_slot_t *slot) {
+    if (!slot || slot->offset >= SWAP_SLOT_MAX) return;
+    task_mutex_lock(&budget_lock);
+    swap_slots[slot->offset].last_use = ++swap_clock;
+    task_mutex_unlock(&budget_lock);
+}
+
+void *swap_access(swap_slot_t *slot) {
+    if (swap_restore(slot, NULL) != 0) return NULL;
+    return slot->local_ptr;
+}
+
+void swap_set_watermarks(uint32_t high_pct, uint32_t low_pct) {
+    if (high_pct > 100) high_pct = 100;
+    if (low_pct > high_pct) low_pct = high_pct;
+    swap_high_pct = high_pct;
+    swap_low_pct = low_pct;
+}
+
+void swap_get_stats(swap_stats_t *out) {
+    if (!out) return;
+    task_mutex_lock(&budget_lock);
+    out->resident = 0;
+    out->swapped = 0;
+    for (int i = 0; i < SWAP_SLOT_MAX; i++) {
+        if (!swap_slots[i].in_use) continue;
+        if (swap_slots[i].local_ptr) out->resident++;
+        else out->swapped++;
+    }
+    out->evictions = swap_evictions;
+    out->refaults = swap_refaults;
+    out->prefetches = swap_prefetches;
+    out->high_pct = swap_high_pct;
+    out->low_pct = swap_low_pct;
+    task_mutex_unlock(&budget_lock);
+}
+
+/* Housekeeping: a round the foreground is inside waits for the next tick. */
+void memory_budget_tick(void) {
+    if (task_mutex_trylock(&budget_lock) != 0) return;
+    swap_balance_keep(-1);
+    task_mutex_unlock(&budget_lock);
+}
+
 void swap_slot_free(swap_slot_t *slot) {
     if (!slot || slot->offset >= SWAP_SLOT_MAX) return;
+    task_mutex_lock(&budget_lock);
     swap_slot_t *real = &swap_slots[slot->offset];
-    if (real->local_ptr) {
-        free(real->local_ptr);
-        memory_budget_free(BUDGET_SWAP_CACHE, real->size);
-    }
+    if (real->local_ptr)
+        budget_free(BUDGET_SWAP_CACHE, real->local_ptr);
+    for (uint32_t i = 0; i < real->chunk_count; i++)
+        swap_chunk_used[real->chunk + i] = 0;
+    real->chunk_count = 0;
     real->local_ptr = NULL;
     real->in_use = 0;
+    task_mutex_unlock(&budget_lock);
 }
 
-void swap_compress(const void *src, size_t len, void *dst, size_t *out_len) {
-    const unsigned char *s = (const unsigned char *)src;
-    unsigned char *d = (unsigned char *)dst;
-    size_t i = 0, o = 0;
-    while (i < len && o + 2 < len) {
-        unsigned char run = s[i];
-        size_t count = 1;
-        while (i + count < len && s[i + count] == run && count < 127) count++;
-        if (count >= 3) {
-            d[o++] = (unsigned char)(0x80 | count);
-            d[o++] = run;
-            i += count;
-        } else {
-            d[o++] = s[i++];
-        }
-    }
-    *out_len = o;
-}
-
-void swap_decompress(const void *src, size_t len, void *dst, size_t *out_len) {
-    const unsigned char *s = (const unsigned char *)src;
-    unsigned char *d = (unsigned char *)dst;
-    size_t i = 0, o = 0;
-    while (i < len) {
-        if (s[i] & 0x80) {
-            size_t count = s[i] & 0x7F;
-            unsigned char v = s[i + 1];
-            size_t j;
-            for (j = 0; j < count; j++) d[o++] = v;
-            i += 2;
-        } else {
-            d[o++] = s[i++];
-        }
+/* Shrinker for BUDGET_SWAP_CACHE: push resident slots out to storage, LRU first. */
+static size_t swap_shrink(size_t want_bytes, void *ctx) {
+    size_t freed = 0;
+    (void)ctx;
+    while (freed < want_bytes) {
+        swap_slot_t *s = swap_lru_victim(swap_restoring);
+        if (!s) break;
+        size_t held = malloc_usable_size(s->local_ptr);
+        if (swap_evict(s, SWAP_PATH_DEFAULT) != 0) break;
+        freed += held;
     }
-    *out_len = o;
+    return freed;
+}
+
+void swap_compress(const void *src, size_t len, void *dst, size_t *out_len) {
+    *out_len = lz_compress(src, len, dst, LZ_BOUND(len));
+}
+
+int swap_decompress(const void *src, size_t len, void *dst, size_t dst_cap, size_t *out_len) {
+    return lz_decompress(src, len, dst, dst_cap, out_len);
 }
@@ -1,5 +1,7 @@
 #include "memory_manager.h"
 #include "kernel.h"
+#include "page_alloc.h"
+#include "platform.h"
 #include <stdint.h>
 #include <stddef.h>
 
@@ -16,25 +18,183 @@ static inline void *memset(void *s, int c, size_t n) {
     return s;
 }
 
+/* Arena layout: [prologue footer][block][block]...[epilogue header].
+ * Both sentinels look allocated, so coalescing never crosses an arena edge.
+ * Arena 0 is the static pool; later ones come from page_alloc(). */
+typedef struct {
+    char *start;
+    size_t len;
+    mem_block_t *first;
+    mem_block_t *epilogue;
+} mem_arena_t;
+
 static char memory_pool[MEMORY_POOL_SIZE];
 static mem_block_t *free_list = NULL;
+static mem_arena_t arenas[MM_ARENA_MAX];
+static int arena_count = 0;
+static size_t direct_bytes = 0;    /* held by MM_CLASS_PAGES blocks */
+static size_t arena_bytes = 0;
+
+/* Running counters behind heap_get_stats(). largest_free only grows on
+ * insert; removing the largest block marks it stale, and the next read
+ * rescans the free list once. Reads are O(1) except for that rescan, so
+ * the largest block is amortized O(1), not O(1) per read. */
+static size_t free_bytes = 0;
+static size_t largest_free = 0;
+static int largest_stale = 0;
+static size_t in_use = 0;
+static size_t peak_in_use = 0;
+static unsigned int n_allocs, n_frees, n_failed;
+static unsigned int size_hist[MM_HIST_BUCKETS];
+
+#define SLAB_CARRIER ((const void *)1)   /* caller tag of a block holding a slab */
+#ifdef MM_PROFILE
+static mem_block_t *direct_list = NULL;  /* live MM_CLASS_PAGES blocks */
+#endif
+
+/* Per-class free lists of slab objects (linked through mem_block_t.next). */
+static mem_block_t *class_free[MM_CLASS_COUNT];
+
+/* Every entry point below holds this: tasks on all cores and IRQ-side code
+ * share one heap. */
+static plat_lock_t heap_lock = PLAT_LOCK_INIT;
 
 
 #define ALIGN(size) (((size) + (ALIGNMENT - 1)) & ~(ALIGNMENT - 1))
+#define CLASS_SIZE(idx) ((size_t)MM_CLASS_MIN << (idx))
+
+#define HDR  sizeof(mem_block_t)
+#define FTR  sizeof(mem_footer_t)
+#define MIN_SPLIT 16
+#define PAYLOAD(b) ((char *)(b) + HDR)
+#define FOOTER(b) ((mem_footer_t *)((char *)(b) + HDR + (b)->size))
+#define NEXT_BLOCK(b) ((mem_block_t *)((char *)(b) + HDR + (b)->size + FTR))
+
+
+static void set_footer(mem_block_t *b) {
+    FOOTER(b)->tag = b->size | (b->free ? 1 : 0);
+}
+
+static mem_block_t *prev_block(mem_block_t *b) {
+    mem_footer_t *pf = (mem_footer_t *)((char *)b - FTR);
+    if (!(pf->tag & 1)) return NULL;
+    size_t psize = pf->tag & ~(size_t)1;
+    return (mem_block_t *)((char *)pf - psize - HDR);
+}
+
+static void free_list_insert(mem_block_t *b) {
+    free_bytes += b->size;
+    if (b->size > largest_free) largest_free = b->size;
+    b->prev = NULL;
+    b->next = free_list;
+    if (free_list) free_list->prev = b;
+    free_list = b;
+}
+
+static void free_list_remove(mem_block_t *b) {
+    free_bytes -= b->size;
+    if (b->size >= largest_free) largest_stale = 1;
+    if (b->prev) b->prev->next = b->next;
+    else free_list = b->next;
+    if (b->next) b->next->prev = b->prev;
+    b->next = b->prev = NULL;
+}
+
 
+static void arena_add(char *mem, size_t len) {
+    mem_arena_t *a = &arenas[arena_count++];
+    mem_footer_t *prologue = (mem_footer_t *)mem;
+    prologue->tag = 0;
+
+    a->start = mem;
+    a->len = len;
+    arena_bytes += len;
+    a->first = (mem_block_t *)(mem + FTR);
+    a->first->size = len - FTR - HDR - FTR - HDR;
+    a->first->free = 1;
+    a->first->size_class = MM_CLASS_LARGE;
+    set_footer(a->first);
+
+    a->epilogue = NEXT_BLOCK(a->first);
+    a->epilogue->size = 0;
+    a->epilogue->free = 0;
+    a->epilogue->size_class = MM_CLASS_LARGE;
+    a->epilogue->next = a->epilogue->prev = NULL;
+
+    free_list_insert(a->first);
+}
+
+/* Add a page-backed arena big enough for a size-byte block. */
+static int heap_grow(size_t size) {
+    size_t need = size + FTR + HDR + FTR + HDR;
+    if (need < MM_ARENA_MIN) need = MM_ARENA_MIN;
+    if (arena_count >= MM_ARENA_MAX) return -1;
+    unsigned int order = page_order_for(need);
+    char *mem = (char *)page_alloc(order);
+    if (!mem) return -1;
+    arena_add(mem, (size_t)PAGE_SIZE << order);
+    return 0;
+}
+
+static int heap_owns(const void *p) {
+    for (int i = 0; i < arena_count; i++) {
+        if ((const char *)p >= arenas[i].start && (const char *)p < arenas[i].start + arenas[i].len)
+            return 1;
+    }
+    return 0;
+}
 
 void init_memory_manager(void) {
-    free_list = (mem_block_t *)memory_pool;
-    free_list->size = MEMORY_POOL_SIZE - sizeof(mem_block_t);
-    free_list->free = 1;
-    free_list->next = NULL;
+    free_list = NULL;
+    arena_count = 0;
+    direct_bytes = 0;
+    arena_bytes = 0;
+    free_bytes = largest_free = 0;
+    largest_stale = 0;
+    in_use = peak_in_use = 0;
+    n_allocs = n_frees = n_failed = 0;
+    for (int i = 0; i < MM_HIST_BUCKETS; i++)
+        size_hist[i] = 0;
+    arena_add(memory_pool, MEMORY_POOL_SIZE);
+    for (int i = 0; i < MM_CLASS_COUNT; i++)
+        class_free[i] = NULL;
+}
+
+/* Smallest class whose object size fits; caller guarantees size <= MM_SMALL_MAX. */
+static int size_to_class(size_t size) {
+    if (size <= MM_CLASS_MIN) return 0;
+    return (int)(32 - __builtin_clz((unsigned int)(size - 1))) - 4;
+}
+
+static void profile_tag(void *p, size_t request, const void *caller) {
+#ifdef MM_PROFILE
+    mem_block_t *b = (mem_block_t *)((char *)p - HDR);
+    b->caller = caller;
+    b->stamp_ms = plat_ticks_ms();
+    b->request = (uint32_t)request;
+#else
+    (void)p; (void)request; (void)caller;
+#endif
+}
+
+static void account_alloc(void *p, size_t request) {
+    if (!p) {
+        n_failed++;
+        return;
+    }
+    int bucket = request > (MM_CLASS_MIN << (MM_HIST_BUCKETS - 2))
+                 ? MM_HIST_BUCKETS - 1 : size_to_class(request);
+    size_hist[bucket]++;
+    n_allocs++;
+    in_use += ((mem_block_t *)((char *)p - HDR))->size;
+    if (in_use > peak_in_use) peak_in_use = in_use;
 }
 
 
 static mem_block_t *find_free_block(size_t size) {
     mem_block_t *current = free_list;
     while (current) {
-        if (current->free && current->size >= size) {
+        if (current->size >= size) {
             return current;
         }
         current = current->next;
@@ -42,121 +202,378 @@ static mem_block_t *find_free_block(size_t size) {
     return NULL;
 }
 
-
+/* Shrink an allocated block to size, returning the tail to the free list
+ * (merged with the following block when that one is free). */
 static void split_block(mem_block_t *block, size_t size) {
-    if (block->size >= size + sizeof(mem_block_t) + ALIGNMENT) {
-        mem_block_t *new_block = (mem_block_t *)((char *)block + sizeof(mem_block_t) + size);
-        new_block->size = block->size - size - sizeof(mem_block_t);
-        
-        new_block->free = 1;
-        new_block->next = block->next;
-        
-        block->size = size;
-        block->next = new_block;
+    if (block->size < size + HDR + FTR + MIN_SPLIT) return;
+
+    mem_block_t *new_block = (mem_block_t *)(PAYLOAD(block) + size + FTR);
+    new_block->size = block->size - size - HDR - FTR;
+    new_block->free = 1;
+    new_block->size_class = MM_CLASS_LARGE;
+
+    block->size = size;
+    set_footer(block);
+
+    mem_block_t *after = NEXT_BLOCK(new_block);
+    if (after->free) {
+        free_list_remove(after);
+        new_block->size += HDR + after->size + FTR;
     }
+    set_footer(new_block);
+    free_list_insert(new_block);
 }
 
-
-static void merge_free_blocks(void) {
-    mem_block_t *current = free_list;
-    while (current && current->next) {
-        if (current->free && current->next->free) {
-            current->size += sizeof(mem_block_t) + current->next->size;
-            current->next = current->next->next;
-        } else {
-            current = current->next;
-        }
+/* Merge b with its free neighbours via the boundary tags; b is not on the free list. */
+static mem_block_t *coalesce(mem_block_t *b) {
+    mem_block_t *next = NEXT_BLOCK(b);
+    if (next->free) {
+        free_list_remove(next);
+        b->size += HDR + next->size + FTR;
     }
+    mem_block_t *prev = prev_block(b);
+    if (prev) {
+        free_list_remove(prev);
+        prev->size += HDR + b->size + FTR;
+        b = prev;
+    }
+    set_footer(b);
+    return b;
 }
 
 
-void *malloc(size_t size) {
-    if (size == 0) {
-        return NULL;
-    }
-    size = ALIGN(size);
-    
+static void *large_alloc(size_t size) {
     mem_block_t *block = find_free_block(size);
     if (!block) {
-
-        return NULL;
+        if (heap_grow(size) != 0)
+            return NULL;
+        block = find_free_block(size);
+        if (!block) return NULL;
     }
 
+    free_list_remove(block);
+    block->free = 0;
+    block->size_class = MM_CLASS_LARGE;
+    set_footer(block);
     split_block(block, size);
+
+    return PAYLOAD(block);
+}
+
+/* Carve a slab out of the large heap and thread its objects onto class_free[idx].
+ * Slabs hold at least 8 objects so the 1-2 KB classes do not waste a slab each. */
+static int slab_refill(int idx) {
+    size_t stride = HDR + CLASS_SIZE(idx);
+    size_t count = MM_SLAB_SIZE / stride;
+    if (count < 8) count = 8;
+
+    char *slab = (char *)large_alloc(stride * count);
+    if (!slab) return -1;
+    profile_tag(slab, stride * count, SLAB_CARRIER);
+
+    for (size_t i = 0; i < count; i++) {
+        mem_block_t *obj = (mem_block_t *)(slab + i * stride);
+        obj->size = CLASS_SIZE(idx);
+        obj->free = 1;
+        obj->size_class = idx;
+        obj->prev = NULL;
+        obj->next = class_free[idx];
+        class_free[idx] = obj;
+    }
+    return 0;
+}
+
+/* Framebuffer copies, snapshots and swap buffers: whole buddy blocks. */
+static void *page_direct_alloc(size_t size) {
+    unsigned int order = page_order_for(size + HDR);
+    mem_block_t *block = (mem_block_t *)page_alloc(order);
+    if (!block) return NULL;
+    block->size = ((size_t)PAGE_SIZE << order) - HDR;
+    block->next = block->prev = NULL;
     block->free = 0;
+    block->size_class = MM_CLASS_PAGES;
+    direct_bytes += (size_t)PAGE_SIZE << order;
+#ifdef MM_PROFILE
+    block->next = direct_list;
+    if (direct_list) direct_list->prev = block;
+    direct_list = block;
+#endif
+    return PAYLOAD(block);
+}
+
 
-    return (char *)block + sizeof(mem_block_t);
+static void *heap_alloc(size_t size) {
+    if (size <= MM_SMALL_MAX) {
+        int idx = size_to_class(size);
+        if (!class_free[idx] && slab_refill(idx) != 0)
+            return NULL;
+        mem_block_t *obj = class_free[idx];
+        class_free[idx] = obj->next;
+        obj->next = NULL;
+        obj->free = 0;
+        return PAYLOAD(obj);
+    }
+    if (size >= MM_PAGE_DIRECT) {
+        void *p = page_direct_alloc(size);
+        if (p) return p;
+    }
+    return large_alloc(ALIGN(size));
 }
 
-// updated free
-void free(void *ptr) {
-    if (!ptr) return;
-    
-    if ((char *)ptr < memory_pool || (char *)ptr >= memory_pool + MEMORY_POOL_SIZE) {
+/* heap_alloc plus accounting and the profiler tag; caller holds heap_lock. */
+static void *heap_alloc_from(size_t size, const void *caller) {
+    void *p = heap_alloc(size);
+    account_alloc(p, size);
+    if (p) profile_tag(p, size, caller);
+    return p;
+}
+
+void *malloc_from(size_t size, const void *caller) {
+    if (size == 0) {
+        return NULL;
+    }
+    uint32_t flags = plat_lock_irqsave(&heap_lock);
+    void *p = heap_alloc_from(size, caller);
+    plat_unlock_irqrestore(&heap_lock, flags);
+    return p;
+}
+
+void *malloc(size_t size) {
+    return malloc_from(size, __builtin_return_address(0));
+}
+
+static void heap_free(void *ptr) {
+    mem_block_t *block = (mem_block_t *)((char *)ptr - HDR);
+    if (!heap_owns(ptr)) {
+        /* Outside the arenas only a direct page block is ours; check the
+         * page allocator before trusting anything in the header. */
+        int order = page_block_order(block);
+        if (order >= 0 && block->size_class == MM_CLASS_PAGES && !block->free &&
+            block->size == ((size_t)PAGE_SIZE << order) - HDR) {
+            in_use -= block->size;
+            n_frees++;
+#ifdef MM_PROFILE
+            if (block->prev) block->prev->next = block->next;
+            else direct_list = block->next;
+            if (block->next) block->next->prev = block->prev;
+#endif
+            block->free = 1;
+            direct_bytes -= (size_t)PAGE_SIZE << order;
+            page_free(block, order);
+        }
         // Invalid pointer - just return silently in freestanding environment
         return;
     }
 
-    mem_block_t *block = (mem_block_t *)((char *)ptr - sizeof(mem_block_t));
+    if (block->free) return;  /* double free */
     block->free = 1;
+    in_use -= block->size;
+    n_frees++;
 
-    merge_free_blocks();
+    if (block->size_class != MM_CLASS_LARGE) {
+        block->next = class_free[block->size_class];
+        class_free[block->size_class] = block;
+        return;
+    }
+
+    free_list_insert(coalesce(block));
 }
 
+/* The heap is shared by every task, core and IRQ-side code: each entry
+ * point holds heap_lock, so neither a preemptive switch nor another core
+ * lands mid-update. */
+void free(void *ptr) {
+    if (!ptr) return;
+    uint32_t flags = plat_lock_irqsave(&heap_lock);
+    heap_free(ptr);
+    plat_unlock_irqrestore(&heap_lock, flags);
+}
 
-void *realloc(void *ptr, size_t new_size) {
-    if (!ptr) {
-        return malloc(new_size);
-    }
-    if (new_size == 0) {
-        free(ptr);
-        return NULL;
-    }
 
-    mem_block_t *block = (mem_block_t *)((char *)ptr - sizeof(mem_block_t));
+static void *heap_realloc(void *ptr, size_t new_size, const void *caller) {
+    mem_block_t *block = (mem_block_t *)((char *)ptr - HDR);
+    size_t old_size = block->size;
     if (block->size >= new_size) {
-        split_block(block, ALIGN(new_size));
+        if (block->size_class == MM_CLASS_LARGE) {
+            split_block(block, ALIGN(new_size));
+            in_use -= old_size - block->size;
+        }
+        profile_tag(ptr, new_size, caller);
         return ptr;
     }
 
+    /* Grow in place by absorbing a free right-hand neighbour. */
+    if (block->size_class == MM_CLASS_LARGE) {
+        mem_block_t *next = NEXT_BLOCK(block);
+        size_t want = ALIGN(new_size);
+        if (next->free && block->size + HDR + next->size + FTR >= want) {
+            free_list_remove(next);
+            block->size += HDR + next->size + FTR;
+            set_footer(block);
+            split_block(block, want);
+            in_use += block->size - old_size;
+            if (in_use > peak_in_use) peak_in_use = in_use;
+            profile_tag(ptr, new_size, caller);
+            return ptr;
+        }
+    }
 
-    void *new_ptr = malloc(new_size);
+
+    void *new_ptr = heap_alloc_from(new_size, caller);    /* heap_lock is held */
     if (!new_ptr) return NULL;
 
 
     memcpy(new_ptr, ptr, block->size < new_size ? block->size : new_size);
-    free(ptr);
+    heap_free(ptr);
     return new_ptr;
 }
 
+void *realloc(void *ptr, size_t new_size) {
+    if (!ptr) {
+        return malloc_from(new_size, __builtin_return_address(0));
+    }
+    if (new_size == 0) {
+        free(ptr);
+        return NULL;
+    }
+    uint32_t flags = plat_lock_irqsave(&heap_lock);
+    void *p = heap_realloc(ptr, new_size, __builtin_return_address(0));
+    plat_unlock_irqrestore(&heap_lock, flags);
+    return p;
+}
+
 void *calloc(size_t nmemb, size_t size) {
     size_t total_size = nmemb * size;
-    void *ptr = malloc(total_size);
+    void *ptr = malloc_from(total_size, __builtin_return_address(0));
     if (ptr) {
         memset(ptr, 0, total_size);
     }
     return ptr;
 }
 
+size_t malloc_usable_size(void *ptr) {
+    if (!ptr) return 0;
+    mem_block_t *block = (mem_block_t *)((char *)ptr - HDR);
+    if (block->free) return 0;
+    return block->size;
+}
+
+/* Slabs count as used in full: their objects are not returned to the large heap.
+ * Percentage is of all memory the heap can reach (static pool + page allocator). */
 unsigned int get_memory_usage_percent(void) {
-    size_t used = 0;
-    mem_block_t *current = free_list;
-    while (current) {
-        if (!current->free)
-            used += sizeof(mem_block_t) + current->size;
-        current = current->next;
+    size_t used = arena_bytes + direct_bytes - free_bytes;
+    size_t total_kb = MEMORY_POOL_SIZE / 1024 + (size_t)page_alloc_total_pages() * (PAGE_SIZE / 1024);
+    if (total_kb == 0) return 0;
+    return (unsigned int)(((used / 1024) * 100) / total_kb);
+}
+
+void heap_get_stats(heap_stats_t *out) {
+    if (!out) return;
+    uint32_t flags = plat_lock_irqsave(&heap_lock);
+    if (largest_stale) {
+        largest_free = 0;
+        for (mem_block_t *b = free_list; b; b = b->next)
+            if (b->size > largest_free) largest_free = b->size;
+        largest_stale = 0;
+    }
+    out->in_use = in_use;
+    out->peak = peak_in_use;
+    out->heap_bytes = arena_bytes + direct_bytes;
+    out->free_bytes = free_bytes;
+    out->largest_free = largest_free;
+    if (free_bytes == 0)
+        out->frag_pct = 0;
+    else if (free_bytes >= (1u << 20))   /* KB keeps the product in 32 bits */
+        out->frag_pct = 100 - (unsigned int)((largest_free / 1024) * 100 / (free_bytes / 1024));
+    else
+        out->frag_pct = 100 - (unsigned int)(largest_free * 100 / free_bytes);
+    out->allocs = n_allocs;
+    out->frees = n_frees;
+    out->failed = n_failed;
+    for (int i = 0; i < MM_HIST_BUCKETS; i++)
+        out->hist[i] = size_hist[i];
+    plat_unlock_irqrestore(&heap_lock, flags);
+}
+
+#ifdef MM_PROFILE
+static void profile_add(heap_site_t *out, int *n, int max, const mem_block_t *b,
+                        uint32_t now, uint32_t min_age_ms) {
+    int i;
+    if (now - b->stamp_ms < min_age_ms) return;
+    for (i = 0; i < *n; i++)
+        if (out[i].caller == b->caller) break;
+    if (i == *n) {
+        if (*n == max) {
+            /* Table full: fold into a trailing catch-all entry. */
+            i = max - 1;
+            out[i].caller = 0;
+        } else {
+            (*n)++;
+            out[i].caller = b->caller;
+            out[i].count = out[i].bytes = 0;
+            out[i].oldest_ms = b->stamp_ms;
+        }
     }
-    if (MEMORY_POOL_SIZE == 0) return 0;
-    return (unsigned int)((used * 100) / MEMORY_POOL_SIZE);
+    out[i].count++;
+    out[i].bytes += b->request;
+    if ((int32_t)(b->stamp_ms - out[i].oldest_ms) < 0) out[i].oldest_ms = b->stamp_ms;
 }
 
+int heap_profile_sites(heap_site_t *out, int max, uint32_t min_age_ms) {
+    uint32_t now = plat_ticks_ms();
+    int n = 0;
+    if (!out || max <= 0) return 0;
+    for (int a = 0; a < arena_count; a++) {
+        for (mem_block_t *b = arenas[a].first; b != arenas[a].epilogue; b = NEXT_BLOCK(b)) {
+            if (b->free) continue;
+            if (b->caller != SLAB_CARRIER) {
+                profile_add(out, &n, max, b, now, min_age_ms);
+                continue;
+            }
+            /* Same geometry as slab_refill(). */
+            int idx = ((mem_block_t *)PAYLOAD(b))->size_class;
+            size_t stride = HDR + CLASS_SIZE(idx);
+            size_t count = MM_SLAB_SIZE / stride;
+            if (count < 8) count = 8;
+            for (size_t k = 0; k < count; k++) {
+                mem_block_t *obj = (mem_block_t *)(PAYLOAD(b) + k * stride);
+                if (!obj->free) profile_add(out, &n, max, obj, now, min_age_ms);
+            }
+        }
+    }
+    for (mem_block_t *b = direct_list; b; b = b->next)
+        profile_add(out, &n, max, b, now, min_age_ms);
+    for (int i = 1; i < n; i++) {
+        heap_site_t t = out[i];
+        int j = i;
+        for (; j > 0 && out[j - 1].bytes < t.bytes; j--) out[j] = out[j - 1];
+        out[j] = t;
+    }
+    return n;
+}
+#else
+int heap_profile_sites(heap_site_t *out, int max, uint32_t min_age_ms) {
+    (void)out; (void)max; (void)min_age_ms;
+    return -1;
+}
+#endif
+
 void print_memory_state(void) {
-    mem_block_t *current = free_list;
     kprint("Memory State:\n");
-    while (current) {
-        kprintf("Block %p - size: %zu, free: %d, next: %p\n",
-               (void *)current, current->size, current->free, (void *)current->next);
-        current = current->next;
+    for (int i = 0; i < arena_count; i++) {
+        kprintf("Arena %d at %x - %d bytes\n", i, (unsigned int)arenas[i].start, (int)arenas[i].len);
+        mem_block_t *current = arenas[i].first;
+        while (current != arenas[i].epilogue) {
+            kprintf("Block %x - size: %d, free: %d\n",
+                   (unsigned int)current, (int)current->size, current->free);
+            current = NEXT_BLOCK(current);
+        }
+    }
+    kprintf("Direct page blocks: %d bytes\n", (int)direct_bytes);
+    for (int i = 0; i < MM_CLASS_COUNT; i++) {
+        int n = 0;
+        for (mem_block_t *o = class_free[i]; o; o = o->next) n++;
+        kprintf("Class %d (%d bytes) - free objects: %d\n", i, (int)CLASS_SIZE(i), n);
     }
     kprint("\n");
 }
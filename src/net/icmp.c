@@ -62,8 +62,8 @@ int net_icmp_ping(uint32_t dst_ip, uint32_t *rtt_ms) {
     plat_net_send(pkt, 28);
 
     uint8_t rx[128];
-    int tries = 2000;
-    while (tries-- > 0) {
+    uint32_t waited;
+    for (waited = 0; waited < NET_ICMP_TIMEOUT_MS; waited += NET_POLL_MS) {
         int n = plat_net_recv(rx, sizeof(rx));
         if (n >= 28) {
             icmp_hdr_t *ricmp = (icmp_hdr_t *)(rx + 20);
@@ -72,7 +72,7 @@ int net_icmp_ping(uint32_t dst_ip, uint32_t *rtt_ms) {
                 return 0;
             }
         }
-        plat_delay_ms(1);
+        plat_delay_ms(NET_POLL_MS);
     }
     return -1;
 }
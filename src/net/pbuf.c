@@ -0,0 +1,96 @@
+/* Packet buffer pool — see pbuf.h. */
+
+#include "pbuf.h"
+#include "platform.h"
+
+static pbuf_t pbuf_pool[PBUF_POOL_SIZE];
+static pbuf_t *pbuf_free_list;
+static uint32_t pbuf_free_count;
+static uint32_t pbuf_low_water;
+static uint32_t pbuf_fail;
+static int pbuf_ready;
+static plat_lock_t pbuf_lock = PLAT_LOCK_INIT;
+
+/* First use, from whichever of the RX IRQ, a task or the shell comes
+ * first; callers hold pbuf_lock. */
+static void pbuf_init(void) {
+    int i;
+    pbuf_free_list = (pbuf_t *)0;
+    for (i = PBUF_POOL_SIZE - 1; i >= 0; i--) {
+        pbuf_pool[i].ref = 0;
+        pbuf_pool[i].next = pbuf_free_list;
+        pbuf_free_list = &pbuf_pool[i];
+    }
+    pbuf_free_count = PBUF_POOL_SIZE;
+    pbuf_low_water = PBUF_POOL_SIZE;
+    pbuf_ready = 1;
+}
+
+pbuf_t *pbuf_alloc(uint16_t headroom, uint16_t len) {
+    pbuf_t *p;
+    if ((uint32_t)headroom + len > PBUF_BUF_SIZE) return (pbuf_t *)0;
+    uint32_t flags = plat_lock_irqsave(&pbuf_lock);
+    if (!pbuf_ready) pbuf_init();
+    p = pbuf_free_list;
+    if (!p) {
+        pbuf_fail++;
+        plat_unlock_irqrestore(&pbuf_lock, flags);
+        return (pbuf_t *)0;
+    }
+    pbuf_free_list = p->next;
+    if (--pbuf_free_count < pbuf_low_water) pbuf_low_water = pbuf_free_count;
+    plat_unlock_irqrestore(&pbuf_lock, flags);
+    p->next = (pbuf_t *)0;
+    p->ref = 1;
+    p->payload = p->buf + headroom;
+    p->len = len;
+    return p;
+}
+
+void pbuf_ref(pbuf_t *p) {
+    uint32_t flags = plat_lock_irqsave(&pbuf_lock);
+    if (p && p->ref) p->ref++;
+    plat_unlock_irqrestore(&pbuf_lock, flags);
+}
+
+/* Buffers are handed between tasks, cores and the NIC, so refcounts and
+ * the free list only change under pbuf_lock. */
+void pbuf_free(pbuf_t *p) {
+    if (!p) return;
+    uint32_t flags = plat_lock_irqsave(&pbuf_lock);
+    if (p->ref && --p->ref == 0) {
+        p->next = pbuf_free_list;
+        pbuf_free_list = p;
+        pbuf_free_count++;
+    }
+    plat_unlock_irqrestore(&pbuf_lock, flags);
+}
+
+void *pbuf_push(pbuf_t *p, uint16_t n) {
+    if (!p || (size_t)(p->payload - p->buf) < n) return (void *)0;
+    p->payload -= n;
+    p->len = (uint16_t)(p->len + n);
+    return p->payload;
+}
+
+void *pbuf_pull(pbuf_t *p, uint16_t n) {
+    if (!p || p->len < n) return (void *)0;
+    p->payload += n;
+    p->len = (uint16_t)(p->len - n);
+    return p->payload;
+}
+
+void pbuf_trim(pbuf_t *p, uint16_t len) {
+    if (p && len < p->len) p->len = len;
+}
+
+void pbuf_get_stats(pbuf_stats_t *out) {
+    if (!out) return;
+    uint32_t flags = plat_lock_irqsave(&pbuf_lock);
+    if (!pbuf_ready) pbuf_init();
+    out->total = PBUF_POOL_SIZE;
+    out->free = pbuf_free_count;
+    out->low_water = pbuf_low_water;
+    out->alloc_fail = pbuf_fail;
+    plat_unlock_irqrestore(&pbuf_lock, flags);
+}
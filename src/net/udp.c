@@ -3,16 +3,20 @@
 #include "net.h"
 #include "platform.h"
 #include "kernel.h"
+#include "pbuf.h"
 #include <stdint.h>
 
 #define RX_SLOTS 8
-#define RX_SLOT_SIZE 1536
 
+/* Received datagrams stay in the pbuf they arrived in; data/len are kept
+ * here because the buffer's own payload window may still be moved by the
+ * sender (loopback shares the TX buffer). */
 typedef struct {
     uint32_t src_ip;
     uint16_t src_port;
     uint16_t len;
-    uint8_t data[NET_MAX_PAYLOAD];
+    const uint8_t *data;
+    pbuf_t *p;
 } rx_slot_t;
 
 static rx_slot_t rx_ring[RX_SLOTS];
@@ -59,64 +63,103 @@ void net_ip_to_str(uint32_t ip, char *buf, int max) {
     buf[i] = '\0';
 }
 
-static void ring_push(uint32_t sip, uint16_t sport, const void *data, uint16_t len) {
+/* Queue a reference to p; the ring owns it from here (dropped when full). */
+static void ring_push(uint32_t sip, uint16_t sport, pbuf_t *p, const uint8_t *data, uint16_t len) {
     int next = (rx_tail + 1) % RX_SLOTS;
-    if (next == rx_head) return;
+    if (next == rx_head) {
+        pbuf_free(p);
+        return;
+    }
     rx_ring[rx_tail].src_ip = sip;
     rx_ring[rx_tail].src_port = sport;
     rx_ring[rx_tail].len = len;
-    uint16_t i;
-    for (i = 0; i < len && i < NET_MAX_PAYLOAD; i++)
-        rx_ring[rx_tail].data[i] = ((const uint8_t *)data)[i];
+    rx_ring[rx_tail].data = data;
+    rx_ring[rx_tail].p = p;
     rx_tail = next;
 }
 
+static void ring_drain(void) {
+    while (rx_head != rx_tail) {
+        pbuf_free(rx_ring[rx_head].p);
+        rx_ring[rx_head].p = (pbuf_t *)0;
+        rx_head = (rx_head + 1) % RX_SLOTS;
+    }
+}
+
 int net_init(void) {
+    ring_drain();
     rx_head = rx_tail = 0;
     net_up = 1;
     return 0;
 }
 
 void net_shutdown(void) {
+    ring_drain();
     net_up = 0;
 }
 
-int net_udp_send(uint32_t dst_ip, uint16_t dst_port, const void *data, uint16_t len) {
-    if (!net_up) return -1;
-    uint8_t pkt[32 + NET_MAX_PAYLOAD];
-    uint16_t i = 0;
-    pkt[i++] = 'A'; pkt[i++] = 'S'; pkt[i++] = 'M';
-    pkt[i++] = (uint8_t)((dst_ip >> 24) & 0xFF);
-    pkt[i++] = (uint8_t)((dst_ip >> 16) & 0xFF);
-    pkt[i++] = (uint8_t)((dst_ip >> 8) & 0xFF);
-    pkt[i++] = (uint8_t)(dst_ip & 0xFF);
-    pkt[i++] = (uint8_t)(dst_port & 0xFF);
-    pkt[i++] = (uint8_t)(dst_port >> 8);
-    pkt[i++] = (uint8_t)(len & 0xFF);
-    pkt[i++] = (uint8_t)(len >> 8);
-    uint16_t j;
-    for (j = 0; j < len && i < sizeof(pkt); j++)
-        pkt[i++] = ((const uint8_t *)data)[j];
-    plat_net_send(pkt, i);
+int net_udp_send_pbuf(uint32_t dst_ip, uint16_t dst_port, pbuf_t *p) {
+    if (!p) return -1;
+    if (!net_up) {
+        pbuf_free(p);
+        return -1;
+    }
+    pbuf_trim(p, NET_MAX_PAYLOAD);
+    uint16_t len = p->len;
+    const uint8_t *data = p->payload;
     plat_net_info_t info;
     plat_net_get_info(&info);
-    if (dst_ip == info.ip || dst_ip == 0x7F000001u)
-        ring_push(info.ip, dst_port, data, len);
+    if (dst_ip == info.ip || dst_ip == 0x7F000001u) {
+        pbuf_ref(p);
+        ring_push(info.ip, dst_port, p, data, len);
+    }
+    uint8_t *h = (uint8_t *)pbuf_push(p, PBUF_NET_HLEN);
+    if (!h) {
+        pbuf_free(p);
+        return -1;
+    }
+    h[0] = 'A'; h[1] = 'S'; h[2] = 'M';
+    h[3] = (uint8_t)((dst_ip >> 24) & 0xFF);
+    h[4] = (uint8_t)((dst_ip >> 16) & 0xFF);
+    h[5] = (uint8_t)((dst_ip >> 8) & 0xFF);
+    h[6] = (uint8_t)(dst_ip & 0xFF);
+    h[7] = (uint8_t)(dst_port & 0xFF);
+    h[8] = (uint8_t)(dst_port >> 8);
+    h[9] = (uint8_t)(len & 0xFF);
+    h[10] = (uint8_t)(len >> 8);
+    plat_net_send_pbuf(p);
     return (int)len;
 }
 
+int net_udp_send(uint32_t dst_ip, uint16_t dst_port, const void *data, uint16_t len) {
+    if (!net_up) return -1;
+    if (len > NET_MAX_PAYLOAD) len = NET_MAX_PAYLOAD;
+    pbuf_t *p = pbuf_alloc(PBUF_HEADROOM, len);
+    if (!p) return -1;
+    uint16_t i;
+    for (i = 0; i < len; i++)
+        p->payload[i] = ((const uint8_t *)data)[i];
+    return net_udp_send_pbuf(dst_ip, dst_port, p);
+}
+
 int net_udp_recv(uint32_t *src_ip, uint16_t *src_port, void *buf, uint16_t max_len) {
     if (!net_up) return -1;
-    uint8_t raw[1536];
-    int n = plat_net_recv(raw, sizeof(raw));
-    if (n >= 11 && raw[0] == 'A' && raw[1] == 'S' && raw[2] == 'M') {
-        uint32_t sip = ((uint32_t)raw[3] << 24) | ((uint32_t)raw[4] << 16) |
-                       ((uint32_t)raw[5] << 8) | raw[6];
-        uint16_t sport = raw[7] | ((uint16_t)raw[8] << 8);
-        uint16_t plen = raw[9] | ((uint16_t)raw[10] << 8);
-        if (11 + plen <= (uint16_t)n) {
-            ring_push(sip, sport, raw + 11, plen);
+    pbuf_t *p = plat_net_recv_pbuf();
+    if (p) {
+        const uint8_t *raw = p->payload;
+        uint16_t n = p->len;
+        if (n >= PBUF_NET_HLEN && raw[0] == 'A' && raw[1] == 'S' && raw[2] == 'M') {
+            uint32_t sip = ((uint32_t)raw[3] << 24) | ((uint32_t)raw[4] << 16) |
+                           ((uint32_t)raw[5] << 8) | raw[6];
+            uint16_t sport = raw[7] | ((uint16_t)raw[8] << 8);
+            uint16_t plen = raw[9] | ((uint16_t)raw[10] << 8);
+            if (PBUF_NET_HLEN + plen <= n) {
+                pbuf_pull(p, PBUF_NET_HLEN);
+                ring_push(sip, sport, p, p->payload, plen);
+                p = (pbuf_t *)0;
+            }
         }
+        pbuf_free(p);
     }
     if (rx_head == rx_tail) return 0;
     rx_slot_t *s = &rx_ring[rx_head];
@@ -126,6 +169,8 @@ int net_udp_recv(uint32_t *src_ip, uint16_t *src_port, void *buf, uint16_t max_l
     for (i = 0; i < cpy; i++) ((uint8_t *)buf)[i] = s->data[i];
     if (src_ip) *src_ip = s->src_ip;
     if (src_port) *src_port = s->src_port;
+    pbuf_free(s->p);
+    s->p = (pbuf_t *)0;
     rx_head = (rx_head + 1) % RX_SLOTS;
     return (int)cpy;
 }
@@ -139,14 +184,14 @@ int net_ping(const char *host, uint32_t *rtt_ms) {
     uint8_t buf[16];
     uint32_t sip;
     uint16_t sport;
-    int tries = 1000;
-    while (tries-- > 0) {
+    uint32_t waited;
+    for (waited = 0; waited < NET_PING_TIMEOUT_MS; waited += NET_POLL_MS) {
         int n = net_udp_recv(&sip, &sport, buf, sizeof(buf));
         if (n >= 4 && buf[0] == 'P') {
             if (rtt_ms) *rtt_ms = plat_ticks_ms() - start;
             return 0;
         }
-        plat_delay_ms(1);
+        plat_delay_ms(NET_POLL_MS);
     }
     return -1;
 }
@@ -0,0 +1,214 @@
+/* Binary buddy page-frame allocator seeded from the platform memory map. */
+
+#include "page_alloc.h"
+#include "platform.h"
+#include "kernel.h"
+#include <stddef.h>
+
+/* Per-frame byte: head of a free block = FRAME_FREE | order, head of an
+ * allocated block = order, anything else (tail page, hole, metadata) = FRAME_NONE. */
+#define FRAME_FREE   0x80
+#define FRAME_NONE   0x7F
+#define ORDER_LIMIT  (31 - PAGE_SHIFT)      /* 2 GB, the most a size_t can ask for */
+
+typedef struct page_node {
+    struct page_node *next;
+    struct page_node *prev;
+} page_node_t;
+
+static page_node_t *free_area[PAGE_MAX_ORDER + 1];
+static uint8_t *frame_info;
+static uint32_t frame_base;      /* physical address of frame 0 */
+static uint32_t frame_count;
+static uint32_t total_pages;
+static uint32_t free_pages;
+static int inited = 0;
+static plat_lock_t page_lock = PLAT_LOCK_INIT;     /* free lists, shared by all cores */
+
+#define FRAME_ADDR(idx) ((void *)(frame_base + ((uint32_t)(idx) << PAGE_SHIFT)))
+#define ADDR_FRAME(p)   (((uint32_t)(p) - frame_base) >> PAGE_SHIFT)
+
+static void area_push(unsigned int order, uint32_t idx) {
+    page_node_t *n = (page_node_t *)FRAME_ADDR(idx);
+    n->prev = NULL;
+    n->next = free_area[order];
+    if (free_area[order]) free_area[order]->prev = n;
+    free_area[order] = n;
+    frame_info[idx] = (uint8_t)(FRAME_FREE | order);
+}
+
+static void area_remove(unsigned int order, uint32_t idx) {
+    page_node_t *n = (page_node_t *)FRAME_ADDR(idx);
+    if (n->prev) n->prev->next = n->next;
+    else free_area[order] = n->next;
+    if (n->next) n->next->prev = n->prev;
+    frame_info[idx] = FRAME_NONE;
+}
+
+/* Insert a free block, merging with its buddy while the buddy is free too. */
+static void free_block(uint32_t idx, unsigned int order) {
+    while (order < PAGE_MAX_ORDER) {
+        uint32_t buddy = idx ^ (1u << order);
+        if (buddy >= frame_count || frame_info[buddy] != (FRAME_FREE | order))
+            break;
+        area_remove(order, buddy);
+        if (buddy < idx) idx = buddy;
+        order++;
+    }
+    area_push(order, idx);
+}
+
+static void add_range(uint32_t first, uint32_t end) {
+    while (first < end) {
+        unsigned int order = PAGE_MAX_ORDER;
+        while (order > 0 && ((first & ((1u << order) - 1)) || first + (1u << order) > end))
+            order--;
+        free_pages += 1u << order;
+        total_pages += 1u << order;
+        free_block(first, order);
+        first += 1u << order;
+    }
+}
+
+void page_alloc_init(void) {
+    plat_mem_region_t map[PLAT_MEM_REGION_MAX];
+    int n, i;
+    uint32_t lo = 0xFFFFFFFFu, hi = 0;
+
+    if (inited) return;
+    n = plat_mem_map(map, PLAT_MEM_REGION_MAX);
+    for (i = 0; i < n; i++) {
+        uint32_t b = (map[i].base + PAGE_SIZE - 1) & ~(uint32_t)(PAGE_SIZE - 1);
+        uint32_t e = (map[i].base + map[i].length) & ~(uint32_t)(PAGE_SIZE - 1);
+        map[i].base = b;
+        map[i].length = (e > b) ? e - b : 0;
+        if (!map[i].length) continue;
+        if (b < lo) lo = b;
+        if (e > hi) hi = e;
+    }
+    if (hi <= lo) return;
+
+    frame_base = lo;
+    frame_count = (hi - lo) >> PAGE_SHIFT;
+
+    /* frame_info lives in the first region large enough to hold it. */
+    uint32_t meta_pages = (frame_count + PAGE_SIZE - 1) >> PAGE_SHIFT;
+    for (i = 0; i < n; i++) {
+        if (map[i].length >= ((meta_pages + 1) << PAGE_SHIFT)) {
+            frame_info = (uint8_t *)map[i].base;
+            map[i].base += meta_pages << PAGE_SHIFT;
+            map[i].length -= meta_pages << PAGE_SHIFT;
+            break;
+        }
+    }
+    if (!frame_info) return;
+
+    for (uint32_t f = 0; f < frame_count; f++) frame_info[f] = FRAME_NONE;
+    for (i = 0; i <= PAGE_MAX_ORDER; i++) free_area[i] = NULL;
+    for (i = 0; i < n; i++) {
+        if (!map[i].length) continue;
+        add_range(ADDR_FRAME(map[i].base), ADDR_FRAME(map[i].base + map[i].length));
+    }
+    inited = 1;
+}
+
+/* Above PAGE_MAX_ORDER: 2^(order - PAGE_MAX_ORDER) adjacent free top-order
+ * blocks, starting at any of them (page_lock held). The head frame records
+ * the full order; the other heads become tail pages. */
+static void *span_alloc(unsigned int order) {
+    uint32_t n = 1u << (order - PAGE_MAX_ORDER), step = 1u << PAGE_MAX_ORDER, j;
+    page_node_t *b;
+    for (b = free_area[PAGE_MAX_ORDER]; b; b = b->next) {
+        uint32_t idx = ADDR_FRAME(b);
+        for (j = 1; j < n; j++) {
+            uint32_t k = idx + j * step;
+            if (k >= frame_count || frame_info[k] != (FRAME_FREE | PAGE_MAX_ORDER)) break;
+        }
+        if (j < n) continue;
+        for (j = 0; j < n; j++) area_remove(PAGE_MAX_ORDER, idx + j * step);
+        frame_info[idx] = (uint8_t)order;
+        free_pages -= n * step;
+        return FRAME_ADDR(idx);
+    }
+    return NULL;
+}
+
+void *page_alloc(unsigned int order) {
+    unsigned int o;
+    if (!inited || order > ORDER_LIMIT) return NULL;
+    uint32_t flags = plat_lock_irqsave(&page_lock);
+    if (order > PAGE_MAX_ORDER) {
+        void *p = span_alloc(order);
+        plat_unlock_irqrestore(&page_lock, flags);
+        return p;
+    }
+    for (o = order; o <= PAGE_MAX_ORDER; o++)
+        if (free_area[o]) break;
+    if (o > PAGE_MAX_ORDER) {
+        plat_unlock_irqrestore(&page_lock, flags);
+        return NULL;
+    }
+
+    uint32_t idx = ADDR_FRAME(free_area[o]);
+    area_remove(o, idx);
+    /* Split down, handing the upper halves back to the smaller orders. */
+    while (o > order) {
+        o--;
+        area_push(o, idx + (1u << o));
+    }
+    frame_info[idx] = (uint8_t)order;
+    free_pages -= 1u << order;
+    plat_unlock_irqrestore(&page_lock, flags);
+    return FRAME_ADDR(idx);
+}
+
+void page_free(void *addr, unsigned int order) {
+    if (!inited || !addr || order > ORDER_LIMIT) return;
+    if ((uint32_t)addr < frame_base || ((uint32_t)addr & (PAGE_SIZE - 1))) return;
+    uint32_t idx = ADDR_FRAME(addr);
+    uint32_t flags = plat_lock_irqsave(&page_lock);
+    if (idx >= frame_count || frame_info[idx] != order) {   /* not an allocated head */
+        plat_unlock_irqrestore(&page_lock, flags);
+        return;
+    }
+    free_pages += 1u << order;
+    if (order > PAGE_MAX_ORDER) {
+        uint32_t j, step = 1u << PAGE_MAX_ORDER;
+        for (j = 0; j < 1u << (order - PAGE_MAX_ORDER); j++)
+            free_block(idx + j * step, PAGE_MAX_ORDER);
+    } else {
+        free_block(idx, order);
+    }
+    plat_unlock_irqrestore(&page_lock, flags);
+}
+
+unsigned int page_order_for(size_t bytes) {
+    unsigned int order = 0;
+    while (order <= ORDER_LIMIT && ((size_t)PAGE_SIZE << order) < bytes)
+        order++;
+    return order;
+}
+
+int page_block_order(const void *addr) {
+    uint32_t a = (uint32_t)addr, idx;
+    int order = -1;
+    if (!inited || a < frame_base || (a & (PAGE_SIZE - 1))) return -1;
+    idx = ADDR_FRAME(a);
+    uint32_t flags = plat_lock_irqsave(&page_lock);
+    if (idx < frame_count && frame_info[idx] != FRAME_NONE && !(frame_info[idx] & FRAME_FREE))
+        order = frame_info[idx];
+    plat_unlock_irqrestore(&page_lock, flags);
+    return order;
+}
+
+int page_alloc_ready(void) {
+    return inited;
+}
+
+uint32_t page_alloc_total_pages(void) {
+    return total_pages;
+}
+
+uint32_t page_alloc_free_pages(void) {
+    return free_pages;
+}
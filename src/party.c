@@ -5,6 +5,7 @@
 
 #include "party.h"
 #include "transport.h"
+#include "scheduler.h"
 #include <stddef.h>
 
 static void *party_memcpy(void *dest, const void *src, size_t n) {
@@ -35,6 +36,8 @@ static void *party_memset(void *s, int c, size_t n) {
 static party_room_t room;
 static int party_initialized;
 static uint8_t party_rx_buf[TRANSPORT_MAX_PAYLOAD];
+/* Room state and rx buffer; taken before the transport's own lock. */
+static task_mutex_t party_lock = TASK_MUTEX_INIT;
 
 static void clear_room(void) {
     memset(&room, 0, sizeof(room));
@@ -137,6 +140,7 @@ int party_init(void) {
 int party_create(const char *name) {
     if (!party_initialized)
         return -1;
+    task_mutex_lock(&party_lock);
     clear_room();
     if (name) {
         size_t n = 0;
@@ -158,16 +162,18 @@ int party_create(const char *name) {
     memcpy(payload + 1, room.name, name_len);
     payload[1 + name_len] = (uint8_t)room.member_count;
     send_party_msg(PARTY_MSG_ROOM_INFO, payload, name_len + 2);
+    task_mutex_unlock(&party_lock);
     return 0;
 }
 
 int party_invite(const char *ip) {
-    if (!party_initialized || !room.in_room || !room.is_host)
+    if (!party_initialized || !ip)
         return -1;
-    if (room.member_count >= PARTY_MEMBER_MAX)
-        return -1;
-    if (!ip)
+    task_mutex_lock(&party_lock);
+    if (!room.in_room || !room.is_host || room.member_count >= PARTY_MEMBER_MAX) {
+        task_mutex_unlock(&party_lock);
         return -1;
+    }
     size_t i = 0;
     while (ip[i] && i < PARTY_IP_STR_MAX - 1)
         room.members[room.member_count].ip[i] = ip[i], i++;
@@ -175,13 +181,23 @@ int party_invite(const char *ip) {
     room.members[room.member_count].active = 1;
     room.member_count++;
     send_party_msg(PARTY_MSG_INVITE, (const uint8_t *)ip, (uint16_t)(i + 1));
+    task_mutex_unlock(&party_lock);
     return 0;
 }
 
+static void party_poll_locked(void) {
+    uint8_t type;
+    int n = transport_receive(party_rx_buf, sizeof(party_rx_buf), &type);
+    if (n > 0 && type == TRANSPORT_TYPE_DATA && party_rx_buf[0] >= PARTY_MSG_CREATE && party_rx_buf[0] <= PARTY_MSG_ROOM_INFO)
+        party_handle_received(party_rx_buf, n);
+}
+
 int party_list(void) {
     if (!party_initialized)
         return -1;
-    party_poll();
+    task_mutex_lock(&party_lock);
+    party_poll_locked();
+    task_mutex_unlock(&party_lock);
     return 0;
 }
 
@@ -189,6 +205,7 @@ int party_join(const char *ip) {
     if (!party_initialized)
         return -1;
     (void)ip;
+    task_mutex_lock(&party_lock);
     clear_room();
     room.in_room = 1;
     room.is_host = 0;
@@ -196,12 +213,15 @@ int party_join(const char *ip) {
     room.members[0].active = 1;
     room.members[0].ip[0] = '\0';
     send_party_msg(PARTY_MSG_JOIN, (const uint8_t *)"0.0.0.0", 7);
+    task_mutex_unlock(&party_lock);
     return 0;
 }
 
 void party_leave(void) {
+    task_mutex_lock(&party_lock);
     send_party_msg(PARTY_MSG_LEAVE, 0, 0);
     clear_room();
+    task_mutex_unlock(&party_lock);
 }
 
 int party_chat(const char *msg) {
@@ -214,18 +234,22 @@ int party_chat(const char *msg) {
     return 0;
 }
 
+/* Housekeeping entry: skips the round while a command holds the room. */
 void party_poll(void) {
     if (!party_initialized)
         return;
-    uint8_t type;
-    int n = transport_receive(party_rx_buf, sizeof(party_rx_buf), &type);
-    if (n > 0 && type == TRANSPORT_TYPE_DATA && party_rx_buf[0] >= PARTY_MSG_CREATE && party_rx_buf[0] <= PARTY_MSG_ROOM_INFO)
-        party_handle_received(party_rx_buf, n);
+    if (task_mutex_trylock(&party_lock) != 0)
+        return;
+    party_poll_locked();
+    task_mutex_unlock(&party_lock);
 }
 
 void party_get_room(party_room_t *out) {
-    if (out)
-        memcpy(out, &room, sizeof(room));
+    if (!out)
+        return;
+    task_mutex_lock(&party_lock);
+    memcpy(out, &room, sizeof(room));
+    task_mutex_unlock(&party_lock);
 }
 
 int party_in_room(void) {
@@ -3,7 +3,9 @@
 #include "pause_engine.h"
 #include "platform.h"
 #include "memory_manager.h"
+#include "memory_budget.h"
 #include "kernel.h"
+#include "scheduler.h"
 #include <stddef.h>
 
 #define WHITELIST_MAX  PAUSE_WHITELIST_MAX
@@ -22,9 +24,39 @@ static void str_copy(char *dst, const char *src, unsigned int max) {
     dst[i] = '\0';
 }
 
+/* Last snapshot kept in RAM (BUDGET_PAUSE_CACHE) so an immediate restore
+ * skips storage; the shrinker drops it under memory pressure. */
+#define PAUSE_SNAPSHOT_BYTES 4096
+static uint8_t *snap_cache;
+static char snap_cache_path[PAUSE_PATH_MAX];
+/* Guards snap_cache and its path. The shrinker runs from whichever task
+ * hit budget pressure, so it only try-locks and gives up the round. */
+static task_mutex_t pause_lock = TASK_MUTEX_INIT;
+
+static void snap_cache_drop(void) {
+    if (!snap_cache) return;
+    budget_free(BUDGET_PAUSE_CACHE, snap_cache);
+    snap_cache = NULL;
+    snap_cache_path[0] = '\0';
+}
+
+static size_t pause_cache_shrink(size_t want_bytes, void *ctx) {
+    (void)want_bytes;
+    (void)ctx;
+    size_t held = 0;
+    if (task_mutex_trylock(&pause_lock) != 0) return 0;
+    if (snap_cache) {
+        held = malloc_usable_size(snap_cache);
+        snap_cache_drop();
+    }
+    task_mutex_unlock(&pause_lock);
+    return held;
+}
+
 void pause_engine_init(void) {
     if (inited) return;
     whitelist_count = 0;
+    memory_budget_register_shrinker(BUDGET_PAUSE_CACHE, pause_cache_shrink, NULL);
     inited = 1;
 }
 
@@ -43,25 +75,55 @@ int pause_whitelist_add(const char *game_id) {
     return 0;
 }
 
-pause_result_t pause_snapshot_save(const char *path) {
-    if (!path) return PAUSE_ERR_IO;
-    static uint8_t snap[4096];
+static pause_result_t snapshot_save(const char *path) {
+    snap_cache_drop();
+    snap_cache = (uint8_t *)budget_malloc(BUDGET_PAUSE_CACHE, PAUSE_SNAPSHOT_BYTES);
+    if (!snap_cache) return PAUSE_ERR_MEMORY;
     uint32_t i;
-    for (i = 0; i < sizeof(snap); i++) snap[i] = (uint8_t)(i ^ 0xA5);
-    if (plat_fs_write(path, snap, sizeof(snap)) != 0) return PAUSE_ERR_IO;
-    kprintf("  pause: snapshot saved to %s (%u bytes)\n", path, (unsigned)sizeof(snap));
+    for (i = 0; i < PAUSE_SNAPSHOT_BYTES; i++) snap_cache[i] = (uint8_t)(i ^ 0xA5);
+    if (plat_fs_write(path, snap_cache, PAUSE_SNAPSHOT_BYTES) != 0) {
+        snap_cache_drop();
+        return PAUSE_ERR_IO;
+    }
+    str_copy(snap_cache_path, path, PAUSE_PATH_MAX);
+    kprintf("  pause: snapshot saved to %s (%d bytes)\n", path, (int)PAUSE_SNAPSHOT_BYTES);
     return PAUSE_OK;
 }
 
-pause_result_t pause_snapshot_restore(const char *path) {
+pause_result_t pause_snapshot_save(const char *path) {
     if (!path) return PAUSE_ERR_IO;
-    static uint8_t snap[4096];
+    task_mutex_lock(&pause_lock);
+    pause_result_t rc = snapshot_save(path);
+    task_mutex_unlock(&pause_lock);
+    return rc;
+}
+
+static pause_result_t snapshot_restore(const char *path) {
+    if (snap_cache && str_eq(snap_cache_path, path)) {
+        kprintf("  pause: snapshot restored from cache (%d bytes)\n", (int)PAUSE_SNAPSHOT_BYTES);
+        return PAUSE_OK;
+    }
+    snap_cache_drop();
+    snap_cache = (uint8_t *)budget_malloc(BUDGET_PAUSE_CACHE, PAUSE_SNAPSHOT_BYTES);
+    if (!snap_cache) return PAUSE_ERR_MEMORY;
     uint32_t got;
-    if (plat_fs_read(path, snap, sizeof(snap), &got) != 0) return PAUSE_ERR_IO;
-    kprintf("  pause: snapshot restored from %s (%u bytes)\n", path, (unsigned)got);
+    if (plat_fs_read(path, snap_cache, PAUSE_SNAPSHOT_BYTES, &got) != 0) {
+        snap_cache_drop();
+        return PAUSE_ERR_IO;
+    }
+    str_copy(snap_cache_path, path, PAUSE_PATH_MAX);
+    kprintf("  pause: snapshot restored from %s (%d bytes)\n", path, (int)got);
     return PAUSE_OK;
 }
 
+pause_result_t pause_snapshot_restore(const char *path) {
+    if (!path) return PAUSE_ERR_IO;
+    task_mutex_lock(&pause_lock);
+    pause_result_t rc = snapshot_restore(path);
+    task_mutex_unlock(&pause_lock);
+    return rc;
+}
+
 /* --- Compatibility DB + soft pause + checkpoint --- */
 static pause_compat_entry_t compat_db[PAUSE_COMPAT_MAX];
 static unsigned int compat_count = 0;
@@ -4,6 +4,11 @@
 
 static quantum_state_t qstate;
 
+/* BUDGET_APP charge for the working set of the last observe; the next
+ * one releases it. Only accounting: nothing is allocated. */
+#define QUANTUM_OBSERVE_BYTES (256 * 1024)
+static int observed_charged;
+
 void quantum_init(void) {
     int i;
     for (i = 0; i < QUANTUM_PROFILE_MAX; i++) {
@@ -23,8 +28,15 @@ uint8_t quantum_coherence(void) {
 
 int quantum_observe(const char *subsys) {
     if (!subsys) return -1;
-    memory_budget_alloc(BUDGET_APP, 256 * 1024);
-    (void)subsys;
+    if (observed_charged) {
+        memory_budget_free(BUDGET_APP, QUANTUM_OBSERVE_BYTES);
+        observed_charged = 0;
+    }
+    observed_charged = memory_budget_alloc(BUDGET_APP, QUANTUM_OBSERVE_BYTES) == 1;
+    if (!observed_charged) {
+        kprintf("observe: %s stays superposed (app budget full)\n", subsys);
+        return -2;
+    }
     kprintf("observe: %s collapsed into RAM\n", subsys);
     if (qstate.coherence > 10) qstate.coherence -= 5;
     return 0;
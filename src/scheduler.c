@@ -1,71 +1,1300 @@
 #include "scheduler.h"
 #include "msp.h"
 #include "kernel.h"
+#include "platform.h"
 #include "memory_manager.h"
+#include "memory_budget.h"
+#include "page_alloc.h"
 #include "arch_x86.h"
 #include <stdint.h>
 
-static struct {
-    void (*func)(void);
-    uint32_t esp;  /* Stack pointer for context switching */
-} task_list[MAX_TASKS];
+#ifndef PLATFORM_PS2
+#include "irq.h"
+#include "smp.h"
+#endif
+
+typedef struct {
+    void (*func)(void);     /* add_task entry (no argument, exit code 0) */
+    task_fn_t entry;        /* task_create entry */
+    void *arg;
+    uint32_t esp;           /* Saved irq_frame_t (x86) */
+    uint8_t *stack;         /* lowest address; canary words sit here */
+    uint32_t stack_size;
+    uint8_t stack_order;    /* page order, STACK_FROM_HEAP for heap stacks */
+    uint8_t detached;       /* reaped on exit instead of by task_join */
+    int joiner;             /* task blocked in task_join, -1 = none */
+    int exit_code;
+    uint8_t state;
+    uint8_t prio;
+    uint8_t edf;            /* deadline class: runs ahead of every priority */
+    uint8_t wake_pending;   /* task_wake before task_block: don't sleep */
+    uint8_t cpu;            /* core whose run queue holds it / it runs on */
+    uint8_t pinned;         /* never moved to another core */
+    int next;               /* run queue / sleep list link, -1 = end */
+    uint32_t wake_tick;
+    uint32_t period_ticks;
+    uint32_t release_tick;
+    uint32_t deadline_tick;
+    uint32_t deadline_misses;
+    uint64_t run_ns;        /* CPU time, charged at each switch away */
+    uint32_t switches;      /* times switched in */
+} task_t;
+
+/* The table starts static and is reallocated (doubling) when full; code
+ * refers to tasks by index so a move is invisible outside the swap. */
+static task_t task_table_init[TASK_TABLE_INIT];
+static task_t *task_list = task_table_init;
+static int task_cap = TASK_TABLE_INIT;
+
+#ifdef PLATFORM_PS2
+#define TASK_FIRST 0
+#else
+#define TASK_FIRST 2        /* slot 0: boot thread (kernel_main -> shell), 1: BSP idle */
+#define TASK_IDLE  1
+#endif
+
+/* Task table, run queues and sleep list, shared by every core. */
+static plat_lock_t sched_lock = PLAT_LOCK_INIT;
+
+static int task_count = TASK_FIRST;    /* slots in use or reusable */
+static int reap_pending;
+static uint32_t slice_ms = SCHED_TIMESLICE_MS;
+
+static void sched_reap(void);
+static int task_current_locked(void);
+static int task_on_cpu(int id);
+
+static uint32_t ms_to_ticks(uint32_t ms) {
+    uint32_t t = (ms + SCHED_TICK_MS - 1) / SCHED_TICK_MS;
+    return t ? t : 1;
+}
+
+static int task_valid(task_id_t id) {
+    return id >= 0 && id < task_count && task_list[id].state != TASK_UNUSED;
+}
+
+#ifdef PLATFORM_PS2
+static int current_task = -1;  /* -1 until init_scheduler */
+
+static int task_current_locked(void) {
+    return current_task;
+}
+
+static int task_on_cpu(int id) {
+    return id == current_task;
+}
 
-static int task_count = 0;
-static int current_task = -1;  /* -1 until first yield or run */
+static uint64_t task_run_ns(int id) {
+    return task_list[id].run_ns;
+}
+#else
+/* Per-core scheduler state. A core only touches another core's entry with
+ * sched_lock held (queueing, stealing, kicking). */
+typedef struct {
+    int current;            /* running task, -1 until the core schedules */
+    int idle;               /* this core's idle task */
+    int rq_head[TASK_PRIO_LEVELS];
+    int rq_tail[TASK_PRIO_LEVELS];
+    int edf_head;           /* ready deadline tasks, earliest first */
+    int nr_ready;           /* queued tasks, idle not counted */
+    int need_resched;
+    uint32_t slice_left;
+    uint8_t online;
+    uint8_t lock_handoff;   /* switch entered with sched_lock held */
+    uint8_t unlock_on_switch;   /* drop sched_lock once off the old stack */
+    uint8_t tick_stopped;   /* AP idle: local APIC timer off */
+    uint32_t switches, steals, halts;
+    uint64_t busy_ns, idle_ns, stamp_ns;
+} sched_cpu_t;
+
+static sched_cpu_t cpus[SMP_MAX_CPUS];
+static uint32_t slice_ticks = SCHED_TIMESLICE_MS / SCHED_TICK_MS;
+static volatile uint32_t tick_count;
+static int sleep_head = -1;     /* sleeping tasks, earliest wake first */
+static uint32_t idle_armed;     /* BSP: ticks the PIT one-shot covers, 0 = periodic */
+static uint32_t idle_ticks_skipped;
+static uint8_t idle_stack[TASK_STACK_SIZE];
+
+/* Wrap-safe "a is before b" on the tick counter. */
+#define TICK_BEFORE(a, b)  ((int32_t)((a) - (b)) < 0)
+
+/* Interrupts must be off: the caller could move to another core. */
+static sched_cpu_t *this_cpu(void) {
+    return &cpus[smp_cpu_id()];
+}
+
+static int task_current_locked(void) {
+    return this_cpu()->current;
+}
+
+static int task_on_cpu(int id) {
+    int c;
+    for (c = 0; c < SMP_MAX_CPUS; c++)
+        if (cpus[c].online && cpus[c].current == id) return 1;
+    return 0;
+}
+
+/* CPU time so far, including the running interval (sched_lock held). */
+static uint64_t task_run_ns(int id) {
+    uint64_t ns = task_list[id].run_ns;
+    int c;
+    for (c = 0; c < SMP_MAX_CPUS; c++)
+        if (cpus[c].online && cpus[c].current == id)
+            ns += plat_ticks_ns() - cpus[c].stamp_ns;
+    return ns;
+}
+
+static void sched_cpu_init(sched_cpu_t *c) {
+    int p;
+    for (p = 0; p < TASK_PRIO_LEVELS; p++) c->rq_head[p] = c->rq_tail[p] = -1;
+    c->edf_head = -1;
+    c->nr_ready = 0;
+    c->need_resched = 0;
+    c->slice_left = slice_ticks;
+    c->stamp_ns = plat_ticks_ns();
+}
 
-void add_task(void (*task_func)(void)) {
-    if (task_count < MAX_TASKS) {
-        uint8_t *stack = (uint8_t*)malloc(1024);
-        if (!stack) return;
-        task_list[task_count].func = task_func;
-        /* Stack: high addr = top. We need space for pusha (32 bytes) + ret addr (4). */
-        task_list[task_count].esp = (uint32_t)(stack + 1024 - 36);
-        uint32_t *stack_top = (uint32_t*)(stack + 1024 - 36);
-        stack_top[0] = 0; stack_top[1] = 0; stack_top[2] = 0; stack_top[3] = 0;
-        stack_top[4] = 0; stack_top[5] = 0; stack_top[6] = 0; stack_top[7] = 0;  /* pusha placeholder */
-        stack_top[8] = (uint32_t)task_func;  /* return addr = task entry */
-        task_count++;
+/* Run queues are per core: a task goes on the queue of task->cpu. */
+static void rq_push(int id) {
+    task_t *t = &task_list[id];
+    sched_cpu_t *c = &cpus[t->cpu];
+    t->next = -1;
+    if (id != c->idle) c->nr_ready++;
+    if (t->edf) {
+        int *pp = &c->edf_head;
+        while (*pp >= 0 && !TICK_BEFORE(t->deadline_tick, task_list[*pp].deadline_tick))
+            pp = &task_list[*pp].next;
+        t->next = *pp;
+        *pp = id;
+        return;
     }
+    if (c->rq_tail[t->prio] >= 0) task_list[c->rq_tail[t->prio]].next = id;
+    else c->rq_head[t->prio] = id;
+    c->rq_tail[t->prio] = id;
+}
+
+static void rq_remove(int id) {
+    task_t *t = &task_list[id];
+    sched_cpu_t *c = &cpus[t->cpu];
+    int *pp = t->edf ? &c->edf_head : &c->rq_head[t->prio];
+    int prev = -1;
+    while (*pp >= 0 && *pp != id) {
+        prev = *pp;
+        pp = &task_list[*pp].next;
+    }
+    if (*pp != id) return;
+    *pp = t->next;
+    if (!t->edf && c->rq_tail[t->prio] == id) c->rq_tail[t->prio] = prev;
+    t->next = -1;
+    if (id != c->idle) c->nr_ready--;
+}
+
+/* Best ready task on a core without dequeuing it, or -1. */
+static int rq_peek(int cpu) {
+    sched_cpu_t *c = &cpus[cpu];
+    int p;
+    if (c->edf_head >= 0) return c->edf_head;
+    for (p = 0; p < TASK_PRIO_LEVELS; p++)
+        if (c->rq_head[p] >= 0) return c->rq_head[p];
+    return -1;
+}
+
+/* Does a beat b? Deadline class first (earlier deadline wins), then
+ * lower priority number. Equal rank never preempts. */
+static int task_beats(int a, int b) {
+    task_t *ta = &task_list[a], *tb = &task_list[b];
+    if (ta->edf != tb->edf) return ta->edf;
+    if (ta->edf) return TICK_BEFORE(ta->deadline_tick, tb->deadline_tick);
+    return ta->prio < tb->prio;
+}
+
+/* Make a core reschedule at its next interrupt exit; another core gets an
+ * IPI so a halted one wakes up. */
+static void sched_kick(int cpu) {
+    cpus[cpu].need_resched = 1;
+    if (cpu != smp_cpu_id()) smp_send_resched(cpu);
+}
+
+static int cpu_is_idle(int cpu) {
+    return cpus[cpu].online && cpus[cpu].current == cpus[cpu].idle && cpus[cpu].nr_ready == 0;
+}
+
+/* Queue a ready task on its core. If it outranks what runs there, that
+ * core switches; otherwise an idle core is kicked so it can steal it. */
+static void sched_enqueue(int id) {
+    task_t *t = &task_list[id];
+    sched_cpu_t *c = &cpus[t->cpu];
+    int i;
+    rq_push(id);
+    if (c->current < 0 || task_beats(id, c->current)) {
+        sched_kick(t->cpu);
+        return;
+    }
+    if (t->pinned) return;
+    for (i = 0; i < smp_cpu_count(); i++) {
+        if (i != t->cpu && cpu_is_idle(i)) {
+            sched_kick(i);
+            return;
+        }
+    }
+}
+
+/* Least loaded online core for a new task, this one on a tie. */
+static int sched_pick_cpu(void) {
+    int me = smp_cpu_id(), best = me, i;
+    int best_load = cpus[me].nr_ready + (cpus[me].current != cpus[me].idle);
+    for (i = 0; i < smp_cpu_count(); i++) {
+        int load;
+        if (!cpus[i].online) continue;
+        load = cpus[i].nr_ready + (cpus[i].current != cpus[i].idle);
+        if (load < best_load) {
+            best = i;
+            best_load = load;
+        }
+    }
+    return best;
+}
+
+/* Busiest other core that has a task to spare: one running and at least
+ * one queued, or idle with two or more queued. -1 if none. */
+static int steal_victim(int cpu) {
+    int v, best = -1, best_load = 1;
+    for (v = 0; v < smp_cpu_count(); v++) {
+        int load;
+        if (v == cpu || !cpus[v].online || cpus[v].nr_ready == 0) continue;
+        load = cpus[v].nr_ready + (cpus[v].current != cpus[v].idle);
+        if (load > best_load) {
+            best = v;
+            best_load = load;
+        }
+    }
+    return best;
+}
+
+/* Work stealing: move the best unpinned ready task of the victim to cpu's
+ * queue (already dequeued, ready to run). -1 if nothing movable. */
+static int rq_steal(int cpu) {
+    int v = steal_victim(cpu), id = -1, p;
+    if (v < 0) return -1;
+    for (id = cpus[v].edf_head; id >= 0 && task_list[id].pinned; id = task_list[id].next)
+        ;
+    for (p = 0; id < 0 && p < TASK_PRIO_IDLE; p++)
+        for (id = cpus[v].rq_head[p]; id >= 0 && task_list[id].pinned; id = task_list[id].next)
+            ;
+    if (id < 0) return -1;
+    rq_remove(id);
+    task_list[id].cpu = (uint8_t)cpu;
+    cpus[cpu].steals++;
+    return id;
+}
+
+/* Charge the time since the last switch on this core to the running task
+ * and to the core's busy or idle total. */
+static void sched_account(sched_cpu_t *c) {
+    uint64_t now = plat_ticks_ns();
+    uint64_t d = now - c->stamp_ns;
+    task_list[c->current].run_ns += d;
+    if (c->current == c->idle) c->idle_ns += d;
+    else c->busy_ns += d;
+    c->stamp_ns = now;
+}
+
+/* Switch now if this core was asked to reschedule (task context only; from
+ * an IRQ handler the exit hook does it). */
+static void sched_maybe_preempt(void) {
+    uint32_t flags = plat_irq_save();
+    sched_cpu_t *c = this_cpu();
+    if (c->current >= 0 && c->need_resched && !irq_in_handler()) task_yield_asm();
+    plat_irq_restore(flags);
+}
+
+/* Give up the CPU with sched_lock held (taken by the caller with its state
+ * change); the switch drops it. Returns with interrupts still off, lock not
+ * held, once the task runs again. */
+static void sched_yield_locked(void) {
+    this_cpu()->lock_handoff = 1;
+    task_yield_asm();
+}
+
+static void sleep_insert(int id) {
+    int *pp = &sleep_head;
+    while (*pp >= 0 && !TICK_BEFORE(task_list[id].wake_tick, task_list[*pp].wake_tick))
+        pp = &task_list[*pp].next;
+    task_list[id].next = *pp;
+    *pp = id;
+}
+
+static void sleep_remove(int id) {
+    int *pp = &sleep_head;
+    while (*pp >= 0 && *pp != id) pp = &task_list[*pp].next;
+    if (*pp == id) *pp = task_list[id].next;
+    task_list[id].next = -1;
+}
+
+/* Every task starts here: run the entry function, then exit with its code. */
+static void task_trampoline(void) {
+    /* Copy out under sched_lock: task_table_grow may move the table. */
+    uint32_t flags = plat_lock_irqsave(&sched_lock);
+    task_t *t = &task_list[this_cpu()->current];
+    task_fn_t entry = t->entry;
+    void (*func)(void) = t->func;
+    void *arg = t->arg;
+    plat_unlock_irqrestore(&sched_lock, flags);
+    int code = 0;
+    if (entry) code = entry(arg);
+    else if (func) func();
+    task_exit(code);
+}
+
+/* Idle: with nothing to run or steal, halt until an interrupt. The BSP
+ * stretches the next PIT interrupt to the first sleeper's wake tick (at
+ * most PIT_ONESHOT_MAX_TICKS away, tickless); an AP stops its local timer
+ * and waits for a reschedule IPI. The check and the halt run with IRQs
+ * off, and cpu_idle_asm re-enables them atomically with the hlt. */
+static void sched_idle_halt(void) {
+    uint32_t flags = plat_lock_irqsave(&sched_lock);
+    sched_cpu_t *c = this_cpu();
+    int cpu = (int)(c - cpus);
+    if (c->nr_ready || c->need_resched || steal_victim(cpu) >= 0) {
+        c->need_resched = 1;
+        plat_unlock_irqrestore(&sched_lock, flags);
+        task_yield();
+        return;
+    }
+    if (cpu == 0) {
+        uint32_t n = PIT_ONESHOT_MAX_TICKS;
+        if (sleep_head >= 0) {
+            int32_t d = (int32_t)(task_list[sleep_head].wake_tick - tick_count);
+            if (d < 1) d = 1;
+            if ((uint32_t)d < n) n = (uint32_t)d;
+        }
+        if (n > 1) {
+            idle_armed = n;
+            pit_set_oneshot(n);
+        }
+    } else if (!c->tick_stopped) {
+        smp_timer_stop();
+        c->tick_stopped = 1;
+    }
+    c->halts++;
+    plat_unlock_irqrestore(&sched_lock, 0);     /* interrupts stay off */
+    cpu_idle_asm();
+    plat_irq_restore(flags);
+}
+
+/* sched_reap must not sleep here: stack_free takes spinlocks only (the
+ * budget counters included). */
+static void idle_task(void) {
+    for (;;) {
+        if (reap_pending) sched_reap();
+        sched_idle_halt();
+    }
+}
+
+/* Initial stack: canary words at the bottom and a frame isr_return can
+ * resume at the top. */
+static uint32_t task_build_frame(uint8_t *stack, uint32_t size) {
+    uint32_t *canary = (uint32_t *)stack;
+    unsigned int i;
+    for (i = 0; i < TASK_STACK_CANARY_WORDS; i++) canary[i] = TASK_STACK_CANARY;
+    uint32_t *top = (uint32_t *)(stack + size);
+    *--top = 0;                     /* trampoline never returns */
+    irq_frame_t *f = (irq_frame_t *)top - 1;
+    uint32_t *w = (uint32_t *)f;
+    for (i = 0; i < sizeof(*f) / 4; i++) w[i] = 0;
+    f->gs = f->fs = f->es = f->ds = irq_kernel_ds();
+    f->cs = irq_kernel_cs();
+    f->eip = (uint32_t)task_trampoline;
+    f->eflags = 0x202;              /* IF set */
+    return (uint32_t)f;
+}
+
+/* Intact canaries and a saved stack pointer above them. The boot thread
+ * and AP idle tasks run on boot stacks and are not checked. */
+static int task_stack_ok(int id, uint32_t esp) {
+    task_t *t = &task_list[id];
+    const uint32_t *canary = (const uint32_t *)t->stack;
+    unsigned int i;
+    if (!t->stack) return 1;
+    if (esp < (uint32_t)(t->stack + TASK_STACK_CANARY_WORDS * 4)) return 0;
+    for (i = 0; i < TASK_STACK_CANARY_WORDS; i++)
+        if (canary[i] != TASK_STACK_CANARY) return 0;
+    return 1;
+}
+
+/* Stack pool: whole pages from the buddy allocator, kept off the shared
+ * heap, with a few freed stacks of each order cached for the next
+ * task_create. Falls back to the heap before the page allocator is up. */
+#define STACK_FROM_HEAP   0xFF
+#define STACK_POOL_ORDERS 5                 /* 4 KB .. 64 KB */
+#define STACK_POOL_CACHE  2
+
+static void *stack_cache[STACK_POOL_ORDERS][STACK_POOL_CACHE];
+static int stack_cached[STACK_POOL_ORDERS];
+static plat_lock_t stack_lock = PLAT_LOCK_INIT;
+
+static uint8_t *stack_alloc(uint32_t size, uint8_t *order_out) {
+    unsigned int order = page_order_for(size);
+    void *p = (void *)0;
+    uint32_t flags;
+    if (page_alloc_ready() && order < STACK_POOL_ORDERS) {
+        uint32_t bytes = (uint32_t)PAGE_SIZE << order;
+        /* Charge first (shrinkers may run); over budget fails the create. */
+        if (memory_budget_alloc(BUDGET_KERNEL, bytes) != 1) return (uint8_t *)0;
+        flags = plat_lock_irqsave(&stack_lock);
+        if (stack_cached[order] > 0)
+            p = stack_cache[order][--stack_cached[order]];
+        plat_unlock_irqrestore(&stack_lock, flags);
+        if (!p) p = page_alloc(order);
+        if (p) {
+            *order_out = (uint8_t)order;
+            return (uint8_t *)p;
+        }
+        memory_budget_free(BUDGET_KERNEL, bytes);
+    }
+    *order_out = STACK_FROM_HEAP;
+    return (uint8_t *)budget_malloc(BUDGET_KERNEL, size);
+}
+
+static void stack_free(uint8_t *stack, uint8_t order) {
+    uint32_t flags;
+    if (!stack) return;
+    if (order == STACK_FROM_HEAP) {
+        budget_free(BUDGET_KERNEL, stack);
+        return;
+    }
+    memory_budget_free(BUDGET_KERNEL, (uint32_t)PAGE_SIZE << order);
+    flags = plat_lock_irqsave(&stack_lock);
+    if (stack_cached[order] < STACK_POOL_CACHE) {
+        stack_cache[order][stack_cached[order]++] = stack;
+        stack = (uint8_t *)0;
+    }
+    plat_unlock_irqrestore(&stack_lock, flags);
+    if (stack) page_free(stack, order);
+}
+#endif
+
+static void task_slot_init(int id, void (*task_func)(void), uint8_t prio) {
+    task_t *t = &task_list[id];
+    t->func = task_func;
+    t->entry = (task_fn_t)0;
+    t->arg = (void *)0;
+    t->stack = (uint8_t *)0;
+    t->stack_size = 0;
+    t->detached = 0;
+    t->joiner = -1;
+    t->exit_code = 0;
+    t->esp = 0;
+    t->prio = prio;
+    t->edf = 0;
+    t->wake_pending = 0;
+    t->cpu = 0;
+    t->pinned = 0;
+    t->next = -1;
+    t->period_ticks = 0;
+    t->deadline_misses = 0;
+    t->run_ns = 0;
+    t->switches = 0;
+    t->state = TASK_READY;
+}
+
+/* Double the table; the copy and pointer swap happen under sched_lock. */
+static int task_table_grow(void) {
+    int cap = task_cap * 2;
+    if (cap > TASK_MAX) return -1;
+    task_t *nt = (task_t *)malloc((size_t)cap * sizeof(task_t));
+    if (!nt) return -1;
+    uint32_t flags = plat_lock_irqsave(&sched_lock);
+    task_t *old = task_list;
+    int i;
+    if (cap <= task_cap) {          /* another task grew it meanwhile */
+        plat_unlock_irqrestore(&sched_lock, flags);
+        free(nt);
+        return 0;
+    }
+    for (i = 0; i < task_cap; i++) nt[i] = old[i];
+    for (; i < cap; i++) nt[i].state = TASK_UNUSED;
+    task_list = nt;
+    task_cap = cap;
+    plat_unlock_irqrestore(&sched_lock, flags);
+    if (old != task_table_init) free(old);
+    return 0;
+}
+
+/* Claim a free slot (marked TASK_DONE so nothing schedules it yet). */
+static int task_slot_claim(void) {
+    for (;;) {
+        uint32_t flags = plat_lock_irqsave(&sched_lock);
+        int id;
+        for (id = TASK_FIRST; id < task_count; id++)
+            if (task_list[id].state == TASK_UNUSED) break;
+        if (id == task_count && task_count < task_cap) task_count++;
+        if (id < task_count) {
+            task_list[id].state = TASK_DONE;
+            task_list[id].detached = 0;
+            task_list[id].joiner = -1;
+            plat_unlock_irqrestore(&sched_lock, flags);
+            return id;
+        }
+        plat_unlock_irqrestore(&sched_lock, flags);
+        if (task_table_grow() != 0) return -1;
+    }
+}
+
+static task_id_t task_spawn(void (*func)(void), task_fn_t fn, void *arg,
+                            uint32_t stack_size, int priority) {
+    if (priority < 0 || priority >= TASK_PRIO_IDLE) return -1;
+    if (stack_size == 0) stack_size = TASK_STACK_SIZE;
+    if (stack_size < TASK_STACK_MIN) stack_size = TASK_STACK_MIN;
+    if (stack_size > TASK_STACK_MAX) return -1;
+    if (reap_pending) sched_reap();
+    int id = task_slot_claim();
+    if (id < 0) return -1;
+#ifndef PLATFORM_PS2
+    uint8_t order;
+    uint8_t *stack = stack_alloc(stack_size, &order);
+    if (!stack) {
+        task_list[id].state = TASK_UNUSED;
+        return -1;
+    }
+#endif
+    uint32_t flags = plat_lock_irqsave(&sched_lock);
+    task_slot_init(id, func, (uint8_t)priority);
+    task_list[id].entry = fn;
+    task_list[id].arg = arg;
+#ifndef PLATFORM_PS2
+    task_list[id].stack = stack;
+    task_list[id].stack_size = stack_size;
+    task_list[id].stack_order = order;
+    task_list[id].esp = task_build_frame(stack, stack_size);
+    task_list[id].cpu = (uint8_t)sched_pick_cpu();
+    sched_enqueue(id);
+#endif
+    plat_unlock_irqrestore(&sched_lock, flags);
+#ifndef PLATFORM_PS2
+    sched_maybe_preempt();
+#endif
+    return id;
+}
+
+task_id_t task_create(task_fn_t fn, void *arg, uint32_t stack_size, int priority) {
+    if (!fn) return -1;
+    return task_spawn((void (*)(void))0, fn, arg, stack_size, priority);
+}
+
+/* Detached from the start: nobody joins an add_task task. */
+task_id_t add_task(void (*task_func)(void)) {
+    if (!task_func) return -1;
+    int id = task_spawn(task_func, (task_fn_t)0, (void *)0, TASK_STACK_SIZE, TASK_PRIO_NORMAL);
+    if (id >= 0) task_detach(id);
+    return id;
+}
+
+/* Free a finished task's slot, then its stack (sched_lock held on entry,
+ * dropped here). */
+static void task_release_locked(int id, uint32_t flags) {
+    task_t *t = &task_list[id];
+#ifndef PLATFORM_PS2
+    uint8_t *stack = t->stack;
+    uint8_t order = t->stack_order;
+    t->stack = (uint8_t *)0;
+#endif
+    t->state = TASK_UNUSED;
+    plat_unlock_irqrestore(&sched_lock, flags);
+#ifndef PLATFORM_PS2
+    stack_free(stack, order);
+#endif
+}
+
+/* Release detached tasks that have exited. Task context only; a task is
+ * skipped while some core is still switching away from its stack. */
+static void sched_reap(void) {
+    int id;
+    reap_pending = 0;
+    for (id = TASK_FIRST; id < task_count; id++) {
+        uint32_t flags = plat_lock_irqsave(&sched_lock);
+        task_t *t = &task_list[id];
+        if (t->state != TASK_DONE || !t->detached) {
+            plat_unlock_irqrestore(&sched_lock, flags);
+            continue;
+        }
+        if (task_on_cpu(id)) {
+            reap_pending = 1;
+            plat_unlock_irqrestore(&sched_lock, flags);
+            continue;
+        }
+        task_release_locked(id, flags);
+    }
+}
+
+int task_detach(task_id_t id) {
+    if (!task_valid(id) || id < TASK_FIRST) return -1;
+    uint32_t flags = plat_lock_irqsave(&sched_lock);
+    task_t *t = &task_list[id];
+    int ok = (t->joiner < 0);
+    if (ok) {
+        t->detached = 1;
+        if (t->state == TASK_DONE) reap_pending = 1;
+    }
+    plat_unlock_irqrestore(&sched_lock, flags);
+    return ok ? 0 : -1;
+}
+
+/* Wait for a task to exit and free it. One joiner per task. */
+int task_join(task_id_t id, int *exit_code) {
+    int self = task_current();
+    if (!task_valid(id) || id < TASK_FIRST || id == self) return -1;
+    uint32_t flags = plat_lock_irqsave(&sched_lock);
+    task_t *t = &task_list[id];
+    if (t->detached || t->joiner >= 0) {
+        plat_unlock_irqrestore(&sched_lock, flags);
+        return -1;
+    }
+    t->joiner = self;
+    while (t->state != TASK_DONE) {
+#ifdef PLATFORM_PS2
+        plat_unlock_irqrestore(&sched_lock, flags);
+        task_yield();
+        flags = plat_lock_irqsave(&sched_lock);
+#else
+        task_list[self].state = TASK_BLOCKED;
+        sched_yield_locked();
+        plat_lock_irqsave(&sched_lock);     /* interrupts already off */
+#endif
+        t = &task_list[id];         /* the table may have moved */
+    }
+    if (exit_code) *exit_code = t->exit_code;
+    task_release_locked(id, flags);
+    return 0;
 }
 
 task_id_t task_current(void) {
-    return (task_id_t)current_task;
+    uint32_t flags = plat_irq_save();
+    int id = task_current_locked();
+    plat_irq_restore(flags);
+    return (task_id_t)id;
+}
+
+void sched_set_timeslice_ms(uint32_t ms) {
+    if (ms == 0) ms = SCHED_TIMESLICE_MS;
+    slice_ms = ms;
+#ifndef PLATFORM_PS2
+    slice_ticks = ms_to_ticks(ms);
+#endif
+}
+
+uint32_t sched_get_timeslice_ms(void) {
+    return slice_ms;
+}
+
+int task_get_info(task_id_t id, task_info_t *out) {
+    if (!out) return -1;
+    uint32_t flags = plat_lock_irqsave(&sched_lock);
+    if (!task_valid(id)) {
+        plat_unlock_irqrestore(&sched_lock, flags);
+        return -1;
+    }
+    task_t *t = &task_list[id];
+    out->state = t->state;
+    out->stack_size = t->stack_size;
+    out->exit_code = t->exit_code;
+    out->prio = t->prio;
+    out->edf = t->edf;
+    out->cpu = t->cpu;
+    out->pinned = t->pinned;
+    out->period_ms = t->period_ticks * SCHED_TICK_MS;
+    out->deadline_misses = t->deadline_misses;
+    out->switches = t->switches;
+    out->run_time = (uint32_t)(task_run_ns(id) >> 10);
+    plat_unlock_irqrestore(&sched_lock, flags);
+    return 0;
+}
+
+int sched_task_slots(void) {
+    return task_count;
 }
 
 #ifdef PLATFORM_PS2
-/* MIPS EE: cooperative round-robin without x86 context switch. */
+/* MIPS EE: cooperative round-robin without x86 context switch. Each
+ * yield calls the next live task's entry as one step of its work. */
+static void task_step(int id) {
+    task_t *t = &task_list[id];
+    if (t->state != TASK_READY) return;
+    uint64_t start = plat_ticks_ns();
+    t->switches++;
+    if (t->entry) t->entry(t->arg);
+    else if (t->func) t->func();
+    task_list[id].run_ns += plat_ticks_ns() - start;    /* table may have grown */
+}
+
 void task_yield(void) {
     if (task_count <= 0) return;
+    if (reap_pending) sched_reap();
     if (current_task < 0) current_task = 0;
     current_task = (current_task + 1) % task_count;
-    if (task_list[current_task].func)
-        task_list[current_task].func();
+    task_step(current_task);
 }
 
 void run_scheduler(void) {
-    if (task_count > 0 && task_list[0].func)
-        task_list[0].func();
+    if (task_count > 0) task_step(0);
+}
+
+/* Stops the task being stepped; the step itself still returns normally. */
+void task_exit(int code) {
+    if (current_task < 0 || !task_valid(current_task)) return;
+    task_t *t = &task_list[current_task];
+    t->exit_code = code;
+    t->state = TASK_DONE;
+    if (t->detached) reap_pending = 1;
+}
+
+uint32_t sched_ticks(void) {
+    return plat_ticks_ms() / SCHED_TICK_MS;
+}
+
+int sched_preemptive(void) {
+    return 0;
+}
+
+void sched_get_idle_stats(uint32_t *halts, uint32_t *ticks_skipped) {
+    if (halts) *halts = 0;
+    if (ticks_skipped) *ticks_skipped = 0;
+}
+
+/* Tasks are plain calls here: sleeping is a delay, blocking a yield. */
+void task_sleep_ms(uint32_t ms) {
+    plat_delay_ms(ms);
+}
+
+void task_block(void) {
+    if (current_task >= 0 && task_list[current_task].wake_pending) {
+        task_list[current_task].wake_pending = 0;
+        return;
+    }
+    task_yield();
+}
+
+void task_block_timeout(uint32_t ms) {
+    if (current_task >= 0 && task_list[current_task].wake_pending) {
+        task_list[current_task].wake_pending = 0;
+        return;
+    }
+    plat_delay_ms(ms);
+}
+
+void task_wake(task_id_t id) {
+    if (task_valid(id)) task_list[id].wake_pending = 1;
+}
+
+int task_set_priority(task_id_t id, int prio) {
+    if (!task_valid(id) || prio < 0 || prio >= TASK_PRIO_LEVELS) return -1;
+    task_list[id].prio = (uint8_t)prio;
+    return 0;
+}
+
+int task_set_deadline(task_id_t id, uint32_t period_ms) {
+    if (!task_valid(id)) return -1;
+    task_list[id].edf = period_ms ? 1 : 0;
+    task_list[id].period_ticks = period_ms ? ms_to_ticks(period_ms) : 0;
+    return 0;
+}
+
+void task_wait_period(void) {
+    if (current_task >= 0 && task_list[current_task].edf)
+        plat_delay_ms(task_list[current_task].period_ticks * SCHED_TICK_MS);
+}
+
+/* One core: pinning only checks its arguments. */
+int task_set_cpu(task_id_t id, int cpu) {
+    if (!task_valid(id) || cpu < -1 || cpu > 0) return -1;
+    task_list[id].pinned = (cpu == 0);
+    return 0;
+}
+
+int sched_cpu_count(void) {
+    return 1;
+}
+
+int sched_get_cpu_info(int cpu, sched_cpu_info_t *out) {
+    if (!out || cpu != 0) return -1;
+    uint64_t busy = 0, now = plat_ticks_ns();
+    int id;
+    for (id = 0; id < task_count; id++) busy += task_list[id].run_ns;
+    out->current = current_task;
+    out->ready = task_count;
+    out->switches = out->steals = out->halts = 0;
+    out->busy_time = (uint32_t)(busy >> 10);        /* time inside task steps */
+    out->idle_time = (uint32_t)((now > busy ? now - busy : 0) >> 10);
+    return 0;
+}
+
+void sched_start_ap(int cpu) {
+    (void)cpu;
+}
+
+void init_scheduler(void) {
+    kprintf("Scheduler: %d tasks registered\n", task_count);
 }
 #else
-/* Save current esp, switch to next task's esp, popa, ret. Cooperative multitasking. */
+static void task_mark_done(int id, int code);
+
+/* Put the current task back in line (if still runnable) and resume the best
+ * ready one, stealing from a busier core when this one has nothing but its
+ * idle task. Runs from the IRQ exit hook with sched_lock held. */
+static irq_frame_t *sched_switch(sched_cpu_t *c, irq_frame_t *f) {
+    int cpu = (int)(c - cpus);
+    int cur = c->current;
+    task_t *ct = &task_list[cur];
+    int next;
+    c->need_resched = 0;
+    c->slice_left = slice_ticks;
+    if (ct->state != TASK_DONE && !task_stack_ok(cur, (uint32_t)f)) {
+        kprintf("\nsched: task %d overflowed its %d byte stack, stopped\n",
+                cur, (int)ct->stack_size);
+        if (ct->state == TASK_SLEEPING) sleep_remove(cur);
+        task_mark_done(cur, TASK_EXIT_OVERFLOW);
+    }
+    if (ct->state == TASK_RUNNING) {
+        ct->state = TASK_READY;
+        if (ct->cpu != cpu) sched_enqueue(cur);     /* re-pinned elsewhere */
+        else rq_push(cur);
+    }
+    next = rq_peek(cpu);            /* idle keeps this non-empty */
+    if (next < 0 || next == c->idle) {
+        int s = rq_steal(cpu);
+        if (s >= 0) next = s;
+        else if (next >= 0) rq_remove(next);
+    } else {
+        rq_remove(next);
+    }
+    if (next < 0) return f;
+    task_list[next].state = TASK_RUNNING;
+    if (next == cur) return f;
+    sched_account(c);
+    ct->esp = (uint32_t)f;
+    c->current = next;
+    c->switches++;
+    task_list[next].switches++;
+    if (c->tick_stopped && next != c->idle) {
+        smp_timer_start();
+        c->tick_stopped = 0;
+    }
+    return (irq_frame_t *)task_list[next].esp;
+}
+
+/* Finish a task and hand its exit code to the joiner (sched_lock held). */
+static void task_mark_done(int id, int code) {
+    task_t *t = &task_list[id];
+    t->exit_code = code;
+    t->state = TASK_DONE;
+    if (t->detached) reap_pending = 1;
+    if (t->joiner >= 0 && task_list[t->joiner].state == TASK_BLOCKED) {
+        task_list[t->joiner].state = TASK_READY;
+        sched_enqueue(t->joiner);
+    }
+}
+
+static void sched_wake_sleepers(void) {
+    while (sleep_head >= 0 && !TICK_BEFORE(tick_count, task_list[sleep_head].wake_tick)) {
+        int id = sleep_head;
+        sleep_head = task_list[id].next;
+        task_list[id].state = TASK_READY;
+        sched_enqueue(id);
+    }
+}
+
+/* Leave tickless mode: credit the periods the one-shot covered (all of them
+ * if it fired, else the whole ones elapsed; the partial period is dropped)
+ * and restart the periodic tick. */
+static void sched_tickless_stop(int fired) {
+    uint32_t n = fired ? idle_armed : pit_oneshot_elapsed(idle_armed);
+    pit_set_periodic();
+    idle_armed = 0;
+    if (n > 1) idle_ticks_skipped += n - 1;
+    tick_count += n;
+}
+
+/* Every interrupt and yield ends here. A switch keeps sched_lock until
+ * sched_switched runs on the new stack, so no other core can resume the
+ * old task while this one still uses its stack. */
+static irq_frame_t *sched_irq_exit(irq_frame_t *f) {
+    sched_cpu_t *c = this_cpu();
+    irq_frame_t *nf = f;
+    uint32_t flags;
+    int best;
+    if (c->current < 0) return f;
+    if (c->lock_handoff) {
+        c->lock_handoff = 0;
+        flags = 0;
+    } else {
+        flags = plat_lock_irqsave(&sched_lock);
+    }
+    if (c == &cpus[0] && idle_armed) {     /* another IRQ ended the idle halt */
+        sched_tickless_stop(0);
+        sched_wake_sleepers();
+    }
+    best = rq_peek((int)(c - cpus));
+    if (c->need_resched || task_list[c->current].state != TASK_RUNNING ||
+        (best >= 0 && task_beats(best, c->current)))
+        nf = sched_switch(c, f);
+    if (nf != f) c->unlock_on_switch = 1;
+    else plat_unlock_irqrestore(&sched_lock, flags);
+    return nf;
+}
+
+static void sched_switched(void) {
+    sched_cpu_t *c = this_cpu();
+    if (!c->unlock_on_switch) return;
+    c->unlock_on_switch = 0;
+    plat_unlock_irqrestore(&sched_lock, 0);
+}
+
+static void sched_slice_tick(sched_cpu_t *c) {
+    if (c->slice_left > 1) c->slice_left--;
+    else c->need_resched = 1;
+}
+
+/* PIT (BSP): the global tick and sleeper wakeups. */
+static irq_frame_t *sched_timer_irq(irq_frame_t *f) {
+    uint32_t flags = plat_lock_irqsave(&sched_lock);
+    if (idle_armed) sched_tickless_stop(1);
+    else tick_count++;
+    sched_wake_sleepers();
+    plat_unlock_irqrestore(&sched_lock, flags);
+    sched_slice_tick(this_cpu());
+    return f;
+}
+
+/* Local APIC timer (APs): time slices only. */
+static irq_frame_t *sched_ap_timer_irq(irq_frame_t *f) {
+    sched_slice_tick(this_cpu());
+    return f;
+}
+
+static irq_frame_t *sched_yield_irq(irq_frame_t *f) {
+    this_cpu()->need_resched = 1;
+    return f;
+}
+
+/* Never returns; the stack is freed by task_join or, for detached tasks,
+ * by the next reap once the switch away from it has happened. */
+void task_exit(int code) {
+    uint32_t flags = plat_lock_irqsave(&sched_lock);
+    sched_cpu_t *c = this_cpu();
+    if (c->current < TASK_FIRST || c->current == c->idle) {    /* boot thread and idle stay */
+        plat_unlock_irqrestore(&sched_lock, flags);
+        return;
+    }
+    task_mark_done(c->current, code);
+    sched_yield_locked();
+    for (;;) task_yield_asm();
+}
+
+/* Trap into the scheduler; the caller resumes here when picked again. */
 void task_yield(void) {
-    if (task_count <= 0) return;
-    if (current_task < 0) current_task = 0;
-    int next = (current_task + 1) % task_count;
-    uint32_t *save_to = &task_list[current_task].esp;
-    uint32_t load_esp = task_list[next].esp;
-    current_task = next;
-    task_yield_asm(save_to, load_esp);
+    if (task_current() < 0 || task_count <= 1) return;
+    task_yield_asm();
 }
 
+/* The boot thread gives up its own work and only yields from here on. */
 void run_scheduler(void) {
-    if (task_count <= 0) return;
-    current_task = 0;
-    run_scheduler_asm(task_list[0].esp);
+    if (task_count <= TASK_FIRST) return;
     while (1) task_yield();
 }
-#endif
 
+uint32_t sched_ticks(void) {
+    return tick_count;
+}
+
+int sched_preemptive(void) {
+    return task_current() >= 0;
+}
+
+void sched_get_idle_stats(uint32_t *halts, uint32_t *ticks_skipped) {
+    uint32_t n = 0;
+    int c;
+    for (c = 0; c < SMP_MAX_CPUS; c++) n += cpus[c].halts;
+    if (halts) *halts = n;
+    if (ticks_skipped) *ticks_skipped = idle_ticks_skipped;
+}
+
+static void task_sleep_until(uint32_t ticks, int wakeable) {
+    uint32_t flags = plat_lock_irqsave(&sched_lock);
+    int cur = task_current_locked();
+    task_t *t = &task_list[cur];
+    if (wakeable && t->wake_pending) {
+        t->wake_pending = 0;
+        plat_unlock_irqrestore(&sched_lock, flags);
+        return;
+    }
+    t->state = TASK_SLEEPING;
+    t->wake_tick = tick_count + ticks;
+    sleep_insert(cur);
+    sched_yield_locked();
+    plat_irq_restore(flags);
+}
+
+void task_sleep_ms(uint32_t ms) {
+    if (task_current() < 0) {
+        plat_delay_ms(ms);
+        return;
+    }
+    task_sleep_until(ms_to_ticks(ms), 0);
+}
+
+void task_block_timeout(uint32_t ms) {
+    if (task_current() < 0) {
+        plat_delay_ms(ms);
+        return;
+    }
+    task_sleep_until(ms_to_ticks(ms), 1);
+}
+
+void task_block(void) {
+    uint32_t flags = plat_lock_irqsave(&sched_lock);
+    int cur = task_current_locked();
+    if (cur < 0) {
+        plat_unlock_irqrestore(&sched_lock, flags);
+        return;
+    }
+    task_t *t = &task_list[cur];
+    if (t->wake_pending) {
+        t->wake_pending = 0;
+        plat_unlock_irqrestore(&sched_lock, flags);
+        return;
+    }
+    t->state = TASK_BLOCKED;
+    sched_yield_locked();
+    plat_irq_restore(flags);
+}
+
+void task_wake(task_id_t id) {
+    if (!task_valid(id)) return;
+    uint32_t flags = plat_lock_irqsave(&sched_lock);
+    task_t *t = &task_list[id];
+    if (t->state == TASK_BLOCKED || t->state == TASK_SLEEPING) {
+        if (t->state == TASK_SLEEPING) sleep_remove(id);
+        t->state = TASK_READY;
+        sched_enqueue(id);
+    } else if (t->state != TASK_DONE) {
+        t->wake_pending = 1;
+    }
+    plat_unlock_irqrestore(&sched_lock, flags);
+    sched_maybe_preempt();
+}
+
+/* A running task on another core is re-ranked at its next switch; kick
+ * that core so it does not wait for the end of the slice. */
+static void task_requeue(int id) {
+    task_t *t = &task_list[id];
+    if (t->state == TASK_READY) {
+        rq_remove(id);
+        sched_enqueue(id);
+    } else if (t->state == TASK_RUNNING) {
+        sched_kick(t->cpu);
+    }
+}
+
+int task_set_priority(task_id_t id, int prio) {
+    if (!task_valid(id) || prio < 0 || prio >= TASK_PRIO_LEVELS - 1) return -1;
+    uint32_t flags = plat_lock_irqsave(&sched_lock);
+    task_t *t = &task_list[id];
+    int queued = (t->state == TASK_READY);
+    if (queued) rq_remove(id);
+    t->prio = (uint8_t)prio;
+    if (queued) sched_enqueue(id);
+    else if (t->state == TASK_RUNNING) sched_kick(t->cpu);
+    plat_unlock_irqrestore(&sched_lock, flags);
+    sched_maybe_preempt();
+    return 0;
+}
+
+int task_set_deadline(task_id_t id, uint32_t period_ms) {
+    if (!task_valid(id) || id == TASK_IDLE) return -1;
+    uint32_t flags = plat_lock_irqsave(&sched_lock);
+    task_t *t = &task_list[id];
+    int queued = (t->state == TASK_READY);
+    if (id == cpus[t->cpu].idle) {
+        plat_unlock_irqrestore(&sched_lock, flags);
+        return -1;
+    }
+    if (queued) rq_remove(id);
+    t->edf = period_ms ? 1 : 0;
+    t->period_ticks = period_ms ? ms_to_ticks(period_ms) : 0;
+    t->release_tick = tick_count;
+    t->deadline_tick = tick_count + t->period_ticks;
+    if (queued) sched_enqueue(id);
+    else if (t->state == TASK_RUNNING) sched_kick(t->cpu);
+    plat_unlock_irqrestore(&sched_lock, flags);
+    sched_maybe_preempt();
+    return 0;
+}
+
+/* End of this period's work: sleep until the next release, whose deadline
+ * is one period later. An overrun counts a miss and releases right away. */
+void task_wait_period(void) {
+    uint32_t flags = plat_lock_irqsave(&sched_lock);
+    int cur = task_current_locked();
+    if (cur < 0 || !task_list[cur].edf) {
+        plat_unlock_irqrestore(&sched_lock, flags);
+        task_yield();
+        return;
+    }
+    task_t *t = &task_list[cur];
+    uint32_t now = tick_count;
+    if (TICK_BEFORE(t->deadline_tick, now)) t->deadline_misses++;
+    t->release_tick += t->period_ticks;
+    if (TICK_BEFORE(t->release_tick, now)) t->release_tick = now;
+    t->deadline_tick = t->release_tick + t->period_ticks;
+    if (TICK_BEFORE(now, t->release_tick)) {
+        t->state = TASK_SLEEPING;
+        t->wake_tick = t->release_tick;
+        sleep_insert(cur);
+    }
+    sched_yield_locked();
+    plat_irq_restore(flags);
+}
+
+int task_set_cpu(task_id_t id, int cpu) {
+    if (!task_valid(id) || cpu < -1 || cpu >= smp_cpu_count()) return -1;
+    uint32_t flags = plat_lock_irqsave(&sched_lock);
+    task_t *t = &task_list[id];
+    if (id == cpus[t->cpu].idle || (id == 0 && cpu != 0)) {    /* task 0: BSP only */
+        plat_unlock_irqrestore(&sched_lock, flags);
+        return -1;
+    }
+    t->pinned = (cpu >= 0);
+    if (cpu >= 0 && t->cpu != cpu) {
+        int old = t->cpu;
+        int queued = (t->state == TASK_READY);
+        if (queued) rq_remove(id);
+        t->cpu = (uint8_t)cpu;      /* a running task moves at its next switch */
+        if (queued) sched_enqueue(id);
+        else if (t->state == TASK_RUNNING) sched_kick(old);
+    }
+    plat_unlock_irqrestore(&sched_lock, flags);
+    sched_maybe_preempt();
+    return 0;
+}
+
+int sched_cpu_count(void) {
+    return smp_cpu_count();
+}
+
+int sched_get_cpu_info(int cpu, sched_cpu_info_t *out) {
+    if (!out || cpu < 0 || cpu >= SMP_MAX_CPUS || !cpus[cpu].online) return -1;
+    uint32_t flags = plat_lock_irqsave(&sched_lock);
+    sched_cpu_t *c = &cpus[cpu];
+    uint64_t busy = c->busy_ns, idle = c->idle_ns;
+    uint64_t run = plat_ticks_ns() - c->stamp_ns;
+    if (c->current == c->idle) idle += run;
+    else busy += run;
+    out->current = c->current;
+    out->ready = c->nr_ready;
+    out->switches = c->switches;
+    out->steals = c->steals;
+    out->halts = c->halts;
+    out->busy_time = (uint32_t)(busy >> 10);
+    out->idle_time = (uint32_t)(idle >> 10);
+    plat_unlock_irqrestore(&sched_lock, flags);
+    return 0;
+}
+
+/* An AP adopts its boot context as its idle task and starts scheduling;
+ * the local APIC timer runs only while it has something to do. */
+void sched_start_ap(int cpu) {
+    sched_cpu_t *c = &cpus[cpu];
+    int id = task_slot_claim();
+    if (id < 0) {
+        kprintf("sched: no task slot for CPU %d\n", cpu);
+        for (;;) cpu_idle_asm();
+    }
+    uint32_t flags = plat_lock_irqsave(&sched_lock);
+    task_slot_init(id, idle_task, TASK_PRIO_IDLE);
+    task_list[id].state = TASK_RUNNING;
+    task_list[id].cpu = (uint8_t)cpu;
+    task_list[id].pinned = 1;
+    task_list[id].detached = 1;
+    sched_cpu_init(c);
+    c->idle = c->current = id;
+    c->tick_stopped = 1;
+    c->online = 1;
+    plat_unlock_irqrestore(&sched_lock, flags);
+    enable_interrupts_asm();
+    idle_task();
+}
+
+/* Adopt the running (boot) context as task 0, start the idle task and hook
+ * the PIT; switching starts once interrupts are enabled. Task 0 stays on
+ * the BSP: the shell calls into the BIOS and the PIC/PIT live there. */
 void init_scheduler(void) {
-    kprintf("Scheduler: %d tasks registered\n", task_count);
+    sched_cpu_t *c = &cpus[0];
+    sched_cpu_init(c);
+    task_slot_init(0, (void (*)(void))0, TASK_PRIO_NORMAL);
+    task_list[0].state = TASK_RUNNING;
+    task_list[0].pinned = 1;
+    task_slot_init(TASK_IDLE, idle_task, TASK_PRIO_IDLE);
+    task_list[TASK_IDLE].pinned = 1;
+    task_list[TASK_IDLE].stack = idle_stack;
+    task_list[TASK_IDLE].stack_size = sizeof(idle_stack);
+    task_list[TASK_IDLE].esp = task_build_frame(idle_stack, sizeof(idle_stack));
+    c->idle = TASK_IDLE;
+    c->online = 1;
+    rq_push(TASK_IDLE);
+    c->current = 0;
+    irq_set_vector(IRQ_YIELD_VECTOR, sched_yield_irq);
+    irq_set_vector(IRQ_LAPIC_TIMER_VECTOR, sched_ap_timer_irq);
+    irq_set_exit_hook(sched_irq_exit);
+    irq_set_switch_hook(sched_switched);
+    irq_register(IRQ_TIMER, sched_timer_irq);
+    kprintf("Scheduler: %d tasks registered, %d ms slice\n", task_count, (int)slice_ms);
+}
+#endif
+
+/* Sleeping locks. The guard only covers the owner/waiter words; waiters
+ * block and retry, so a wake that races the block is never lost. */
+void task_mutex_lock(task_mutex_t *m) {
+    int cur = task_current();
+    if (cur < 0) return;
+    for (;;) {
+        uint32_t flags = plat_lock_irqsave(&m->guard);
+        int got = (m->owner < 0 || m->owner == cur);
+        if (got) {
+            m->owner = cur;
+            m->depth++;
+        } else {
+            m->waiters |= (uint64_t)1 << cur;
+        }
+        plat_unlock_irqrestore(&m->guard, flags);
+        if (got) return;
+        task_block();
+    }
+}
+
+int task_mutex_trylock(task_mutex_t *m) {
+    int cur = task_current(), got;
+    if (cur < 0) return 0;
+    uint32_t flags = plat_lock_irqsave(&m->guard);
+    got = (m->owner < 0 || m->owner == cur);
+    if (got) {
+        m->owner = cur;
+        m->depth++;
+    }
+    plat_unlock_irqrestore(&m->guard, flags);
+    return got ? 0 : -1;
+}
+
+void task_mutex_unlock(task_mutex_t *m) {
+    int cur = task_current(), id;
+    uint64_t w = 0;
+    if (cur < 0) return;
+    uint32_t flags = plat_lock_irqsave(&m->guard);
+    if (m->owner == cur && --m->depth == 0) {
+        m->owner = -1;
+        w = m->waiters;
+        m->waiters = 0;
+    }
+    plat_unlock_irqrestore(&m->guard, flags);
+    for (id = 0; w; id++, w >>= 1)
+        if (w & 1) task_wake(id);
 }
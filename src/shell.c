@@ -27,6 +27,13 @@
 #include "net_clients.h"
 #include "subsys.h"
 #include "quantum.h"
+#include "memory_manager.h"
+#include "lz.h"
+#include "memory_budget.h"
+#include "scheduler.h"
+#include "ktimer.h"
+#include "keyboard.h"
+#include "bcache.h"
 #ifdef PLATFORM_PS2
 #include "syscalls.h"
 #endif
@@ -58,6 +65,7 @@ static void cmd_exit(char *args);
 static void cmd_ps2info(char *args);
 static void cmd_cd(char *args);
 static void cmd_cat(char *args);
+static void cmd_sync(char *args);
 static void cmd_clear(char *args);
 static void cmd_date(char *args);
 static void cmd_echo(char *args);
@@ -90,6 +98,10 @@ static void cmd_ctrlprofile(char *args);
 /* Johnny: Kernel & Hardware CLI */
 static void cmd_sysinfo(char *args);
 static void cmd_memstat(char *args);
+static void cmd_heapstat(char *args);
+static void cmd_sched(char *args);
+static void cmd_cpus(char *args);
+static void cmd_top(char *args);
 static void cmd_ports(char *args);
 static void cmd_iopstat(char *args);
 static void cmd_temp(char *args);
@@ -104,6 +116,7 @@ static shell_command_t commands[] = {
     {"ls", cmd_ls, "List files in current directory"},
     {"cd", cmd_cd, "Change directory"},
     {"cat", cmd_cat, "Display file contents"},
+    {"sync", cmd_sync, "Write cached sectors to disk, cache counters"},
     {"meminfo", cmd_meminfo, "Show memory information"},
     {"ps2info", cmd_ps2info, "Show PS2 hardware information"},
     {"clear", cmd_clear, "Clear screen"},
@@ -132,6 +145,10 @@ static shell_command_t commands[] = {
     {"system", cmd_system, "System control"},
     {"sysinfo", cmd_sysinfo, "Full system status (EE, RAM, IOP, ports, net, temp)"},
     {"memstat", cmd_memstat, "Memory usage"},
+    {"heapstat", cmd_heapstat, "Heap counters, fragmentation, size histogram"},
+    {"sched", cmd_sched, "Scheduler state, time slice (sched slice <ms>)"},
+    {"cpus", cmd_cpus, "Per-core utilisation, run queues, steals"},
+    {"top", cmd_top, "Live CPU use per task and subsystem (top [ms])"},
     {"ports", cmd_ports, "Controller/USB port status"},
     {"iopstat", cmd_iopstat, "IOP status"},
     {"temp", cmd_temp, "Temperature status"},
@@ -195,7 +212,10 @@ void start_shell(void) {
     char args[448];
     
     while (1) {
-        subsys_tick_all();
+        if (!sched_preemptive()) {
+            subsys_tick_all();
+            ktimer_run();
+        }
         print_prompt();
         sys_read_line(input, sizeof(input));
         
@@ -244,6 +264,7 @@ static void cmd_help(char *args) {
     kprintf("%-10s  %s\n", "ls", "list directory");
     kprintf("     %-10s  %s\n", "cd", "change directory");
     kprintf("     %-10s  %s\n", "cat", "show file");
+    kprintf("     %-10s  %s\n", "sync", "flush sector cache, hit/miss counts");
     kprint("  ");
     kprint_color("system", C_MAGENTA);
     kprint("   ");
@@ -251,6 +272,10 @@ static void cmd_help(char *args) {
     kprintf("     %-10s  %s\n", "ps2info", "hardware info");
     kprintf("     %-10s  %s\n", "sysinfo", "full system status");
     kprintf("     %-10s  %s\n", "memstat", "memory usage");
+    kprintf("     %-10s  %s\n", "heapstat", "heap counters (heapstat sites [ms])");
+    kprintf("     %-10s  %s\n", "sched", "scheduler (sched slice <ms>)");
+    kprintf("     %-10s  %s\n", "cpus", "per-core utilisation");
+    kprintf("     %-10s  %s\n", "top", "live task/subsystem CPU (top [ms])");
     kprintf("     %-10s  %s\n", "ports", "controller/USB ports");
     kprintf("     %-10s  %s\n", "iopstat", "IOP status");
     kprintf("     %-10s  %s\n", "temp", "temperature");
@@ -264,7 +289,7 @@ static void cmd_help(char *args) {
     kprint("  ");
     kprint_color("net", C_BLUE);
     kprint("       ");
-    kprintf("%-10s  %s\n", "network", "network status");
+    kprintf("%-10s  %s\n", "network", "network status (network stats)");
     kprintf("     %-10s  %s\n", "ping", "ping host");
     kprintf("     %-10s  %s\n", "ftp", "FTP client");
     kprintf("     %-10s  %s\n", "telnet", "telnet");
@@ -282,7 +307,7 @@ static void cmd_help(char *args) {
     kprintf("%-10s  %s\n", "game", "launch game");
     kprintf("     %-10s  %s\n", "controller", "controller");
     kprintf("     %-10s  %s\n", "timer", "timers");
-    kprintf("     %-10s  %s\n", "benchmark", "benchmarks");
+    kprintf("     %-10s  %s\n", "benchmark", "benchmarks (benchmark heap|lz|disk [file])");
     kprintf("     %-10s  %s\n", "system", "system status");
     kprint("  ");
     kprint_color("----------------------------------------\n", C_DIM);
@@ -330,6 +355,22 @@ static void cmd_cat(char *args) {
     kprint_color("(read not impl)\n", C_DIM);
 }
 
+static void cmd_sync(char *args) {
+    (void)args;
+    int rc = plat_fs_sync();
+    bcache_stats_t bs;
+    bcache_get_stats(&bs);
+    uint32_t lookups = bs.hits + bs.misses;
+    kprint("  ");
+    kprint_color("sync", C_CYAN);
+    kprint(rc == 0 ? " ok\n" : " write-back failed\n");
+    kprintf("    cache    %d/%d sectors  %d dirty\n", (int)bs.cached, BCACHE_ENTRIES, (int)bs.dirty);
+    kprintf("    hits     %d  misses %d  (%d%% hit)\n", (int)bs.hits, (int)bs.misses,
+            !lookups ? 0 : lookups > 0xFFFFFF ? (int)(bs.hits / (lookups / 100))
+                                               : (int)(bs.hits * 100 / lookups));
+    kprintf("    written  %d sectors back  %d evictions\n", (int)bs.writebacks, (int)bs.evictions);
+}
+
 static void cmd_clear(char *args) {
     clear_screen();
 }
@@ -387,8 +428,36 @@ static void cmd_ps2info(char *args) {
     kprint("\n");
 }
 
+/* network stats: driver counters and rates since the previous call. */
+static void cmd_network_stats(void) {
+    static plat_net_stats_t last;
+    static uint32_t last_ms;
+    plat_net_stats_t ns;
+    plat_net_get_stats(&ns);
+    uint32_t now = plat_ticks_ms();
+    uint32_t ms = now - last_ms;
+    kprint("\n  ");
+    kprint_color(" network stats ", C_BLUE);
+    kprint_color(" -------------------------------\n", C_DIM);
+    kprintf("    rx       %d packets  %d/s\n", (int)ns.rx_packets,
+            ms ? (int)((ns.rx_packets - last.rx_packets) * 1000u / ms) : 0);
+    kprintf("    tx       %d packets  %d/s\n", (int)ns.tx_packets,
+            ms ? (int)((ns.tx_packets - last.tx_packets) * 1000u / ms) : 0);
+    kprintf("    dropped  %d  errors %d  overruns %d\n", (int)ns.rx_dropped,
+            (int)ns.rx_errors, (int)ns.rx_overruns);
+    kprintf("    irqs     %d  polls %d\n", (int)ns.rx_irqs, (int)ns.rx_polls);
+    kprint("  ");
+    kprint_color("----------------------------------------\n", C_DIM);
+    kprint("\n");
+    last = ns;
+    last_ms = now;
+}
+
 static void cmd_network(char *args) {
-    (void)args;
+    if (args && ksstrcmp(args, "stats") == 0) {
+        cmd_network_stats();
+        return;
+    }
     kprint("\n  ");
     kprint_color(" network ", C_BLUE);
     kprint_color(" -------------------------------------\n", C_DIM);
@@ -455,6 +524,10 @@ static void cmd_timer(char *args) {
     uint32_t timer_value = sys_timer_get();
     
     kprintf("Timer initialized! Current value: %u\n", timer_value);
+    kprintf("Clock source: %s", plat_clock_name());
+    if (plat_clock_khz())
+        kprintf(" at %d kHz", (int)plat_clock_khz());
+    kprintf(", uptime %d ms\n", (int)plat_ticks_ms());
     kprint("Available timers:\n");
     kprint("  - Timer 0: System timer\n");
     kprint("  - Timer 1: User timer\n");
@@ -716,7 +789,190 @@ static void cmd_demo(char *args) {
     kprint("Back to text mode.\n");
 }
 
+/* Mixed-size malloc/free churn: holds a window of live blocks so the heap
+ * stays fragmented the way streaming/transport/scheduler traffic leaves it. */
+#define HEAP_BENCH_ROUNDS  20000
+#define HEAP_BENCH_WINDOW  64
+
+static void bench_heap(void) {
+    static const size_t sizes[] = { 12, 24, 48, 100, 200, 512, 1400, 3000 };
+    void *live[HEAP_BENCH_WINDOW];
+    uint32_t ops = 0, failed = 0;
+    int i;
+    for (i = 0; i < HEAP_BENCH_WINDOW; i++) live[i] = NULL;
+    uint32_t start = plat_ticks_ms();
+    for (i = 0; i < HEAP_BENCH_ROUNDS; i++) {
+        int slot = (i * 7) % HEAP_BENCH_WINDOW;
+        if (live[slot]) { free(live[slot]); ops++; }
+        live[slot] = malloc(sizes[(i * 5) % 8]);
+        if (!live[slot]) failed++;
+        ops++;
+    }
+    for (i = 0; i < HEAP_BENCH_WINDOW; i++) {
+        if (live[i]) { free(live[i]); ops++; }
+    }
+    uint32_t ms = plat_ticks_ms() - start;
+    if (ms == 0) ms = 1;
+    kprint_color("heap", C_CYAN);
+    kprintf(" %d ops in %d ms  (%d ops/s", (int)ops, (int)ms, (int)((ops * 1000u) / ms));
+    if (failed) kprintf(", %d failed", (int)failed);
+    kprint(")\n");
+}
+
+/* Codec throughput on 16KB buffers shaped like what swap and snapshots see:
+ * a tiled 8bpp framebuffer, sparse game state, console text, and noise. */
+#define LZ_BENCH_BYTES   16384
+#define LZ_BENCH_ROUNDS  32
+
+static void bench_lz_fill(uint8_t *buf, int kind) {
+    uint32_t seed = 12345;
+    int i;
+    for (i = 0; i < LZ_BENCH_BYTES; i++) {
+        seed = seed * 1103515245u + 12345u;
+        switch (kind) {
+        case 0:  buf[i] = (uint8_t)(((i % 320) / 16 + (i / 320) / 16) & 7); break;
+        case 1:  buf[i] = (i % 64 < 12) ? (uint8_t)(seed >> 24) : 0; break;
+        case 2:  buf[i] = (uint8_t)"  mem   kernel  ok  run  idle\n"[(seed >> 16) % 30]; break;
+        default: buf[i] = (uint8_t)(seed >> 24); break;
+        }
+    }
+}
+
+static void bench_lz(void) {
+    static const char *names[] = { "framebuf", "gamestate", "text", "random" };
+    uint8_t *src = (uint8_t *)malloc(LZ_BENCH_BYTES);
+    uint8_t *enc = (uint8_t *)malloc(LZ_BOUND(LZ_BENCH_BYTES));
+    uint8_t *dec = (uint8_t *)malloc(LZ_BENCH_BYTES);
+    int kind, r;
+    if (!src || !enc || !dec) {
+        kprint("lz: out of memory\n");
+        free(src); free(enc); free(dec);
+        return;
+    }
+    for (kind = 0; kind < 4; kind++) {
+        size_t zlen = 0, got = 0;
+        int ok = 1;
+        bench_lz_fill(src, kind);
+        uint32_t start = plat_ticks_ms();
+        for (r = 0; r < LZ_BENCH_ROUNDS; r++)
+            zlen = lz_compress(src, LZ_BENCH_BYTES, enc, LZ_BOUND(LZ_BENCH_BYTES));
+        uint32_t cms = plat_ticks_ms() - start;
+        start = plat_ticks_ms();
+        for (r = 0; r < LZ_BENCH_ROUNDS && ok; r++)
+            ok = lz_decompress(enc, zlen, dec, LZ_BENCH_BYTES, &got) == 0 && got == LZ_BENCH_BYTES;
+        uint32_t dms = plat_ticks_ms() - start;
+        for (r = 0; r < LZ_BENCH_BYTES && ok; r++)
+            ok = dec[r] == src[r];
+        if (cms == 0) cms = 1;
+        if (dms == 0) dms = 1;
+        /* bytes per ms / 100 = tenths of MB/s */
+        uint32_t ct = (LZ_BENCH_BYTES * LZ_BENCH_ROUNDS / cms) / 100;
+        uint32_t dt = (LZ_BENCH_BYTES * LZ_BENCH_ROUNDS / dms) / 100;
+        kprint("    ");
+        kprint_color("lz", C_CYAN);
+        kprintf(" %s  %d%%  comp %d.%d MB/s  decomp %d.%d MB/s%s\n", names[kind],
+                (int)(zlen * 100 / LZ_BENCH_BYTES), (int)(ct / 10), (int)(ct % 10),
+                (int)(dt / 10), (int)(dt % 10), ok ? "" : "  MISMATCH");
+    }
+    free(src);
+    free(enc);
+    free(dec);
+}
+
+/* Whole-file reads, PIO then DMA: throughput, and how busy the BSP was
+ * (everything but its idle task). Data-port copies run in the ATA IRQ,
+ * which lands in the idle task while the reader sleeps, so they are
+ * taken back out of the idle time. */
+#define DISK_BENCH_ROUNDS  4
+
+static void bench_disk_run(const char *mode, const char *name, uint8_t *buf, uint32_t size) {
+    plat_disk_stats_t before, after;
+    sched_cpu_info_t c0, c1;
+    uint32_t got = 0, bytes = 0;
+    int r, ok = 1;
+    plat_disk_get_stats(&before);
+    sched_get_cpu_info(0, &c0);
+    uint32_t start = plat_ticks_ms();
+    for (r = 0; r < DISK_BENCH_ROUNDS && ok; r++) {
+        bcache_invalidate();                /* measure the drive, not the cache */
+        ok = plat_fs_read(name, buf, size, &got) == 0;
+        bytes += got;
+    }
+    uint32_t ms = plat_ticks_ms() - start;
+    sched_get_cpu_info(0, &c1);
+    plat_disk_get_stats(&after);
+    if (ms == 0) ms = 1;
+    /* all ns >> 10, wrapping: only differences */
+    uint32_t idle = c1.idle_time - c0.idle_time;
+    uint32_t total = (c1.busy_time - c0.busy_time) + idle;
+    uint32_t pio = after.pio_time - before.pio_time;
+    idle = idle > pio ? idle - pio : 0;
+    uint32_t idle_pct = total >= 100 ? idle / (total / 100) : 100;
+    uint32_t cpu = idle_pct >= 100 ? 0 : 100 - idle_pct;
+    kprint("    ");
+    kprint_color(mode, C_CYAN);
+    kprintf(" %d KB in %d ms  %d KB/s  cpu %d%%  cmds %d%s\n", (int)(bytes / 1024), (int)ms,
+            (int)(bytes / ms * 1000 / 1024), (int)(cpu > 100 ? 100 : cpu),
+            (int)((after.dma_cmds - before.dma_cmds) + (after.pio_cmds - before.pio_cmds)),
+            ok ? "" : "  READ FAILED");
+}
+
+static void bench_disk(char *name) {
+    plat_file_info_t files[32];
+    plat_disk_stats_t ds;
+    uint32_t size = 0;
+    int i, n = plat_fs_list(files, 32), named = name && *name;
+    for (i = 0; i < n; i++) {
+        if (named) {
+            if (ksstrcmp(files[i].name, name) == 0) size = files[i].size;
+        } else if (files[i].size > size) {
+            size = files[i].size;
+            name = files[i].name;
+        }
+    }
+    if (size == 0) {
+        kprint("disk: no such file\n");
+        return;
+    }
+    uint8_t *buf = (uint8_t *)malloc(size);
+    if (!buf) {
+        kprint("disk: out of memory\n");
+        return;
+    }
+    plat_disk_get_stats(&ds);
+    kprintf("    %s, %d bytes x %d\n", name, (int)size, DISK_BENCH_ROUNDS);
+    plat_disk_set_dma(0);
+    bench_disk_run("pio", name, buf, size);
+    if (plat_disk_set_dma(1) == 0) bench_disk_run("dma", name, buf, size);
+    else kprint("    dma unavailable\n");
+    plat_disk_set_dma(ds.dma);
+    free(buf);
+}
+
 static void cmd_benchmark(char *args) {
+    if (args && ksstrcmp(args, "heap") == 0) {
+        kprint("\n    ");
+        bench_heap();
+        kprint("\n");
+        return;
+    }
+    if (args && ksstrcmp(args, "lz") == 0) {
+        kprint("\n");
+        bench_lz();
+        kprint("\n");
+        return;
+    }
+    if (args) {
+        char *file = args;
+        while (*file && *file != ' ') file++;
+        if (*file) *file++ = '\0';
+        if (ksstrcmp(args, "disk") == 0) {
+            kprint("\n");
+            bench_disk(file);
+            kprint("\n");
+            return;
+        }
+    }
     kprint("\n  ");
     kprint_color(" benchmark ", C_MAGENTA);
     kprint_color(" ---------------------------------\n", C_DIM);
@@ -794,11 +1050,343 @@ static void cmd_memstat(char *args) {
     kprintf("    free    %u KB\n", m.free_kb);
     kprintf("    used    %u KB\n", m.used_kb);
     kprintf("    kernel  %u KB\n", m.kernel_kb);
+    kprintf("    heap    %d KB  (peak %d KB, largest free %d KB, frag %d%%)\n",
+            (int)m.heap_used_kb, (int)m.heap_peak_kb, (int)m.heap_largest_free_kb,
+            (int)m.heap_frag_pct);
+    swap_stats_t sw;
+    swap_get_stats(&sw);
+    kprintf("    swap    %d resident  %d on disk  (watermarks %d/%d%%)\n",
+            (int)sw.resident, (int)sw.swapped, (int)sw.high_pct, (int)sw.low_pct);
+    kprintf("            evict %d  refault %d  prefetch %d\n",
+            (int)sw.evictions, (int)sw.refaults, (int)sw.prefetches);
     kprint("  ");
     kprint_color("----------------------------------------\n", C_DIM);
     kprint("\n");
 }
 
+/* Live allocations by call site (MM_PROFILE builds). Also saved to
+ * HEAP_PROFILE_FILE for tools/heap_symbolize.py on the host. */
+#define HEAP_PROFILE_FILE "HEAPPROF.TXT"
+
+static int profile_put(char *buf, int pos, int max, const char *s) {
+    while (*s && pos < max - 1) buf[pos++] = *s++;
+    return pos;
+}
+
+static int profile_put_num(char *buf, int pos, int max, uint32_t v, int hex) {
+    char tmp[12];
+    int n = 0;
+    uint32_t base = hex ? 16 : 10;
+    if (hex) pos = profile_put(buf, pos, max, "0x");
+    do {
+        tmp[n++] = "0123456789abcdef"[v % base];
+        v /= base;
+    } while (v);
+    while (n > 0 && pos < max - 1) buf[pos++] = tmp[--n];
+    return pos;
+}
+
+static void heap_profile_dump(uint32_t min_age_ms) {
+    static heap_site_t sites[MM_PROFILE_SITES];
+    static char text[MM_PROFILE_SITES * 64];
+    int n = heap_profile_sites(sites, MM_PROFILE_SITES, min_age_ms);
+    if (n < 0) {
+        kprint("  heapstat: rebuild with MM_PROFILE=1 to record call sites\n");
+        return;
+    }
+    uint32_t now = plat_ticks_ms();
+    int pos = 0;
+    kprintf("\n    live blocks older than %d ms by call site\n", (int)min_age_ms);
+    for (int i = 0; i < n; i++) {
+        kprint("    ");
+        if (sites[i].caller) kprintf("%x", (unsigned int)(uintptr_t)sites[i].caller);
+        else kprint("(other)   ");
+        kprintf("  %d blocks  %d bytes  oldest %d ms ago\n", (int)sites[i].count,
+                (int)sites[i].bytes, (int)(now - sites[i].oldest_ms));
+        pos = profile_put(text, pos, sizeof(text), "site ");
+        pos = profile_put_num(text, pos, sizeof(text), (uint32_t)(uintptr_t)sites[i].caller, 1);
+        pos = profile_put(text, pos, sizeof(text), " count ");
+        pos = profile_put_num(text, pos, sizeof(text), sites[i].count, 0);
+        pos = profile_put(text, pos, sizeof(text), " bytes ");
+        pos = profile_put_num(text, pos, sizeof(text), sites[i].bytes, 0);
+        pos = profile_put(text, pos, sizeof(text), " age_ms ");
+        pos = profile_put_num(text, pos, sizeof(text), now - sites[i].oldest_ms, 0);
+        pos = profile_put(text, pos, sizeof(text), "\n");
+    }
+    if (plat_fs_write(HEAP_PROFILE_FILE, text, (uint32_t)pos) == 0)
+        kprintf("    saved to %s\n", HEAP_PROFILE_FILE);
+}
+
+static void cmd_heapstat(char *args) {
+    static const char *buckets[MM_HIST_BUCKETS] = {
+        "<=16", "<=32", "<=64", "<=128", "<=256", "<=512",
+        "<=1K", "<=2K", "<=4K", "<=8K", "<=16K", ">16K"
+    };
+    heap_stats_t h;
+    char sub[16];
+    int min_age = 0;
+    int n = 0;
+    sub[0] = '\0';
+    if (args) while (args[n] && args[n] != ' ') n++;
+    if (n > 0 && n < (int)sizeof(sub)) ksscanf(args, "%s %d", sub, &min_age);
+    if (ksstrcmp(sub, "sites") == 0) {
+        heap_profile_dump(min_age > 0 ? (uint32_t)min_age : 0);
+        kprint("\n");
+        return;
+    }
+    heap_get_stats(&h);
+    kprint("\n  ");
+    kprint_color(" heapstat ", C_CYAN);
+    kprint_color(" --------------------------------------\n", C_DIM);
+    kprintf("    in use   %d KB  (peak %d KB)\n", (int)(h.in_use / 1024), (int)(h.peak / 1024));
+    kprintf("    heap     %d KB  free %d KB\n", (int)(h.heap_bytes / 1024), (int)(h.free_bytes / 1024));
+    kprintf("    largest  %d KB free block  (frag %d%%)\n", (int)(h.largest_free / 1024), (int)h.frag_pct);
+    kprintf("    calls    %d malloc  %d free  %d failed\n",
+            (int)h.allocs, (int)h.frees, (int)h.failed);
+    kprint("    sizes   ");
+    for (int i = 0; i < MM_HIST_BUCKETS; i++) {
+        if (!h.hist[i]) continue;
+        kprintf(" %s:%d", buckets[i], (int)h.hist[i]);
+    }
+    kprint("\n  ");
+    kprint_color("----------------------------------------\n", C_DIM);
+    kprint("\n");
+}
+
+static void cmd_sched(char *args) {
+    char sub[16];
+    int ms = 0;
+    int n = 0;
+    sub[0] = '\0';
+    if (args) while (args[n] && args[n] != ' ') n++;
+    if (n > 0 && n < (int)sizeof(sub)) ksscanf(args, "%s %d", sub, &ms);
+    if (ksstrcmp(sub, "slice") == 0) {
+        if (ms <= 0) {
+            kprint_color("  usage: sched slice <ms>\n", C_DIM);
+            return;
+        }
+        sched_set_timeslice_ms((uint32_t)ms);
+    }
+    kprint("\n  ");
+    kprint_color(" sched ", C_CYAN);
+    kprint_color(" -----------------------------------------\n", C_DIM);
+    kprintf("    mode     %s\n", sched_preemptive() ? "preemptive (IRQ0)" : "cooperative");
+    kprintf("    slice    %d ms  (tick %d ms)\n", (int)sched_get_timeslice_ms(), SCHED_TICK_MS);
+    kprintf("    ticks    %d\n", (int)sched_ticks());
+    kprintf("    current  task %d\n", (int)task_current());
+    uint32_t halts, skipped;
+    sched_get_idle_stats(&halts, &skipped);
+    kprintf("    idle     %d halts, %d ticks skipped\n", (int)halts, (int)skipped);
+    static const char *states[] = { "-", "ready", "run", "sleep", "block", "done" };
+    static const char *prios[] = { "high", "normal", "low", "idle" };
+    for (int id = 0; id < sched_task_slots(); id++) {
+        task_info_t ti;
+        if (task_get_info(id, &ti) != 0) continue;
+        if (ti.edf)
+            kprintf("    task %d   %s  edf %d ms  misses %d", id, states[ti.state],
+                    (int)ti.period_ms, (int)ti.deadline_misses);
+        else
+            kprintf("    task %d   %s  %s", id, states[ti.state], prios[ti.prio]);
+        if (ti.stack_size) kprintf("  stack %d", (int)ti.stack_size);
+        if (sched_cpu_count() > 1) kprintf("  cpu %d%s", (int)ti.cpu, ti.pinned ? "*" : "");
+        if (ti.state == TASK_DONE) kprintf("  exit %d", ti.exit_code);
+        kprint("\n");
+    }
+    kprint("\n");
+}
+
+/* Busy share per core since the previous `cpus` (or boot). */
+#define SHELL_CPUS_MAX 8
+
+static void cmd_cpus(char *args) {
+    static uint32_t last_busy[SHELL_CPUS_MAX], last_idle[SHELL_CPUS_MAX];
+    (void)args;
+    kprint("\n  ");
+    kprint_color(" cpus ", C_CYAN);
+    kprint_color(" ------------------------------------------\n", C_DIM);
+    for (int cpu = 0; cpu < sched_cpu_count() && cpu < SHELL_CPUS_MAX; cpu++) {
+        sched_cpu_info_t ci;
+        if (sched_get_cpu_info(cpu, &ci) != 0) continue;
+        uint32_t busy = ci.busy_time - last_busy[cpu];
+        uint32_t total = busy + (ci.idle_time - last_idle[cpu]);
+        int pct = total >= 100 ? (int)(busy / (total / 100)) : 0;
+        if (pct > 100) pct = 100;
+        last_busy[cpu] = ci.busy_time;
+        last_idle[cpu] = ci.idle_time;
+        kprintf("    cpu %d   ", cpu);
+        kprint_color(pct >= 90 ? "busy" : pct > 0 ? "run " : "idle",
+                     pct >= 90 ? C_RED : pct > 0 ? C_GREEN : C_DIM);
+        kprintf("  %d%%  task %d  ready %d  switches %d  steals %d  halts %d\n",
+                pct, ci.current, ci.ready, (int)ci.switches, (int)ci.steals, (int)ci.halts);
+    }
+    kprint("  ");
+    kprint_color("----------------------------------------\n", C_DIM);
+    kprint("\n");
+}
+
+/* top: CPU share, switches and time per task, tick cost per subsystem,
+ * redrawn in place every interval (top [ms]) until a key is pressed.
+ * Times are the scheduler's ns >> 10 units. */
+#define TOP_INTERVAL_MS  1000
+#define TOP_UNITS_PER_MS 977
+#define TOP_POLL_MS      50
+#define TOP_TASK_ROWS    10
+
+typedef struct {
+    int id;
+    task_info_t ti;
+    uint32_t run;           /* run_time since the previous frame */
+    uint32_t sw;
+} top_task_t;
+
+static void top_num(uint32_t v, int width) {
+    char buf[12];
+    int n = 0;
+    do { buf[n++] = (char)('0' + v % 10); v /= 10; } while (v && n < 11);
+    while (width-- > n) kprint(" ");
+    while (n > 0) kprint_char(buf[--n]);
+}
+
+static void top_str(const char *s, int width) {
+    kprint(s);
+    while (*s++) width--;
+    while (width-- > 0) kprint(" ");
+}
+
+static uint32_t top_pct(uint32_t part, uint32_t whole) {
+    if (whole < 100) return 0;
+    part /= whole / 100;
+    return part > 100 ? 100 : part;
+}
+
+/* Events per second over dwall (time units). */
+static uint32_t top_rate(uint32_t count, uint32_t dwall) {
+    uint32_t ms = dwall / TOP_UNITS_PER_MS;
+    return ms ? count * 1000u / ms : 0;
+}
+
+static void cmd_top(char *args) {
+    static const char *states[] = { "-", "ready", "run", "sleep", "block", "done" };
+    static const char *prios[] = { "high", "norm", "low", "idle" };
+    static uint32_t last_run[TASK_MAX], last_sw[TASK_MAX];
+    static uint32_t last_cpu_busy[SHELL_CPUS_MAX], last_cpu_idle[SHELL_CPUS_MAX];
+    static uint32_t last_sub_time[SUBSYS_COUNT], last_sub_ticks[SUBSYS_COUNT];
+    static top_task_t rows[TASK_MAX];
+    int interval = TOP_INTERVAL_MS;
+    if (args && args[0]) ksscanf(args, "%d", &interval);
+    if (interval < TOP_POLL_MS) interval = TOP_POLL_MS;
+
+    /* Baseline, so the first frame covers one interval rather than boot. */
+    for (int id = 0; id < sched_task_slots() && id < TASK_MAX; id++) {
+        task_info_t ti;
+        if (task_get_info(id, &ti) != 0) ti.run_time = ti.switches = 0;
+        last_run[id] = ti.run_time;
+        last_sw[id] = ti.switches;
+    }
+    for (int cpu = 0; cpu < sched_cpu_count() && cpu < SHELL_CPUS_MAX; cpu++) {
+        sched_cpu_info_t ci;
+        if (sched_get_cpu_info(cpu, &ci) != 0) continue;
+        last_cpu_busy[cpu] = ci.busy_time;
+        last_cpu_idle[cpu] = ci.idle_time;
+    }
+    for (int s = 0; s < SUBSYS_COUNT; s++) {
+        subsys_stats_t st;
+        if (subsys_get_stats((subsys_id_t)s, &st) != 0) continue;
+        last_sub_time[s] = st.total_time;
+        last_sub_ticks[s] = st.ticks;
+    }
+    uint32_t last_wall = (uint32_t)(plat_ticks_ns() >> 10);
+    clear_screen();
+    kprint_color(" top ", C_CYAN);
+    kprint_color(" sampling...\n", C_DIM);
+
+    for (;;) {
+        for (int waited = 0; waited < interval && !keyboard_has_key(); waited += TOP_POLL_MS)
+            plat_delay_ms(TOP_POLL_MS);
+        if (keyboard_has_key()) break;
+
+        uint32_t wall = (uint32_t)(plat_ticks_ns() >> 10);
+        uint32_t dwall = wall - last_wall;
+        last_wall = wall;
+        int n = 0;
+        for (int id = 0; id < sched_task_slots() && id < TASK_MAX; id++) {
+            task_info_t ti;
+            if (task_get_info(id, &ti) != 0) {
+                last_run[id] = last_sw[id] = 0;
+                continue;
+            }
+            if (ti.switches < last_sw[id]) last_run[id] = last_sw[id] = 0;     /* slot reused */
+            rows[n].id = id;
+            rows[n].ti = ti;
+            rows[n].run = ti.run_time - last_run[id];
+            rows[n].sw = ti.switches - last_sw[id];
+            last_run[id] = ti.run_time;
+            last_sw[id] = ti.switches;
+            n++;
+        }
+        for (int i = 0; i < n; i++)     /* busiest first */
+            for (int j = i + 1; j < n; j++)
+                if (rows[j].run > rows[i].run) {
+                    top_task_t t = rows[i];
+                    rows[i] = rows[j];
+                    rows[j] = t;
+                }
+
+        clear_screen();
+        kprint_color(" top ", C_CYAN);
+        kprintf("  up %d s  %d ms  ", (int)(plat_ticks_ms() / 1000), interval);
+        kprint_color("any key quits\n", C_DIM);
+        for (int cpu = 0; cpu < sched_cpu_count() && cpu < SHELL_CPUS_MAX; cpu++) {
+            sched_cpu_info_t ci;
+            if (sched_get_cpu_info(cpu, &ci) != 0) continue;
+            uint32_t busy = ci.busy_time - last_cpu_busy[cpu];
+            uint32_t pct = top_pct(busy, busy + (ci.idle_time - last_cpu_idle[cpu]));
+            last_cpu_busy[cpu] = ci.busy_time;
+            last_cpu_idle[cpu] = ci.idle_time;
+            kprintf(" cpu%d ", cpu);
+            top_num(pct, 3);
+            kprint("%");
+        }
+        kprint("\n\n");
+        kprint_color("  task  state  prio  cpu  %cpu  switch/s  time ms\n", C_DIM);
+        for (int i = 0; i < n && i < TOP_TASK_ROWS; i++) {
+            top_task_t *r = &rows[i];
+            kprint("  ");
+            top_num((uint32_t)r->id, 4);
+            kprint("  ");
+            top_str(states[r->ti.state], 5);
+            kprint("  ");
+            top_str(r->ti.edf ? "edf" : prios[r->ti.prio], 4);
+            top_num(r->ti.cpu, 5);
+            top_num(top_pct(r->run, dwall), 6);
+            top_num(top_rate(r->sw, dwall), 10);
+            top_num(r->ti.run_time / TOP_UNITS_PER_MS, 9);
+            kprint("\n");
+        }
+        if (n > TOP_TASK_ROWS) kprintf("  ... %d more\n", n - TOP_TASK_ROWS);
+        kprint("\n");
+        kprint_color("  subsys   ticks/s  avg us  max us  %time\n", C_DIM);
+        for (int s = 0; s < SUBSYS_COUNT; s++) {
+            const subsys_t *ss = subsys_get((subsys_id_t)s);
+            subsys_stats_t st;
+            if (!ss || !ss->tick || subsys_get_stats((subsys_id_t)s, &st) != 0) continue;
+            uint32_t dt = st.total_time - last_sub_time[s];
+            uint32_t dn = st.ticks - last_sub_ticks[s];
+            last_sub_time[s] = st.total_time;
+            last_sub_ticks[s] = st.ticks;
+            kprint("  ");
+            top_str(ss->name, 8);
+            top_num(top_rate(dn, dwall), 8);
+            top_num(dn ? dt * 1024u / 1000u / dn : 0, 8);
+            top_num(st.max_us, 8);
+            top_num(top_pct(dt, dwall), 7);
+            kprint("\n");
+        }
+    }
+    while (keyboard_get_scancode() != 0) ;
+    clear_screen();
+}
+
 static void cmd_ports(char *args) {
     (void)args;
     hw_port_status_t p[HW_STATUS_MAX_PORTS];
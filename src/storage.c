@@ -54,10 +54,40 @@ int storage_copy(const char *src, const char *dst) {
     uint32_t sz;
     if (plat_fs_read(src, buf, sizeof(buf), &sz) != 0) return -1;
     if (plat_fs_write(dst, buf, sz) != 0) return -1;
-    kprintf("  storage: copied %s -> %s (%u bytes)\n", src, dst, (unsigned)sz);
+    kprintf("  storage: copied %s -> %s (%d bytes)\n", src, dst, (int)sz);
     return 0;
 }
 
 int storage_snapshot_backup(const char *source_path, const char *backup_path) {
     return storage_copy(source_path, backup_path);
 }
+
+static char swap_path[STORAGE_PATH_MAX];
+static uint32_t swap_chunk_size;
+
+int storage_swap_open(const char *path, uint32_t chunk_size, uint32_t chunk_count) {
+    uint32_t total = chunk_size * chunk_count;
+    uint32_t n = 0;
+    uint8_t probe;
+    if (!path || !chunk_size || !chunk_count) return -1;
+    /* Reuse an existing file that is already large enough. */
+    if (plat_fs_read_at(path, total - 1, &probe, 1, &n) != 0 || n != 1) {
+        if (plat_fs_create(path, total) != 0) return -1;
+        kprintf("  storage: swap file %s (%d KB)\n", path, (int)(total / 1024));
+    }
+    str_copy(swap_path, path, STORAGE_PATH_MAX);
+    swap_chunk_size = chunk_size;
+    return 0;
+}
+
+int storage_swap_write(uint32_t chunk, const void *data, uint32_t len) {
+    if (!swap_chunk_size || len > swap_chunk_size) return -1;
+    return plat_fs_write_at(swap_path, chunk * swap_chunk_size, data, len);
+}
+
+int storage_swap_read(uint32_t chunk, void *buf, uint32_t len) {
+    uint32_t n = 0;
+    if (!swap_chunk_size || len > swap_chunk_size) return -1;
+    if (plat_fs_read_at(swap_path, chunk * swap_chunk_size, buf, len, &n) != 0) return -1;
+    return (n == len) ? 0 : -1;
+}
@@ -5,7 +5,9 @@
 #include "platform.h"
 #include "kernel.h"
 #include "memory_manager.h"
+#include "memory_budget.h"
 #include "transport.h"
+#include "pbuf.h"
 #include "video.h"
 #include <stddef.h>
 
@@ -14,6 +16,7 @@
 
 struct stream_pipeline {
     char path[128];
+    int fd;                   /* plat_fs_open handle */
     int for_write;
     stream_request_t queue[STREAMING_QUEUE_DEPTH];
     int queue_head;
@@ -23,8 +26,15 @@ struct stream_pipeline {
 
 stream_pipeline_t *stream_open(const char *path, int for_write) {
     if (!path) return NULL;
-    stream_pipeline_t *s = (stream_pipeline_t *)malloc(sizeof(stream_pipeline_t));
-    if (!s) return NULL;
+    int fd = plat_fs_open(path);
+    if (fd < 0 && for_write && plat_fs_create(path, 0) == 0) fd = plat_fs_open(path);
+    if (fd < 0) return NULL;
+    stream_pipeline_t *s = (stream_pipeline_t *)budget_malloc(BUDGET_STREAMING, sizeof(stream_pipeline_t));
+    if (!s) {
+        plat_fs_close(fd);
+        return NULL;
+    }
+    s->fd = fd;
     unsigned int i = 0;
     while (path[i] && i < sizeof(s->path) - 1) { s->path[i] = path[i]; i++; }
     s->path[i] = '\0';
@@ -40,30 +50,32 @@ stream_pipeline_t *stream_open(const char *path, int for_write) {
 }
 
 void stream_close(stream_pipeline_t *s) {
-    if (s) free(s);
+    if (!s) return;
+    plat_fs_close(s->fd);
+    if (s->for_write) plat_fs_sync();
+    budget_free(BUDGET_STREAMING, s);
 }
 
+/* One chunk at req->offset through the pipeline's handle; the handle
+ * keeps its place in the cluster chain, so each chunk is O(1). A short
+ * read (end of file) finishes the request. */
 static int advance_chunk(stream_pipeline_t *s, stream_request_t *req) {
-    if (req->length <= STREAMING_CHUNK_SIZE) {
-        if (s->for_write && req->buffer) {
-            plat_fs_write(s->path, req->buffer, req->length);
-        } else if (!s->for_write && req->buffer) {
-            uint32_t got;
-            plat_fs_read(s->path, req->buffer, req->length, &got);
-        }
+    uint32_t n = req->length < STREAMING_CHUNK_SIZE ? req->length : STREAMING_CHUNK_SIZE;
+    uint32_t got = n;
+    int rc;
+    if (req->op == STREAM_OP_WRITE)
+        rc = plat_fs_pwrite(s->fd, req->offset, req->buffer, n);
+    else
+        rc = plat_fs_pread(s->fd, req->offset, req->buffer, n, &got);
+    if (rc != 0) {
+        req->error = -1;
         req->done = 1;
-        req->error = 0;
-        return 0;
-    }
-    if (s->for_write && req->buffer) {
-        plat_fs_write(s->path, req->buffer, STREAMING_CHUNK_SIZE);
-    } else if (!s->for_write && req->buffer) {
-        uint32_t got;
-        plat_fs_read(s->path, req->buffer, STREAMING_CHUNK_SIZE, &got);
+        return 1;
     }
-    req->offset += STREAMING_CHUNK_SIZE;
-    req->length -= STREAMING_CHUNK_SIZE;
-    if (req->buffer) req->buffer = (char *)req->buffer + STREAMING_CHUNK_SIZE;
+    req->offset += got;
+    req->length -= got;
+    req->buffer = (char *)req->buffer + got;
+    if (req->length == 0 || got < n) req->done = 1;
     return 1;
 }
 
@@ -120,7 +132,7 @@ int stream_read_sync(stream_pipeline_t *s, uint32_t offset, uint32_t length, voi
     r->buffer = buffer;
     r->done = 0;
     r->error = 0;
-    while (r->length > 0 && !r->error) {
+    while (!r->done) {
         advance_chunk(s, r);
     }
     return r->error;
@@ -135,7 +147,7 @@ int stream_write_sync(stream_pipeline_t *s, uint32_t offset, uint32_t length, co
     r->buffer = (void *)buffer;
     r->done = 0;
     r->error = 0;
-    while (r->length > 0 && !r->error) {
+    while (!r->done) {
         advance_chunk(s, r);
     }
     return r->error;
@@ -147,7 +159,6 @@ static int streaming_running;
 static int stream_quality;
 static int stream_passthrough;
 static uint32_t frame_id;
-static uint8_t frame_chunk_buf[TRANSPORT_MAX_PAYLOAD];
 
 int streaming_init(void) {
     if (streaming_initialized)
@@ -204,8 +215,16 @@ int streaming_capture_and_send(void) {
     unsigned int chunk_idx = 0;
     const unsigned int full_w = (unsigned int)VIDEO_WIDTH;
 
+    /* Each chunk is captured straight into the packet buffer that goes out. */
     while (chunk_idx < n_chunks) {
-        uint8_t *hdr = frame_chunk_buf;
+        unsigned int to_copy = FRAME_CHUNK_PAYLOAD;
+        if (src_offset + to_copy > total_bytes)
+            to_copy = total_bytes - src_offset;
+
+        pbuf_t *pb = pbuf_alloc(PBUF_HEADROOM, (uint16_t)(FRAME_CHUNK_HEADER + to_copy));
+        if (!pb)
+            return -1;
+        uint8_t *hdr = pb->payload;
         hdr[0] = (uint8_t)(frame_id & 0xFF);
         hdr[1] = (uint8_t)((frame_id >> 8) & 0xFF);
         hdr[2] = (uint8_t)((frame_id >> 16) & 0xFF);
@@ -215,11 +234,7 @@ int streaming_capture_and_send(void) {
         hdr[6] = (uint8_t)(n_chunks & 0xFF);
         hdr[7] = (uint8_t)((n_chunks >> 8) & 0xFF);
 
-        unsigned int to_copy = FRAME_CHUNK_PAYLOAD;
-        if (src_offset + to_copy > total_bytes)
-            to_copy = total_bytes - src_offset;
-
-        uint8_t *dst = frame_chunk_buf + FRAME_CHUNK_HEADER;
+        uint8_t *dst = pb->payload + FRAME_CHUNK_HEADER;
         if (step == 1) {
             for (unsigned int i = 0; i < to_copy; i++)
                 dst[i] = fb[src_offset + i];
@@ -234,7 +249,7 @@ int streaming_capture_and_send(void) {
         }
         src_offset += to_copy;
 
-        if (transport_send(TRANSPORT_TYPE_DATA, frame_chunk_buf, FRAME_CHUNK_HEADER + (uint16_t)to_copy) < 0)
+        if (transport_send_pbuf(TRANSPORT_TYPE_DATA, pb) < 0)
             return -1;
         chunk_idx++;
     }
@@ -5,8 +5,11 @@
 #include "party.h"
 #include "transport.h"
 #include "kernel.h"
+#include "keyboard.h"
+#include "bcache.h"
 
 static int core_init(void) { return 0; }
+static void core_tick(void) { memory_budget_tick(); }
 static int core_status(char *buf, int max) {
     if (!buf || max < 2) return -1;
     buf[0] = 'o'; buf[1] = 'k'; buf[2] = '\0';
@@ -14,6 +17,7 @@ static int core_status(char *buf, int max) {
 }
 
 static int storage_init(void) { return plat_fs_init(); }
+static void storage_tick(void) { bcache_tick(); }
 static int storage_status(char *buf, int max) {
     if (!buf || max < 8) return -1;
     buf[0] = plat_fs_validate() == 0 ? 'm' : 'e';
@@ -33,7 +37,7 @@ static int net_status(char *buf, int max) {
 }
 static void net_tick(void) { transport_tick(); }
 
-static int input_init(void) { return 0; }
+static int input_init(void) { keyboard_init(); return 0; }
 static int input_status(char *buf, int max) {
     if (!buf || max < 4) return -1;
     buf[0] = 'r'; buf[1] = 'e'; buf[2] = 'a'; buf[3] = 'd'; buf[4] = '\0';
@@ -84,8 +88,8 @@ static int iop_status(char *buf, int max) { return ps2_iop_status(buf, max); }
 #endif
 
 static subsys_t subsystems[SUBSYS_COUNT] = {
-    { "core",    SUBSYS_CORE,    CAP_NONE,    core_init,    core_status,    NULL,         NULL },
-    { "storage", SUBSYS_STORAGE, CAP_STORAGE, storage_init, storage_status, NULL,         NULL },
+    { "core",    SUBSYS_CORE,    CAP_NONE,    core_init,    core_status,    core_tick,    NULL },
+    { "storage", SUBSYS_STORAGE, CAP_STORAGE, storage_init, storage_status, storage_tick, NULL },
     { "net",     SUBSYS_NET,     CAP_NET_RAW, net_init_sub, net_status,     net_tick,     NULL },
     { "input",   SUBSYS_INPUT,   CAP_INPUT,   input_init,   input_status,   NULL,         NULL },
     { "audio",   SUBSYS_AUDIO,   CAP_AUDIO,   audio_init,   audio_status,   NULL,         NULL },
@@ -103,10 +107,39 @@ void subsys_init_all(void) {
         if (subsystems[i].init) subsystems[i].init();
 }
 
+static struct {
+    uint32_t ticks;
+    uint64_t total_ns;
+    uint32_t last_ns;
+    uint32_t max_ns;
+} tick_stats[SUBSYS_COUNT];
+static plat_lock_t stats_lock = PLAT_LOCK_INIT;
+
 void subsys_tick_all(void) {
     int i;
-    for (i = 0; i < SUBSYS_COUNT; i++)
-        if (subsystems[i].tick) subsystems[i].tick();
+    for (i = 0; i < SUBSYS_COUNT; i++) {
+        if (!subsystems[i].tick) continue;
+        uint64_t start = plat_ticks_ns();
+        subsystems[i].tick();
+        uint32_t ns = (uint32_t)(plat_ticks_ns() - start);
+        uint32_t flags = plat_lock_irqsave(&stats_lock);
+        tick_stats[i].ticks++;
+        tick_stats[i].total_ns += ns;
+        tick_stats[i].last_ns = ns;
+        if (ns > tick_stats[i].max_ns) tick_stats[i].max_ns = ns;
+        plat_unlock_irqrestore(&stats_lock, flags);
+    }
+}
+
+int subsys_get_stats(subsys_id_t id, subsys_stats_t *out) {
+    if (!out || id < 0 || id >= SUBSYS_COUNT) return -1;
+    uint32_t flags = plat_lock_irqsave(&stats_lock);
+    out->ticks = tick_stats[id].ticks;
+    out->total_time = (uint32_t)(tick_stats[id].total_ns >> 10);
+    out->last_us = tick_stats[id].last_ns / 1000;
+    out->max_us = tick_stats[id].max_ns / 1000;
+    plat_unlock_irqrestore(&stats_lock, flags);
+    return 0;
 }
 
 const subsys_t *subsys_get(subsys_id_t id) {
@@ -5,6 +5,8 @@
 
 #include "transport.h"
 #include "platform.h"
+#include "pbuf.h"
+#include "scheduler.h"
 #include <stddef.h>
 
 static void *transport_memcpy(void *dest, const void *src, size_t n) {
@@ -21,20 +23,10 @@ static void *transport_memset(void *s, int c, size_t n) {
 #define memcpy transport_memcpy
 #define memset transport_memset
 
-static int do_network_send(const void *data, size_t len) {
-    return plat_net_send(data, len);
-}
-static int do_network_receive(void *buf, size_t max_len) {
-    return plat_net_recv(buf, max_len);
-}
-
 static transport_session_t session;
-static uint8_t tx_buf[TRANSPORT_PACKET_MAX];
-static uint8_t rx_buf[TRANSPORT_PACKET_MAX];
 static int initialized;
-static uint32_t transport_ticks;
-#define TRANSPORT_HEARTBEAT_TICKS   (TRANSPORT_HEARTBEAT_MS / 10)
-#define TRANSPORT_RECONNECT_TICKS   (TRANSPORT_RECONNECT_MS / 10)
+/* Session and NIC queue: shared by senders and the housekeeping tick. */
+static task_mutex_t transport_lock = TASK_MUTEX_INIT;
 #define TRANSPORT_MAX_MISSED_HEARTBEAT 3
 #define TRANSPORT_MAX_RECONNECT_ATTEMPTS 10
 
@@ -52,9 +44,9 @@ int transport_init(void) {
     if (initialized)
         return 0;
     memset(&session, 0, sizeof(session));
-    transport_ticks = 0;
     initialized = 1;
     session.connected = 1;
+    session.last_heartbeat_ms = plat_ticks_ms();
     return 0;
 }
 
@@ -63,28 +55,53 @@ void transport_shutdown(void) {
     session.connected = 0;
 }
 
-int transport_send(uint8_t type, const void *payload, uint16_t len) {
-    if (!initialized || len > TRANSPORT_MAX_PAYLOAD)
+/* Prepend the header in p's headroom and pass p down to the NIC. */
+static int transport_xmit(uint8_t type, uint16_t seq, pbuf_t *p) {
+    uint16_t len = p->len;
+    uint16_t crc = crc16_simple(p->payload, len);
+    transport_header_t *h = (transport_header_t *)pbuf_push(p, TRANSPORT_HEADER_SIZE);
+    if (!h) {
+        pbuf_free(p);
         return -1;
-
-    transport_header_t *h = (transport_header_t *)tx_buf;
+    }
     h->type   = type;
     h->flags  = 0;
-    h->seq    = session.local_seq++;
+    h->seq    = seq;
     h->len    = len;
-    h->crc    = 0;
+    h->crc    = crc;
     h->reserved[0] = h->reserved[1] = 0;
+    return plat_net_send_pbuf(p);
+}
 
-    if (payload && len)
-        memcpy(tx_buf + TRANSPORT_HEADER_SIZE, payload, len);
-    h->crc = crc16_simple(tx_buf + TRANSPORT_HEADER_SIZE, len);
-
-    size_t total = TRANSPORT_HEADER_SIZE + len;
-    if (do_network_send(tx_buf, total) != 0)
+int transport_send_pbuf(uint8_t type, struct pbuf *p) {
+    if (!p)
+        return -1;
+    if (!initialized || p->len > TRANSPORT_MAX_PAYLOAD) {
+        pbuf_free(p);
+        return -1;
+    }
+    uint16_t len = p->len;
+    task_mutex_lock(&transport_lock);
+    int rc = transport_xmit(type, session.local_seq++, p);
+    task_mutex_unlock(&transport_lock);
+    if (rc != 0)
         return -1;
     return (int)len;
 }
 
+int transport_send(uint8_t type, const void *payload, uint16_t len) {
+    if (!initialized || len > TRANSPORT_MAX_PAYLOAD)
+        return -1;
+    pbuf_t *p = pbuf_alloc(PBUF_HEADROOM, len);
+    if (!p)
+        return -1;
+    if (payload && len)
+        memcpy(p->payload, payload, len);
+    else
+        p->len = 0;
+    return transport_send_pbuf(type, p);
+}
+
 /* Batch: encode count + lengths + payloads into one packet when possible. */
 int transport_send_batch(const void *payloads[], const uint16_t lens[], int count) {
     if (!initialized || count <= 0 || count > TRANSPORT_BATCH_MAX)
@@ -94,8 +111,10 @@ int transport_send_batch(const void *payloads[], const uint16_t lens[], int coun
         total_len += 2 + lens[i];
     if (total_len > TRANSPORT_MAX_PAYLOAD - 2)
         return -1;
-    uint8_t batch_buf[TRANSPORT_MAX_PAYLOAD];
-    uint8_t *p = batch_buf;
+    pbuf_t *pb = pbuf_alloc(PBUF_HEADROOM, (uint16_t)(total_len + 2));
+    if (!pb)
+        return -1;
+    uint8_t *p = pb->payload;
     *p++ = (uint8_t)count;
     *p++ = 0;
     for (int i = 0; i < count; i++) {
@@ -105,53 +124,66 @@ int transport_send_batch(const void *payloads[], const uint16_t lens[], int coun
             memcpy(p, payloads[i], lens[i]);
         p += lens[i];
     }
-    return transport_send(TRANSPORT_TYPE_DATA, batch_buf, (uint16_t)(p - batch_buf));
+    return transport_send_pbuf(TRANSPORT_TYPE_DATA, pb);
 }
 
-int transport_receive(void *buffer, size_t max_len, uint8_t *out_type) {
-    if (!initialized || !buffer || !out_type)
+static int transport_recv_locked(void *buffer, size_t max_len, uint8_t *out_type) {
+    pbuf_t *p = plat_net_recv_pbuf();
+    if (!p)
         return -1;
-
-    int n = do_network_receive(rx_buf, sizeof(rx_buf));
-    if (n < (int)TRANSPORT_HEADER_SIZE)
+    if (p->len < TRANSPORT_HEADER_SIZE) {
+        pbuf_free(p);
         return -1;
+    }
 
-    transport_header_t *h = (transport_header_t *)rx_buf;
-    uint16_t len = h->len;
-    if (len > TRANSPORT_MAX_PAYLOAD || (size_t)len > max_len)
+    transport_header_t *h = (transport_header_t *)p->payload;
+    uint8_t type = h->type;
+    uint16_t seq = h->seq;
+    uint16_t hcrc = h->crc;
+    uint32_t len = h->len;
+    if (len > TRANSPORT_MAX_PAYLOAD || (size_t)len > max_len ||
+        len > (uint32_t)(p->len - TRANSPORT_HEADER_SIZE)) {
+        pbuf_free(p);
         return -1;
+    }
 
-    uint16_t crc = crc16_simple(rx_buf + TRANSPORT_HEADER_SIZE, len);
-    if (crc != h->crc)
+    const uint8_t *data = (const uint8_t *)pbuf_pull(p, TRANSPORT_HEADER_SIZE);
+    if (crc16_simple(data, (uint16_t)len) != hcrc) {
+        pbuf_free(p);
         return -1;
+    }
 
-    *out_type = h->type;
-    session.remote_seq = h->seq;
-    session.last_heartbeat_ticks = transport_ticks;
+    *out_type = type;
+    session.remote_seq = seq;
+    session.last_heartbeat_ms = plat_ticks_ms();
     session.heartbeat_missed = 0;
     if (len)
-        memcpy(buffer, rx_buf + TRANSPORT_HEADER_SIZE, len);
-
-    if (h->type == TRANSPORT_TYPE_DATA) {
-        transport_header_t *ack_h = (transport_header_t *)tx_buf;
-        ack_h->type = TRANSPORT_TYPE_ACK;
-        ack_h->flags = 0;
-        ack_h->seq = h->seq;
-        ack_h->len = 0;
-        ack_h->crc = 0;
-        ack_h->reserved[0] = ack_h->reserved[1] = 0;
-        do_network_send(tx_buf, TRANSPORT_HEADER_SIZE);
+        memcpy(buffer, data, len);
+    pbuf_free(p);
+
+    if (type == TRANSPORT_TYPE_DATA) {
+        pbuf_t *ack = pbuf_alloc(PBUF_HEADROOM, 0);
+        if (ack)
+            transport_xmit(TRANSPORT_TYPE_ACK, seq, ack);
     }
     return (int)len;
 }
 
-void transport_tick(void) {
-    if (!initialized)
-        return;
-    transport_ticks++;
+int transport_receive(void *buffer, size_t max_len, uint8_t *out_type) {
+    if (!initialized || !buffer || !out_type)
+        return -1;
+    task_mutex_lock(&transport_lock);
+    int rc = transport_recv_locked(buffer, max_len, out_type);
+    task_mutex_unlock(&transport_lock);
+    return rc;
+}
+
+static void transport_tick_locked(void) {
+    uint32_t now = plat_ticks_ms();
 
     if (session.connected) {
-        if (transport_ticks - session.last_heartbeat_ticks >= TRANSPORT_HEARTBEAT_TICKS) {
+        if (now - session.last_heartbeat_ms >= TRANSPORT_HEARTBEAT_MS) {
+            session.last_heartbeat_ms = now;
             session.heartbeat_missed++;
             if (session.heartbeat_missed >= TRANSPORT_MAX_MISSED_HEARTBEAT)
                 session.connected = 0;
@@ -161,25 +193,42 @@ void transport_tick(void) {
         return;
     }
 
-    static uint32_t next_reconnect_tick;
+    static uint32_t next_reconnect_ms;
     static int reconnect_attempts;
     if (reconnect_attempts == 0)
-        next_reconnect_tick = transport_ticks + TRANSPORT_RECONNECT_TICKS;
-    if (transport_ticks >= next_reconnect_tick && reconnect_attempts < TRANSPORT_MAX_RECONNECT_ATTEMPTS) {
+        next_reconnect_ms = now + TRANSPORT_RECONNECT_MS;
+    if ((int32_t)(now - next_reconnect_ms) >= 0 && reconnect_attempts < TRANSPORT_MAX_RECONNECT_ATTEMPTS) {
         reconnect_attempts++;
         session.connected = 1;
         session.heartbeat_missed = 0;
-        session.last_heartbeat_ticks = transport_ticks;
-        next_reconnect_tick = transport_ticks + TRANSPORT_RECONNECT_TICKS * (reconnect_attempts > 4 ? 2 : 1);
+        session.last_heartbeat_ms = now;
+        next_reconnect_ms = now + TRANSPORT_RECONNECT_MS * (reconnect_attempts > 4 ? 2 : 1);
     }
 }
 
+/* Deadlines are in real milliseconds, so the heartbeat and reconnect
+ * periods hold however often the caller ticks; a tick that lands while
+ * a sender holds the session is skipped. */
+void transport_tick(void) {
+    if (!initialized)
+        return;
+    if (task_mutex_trylock(&transport_lock) != 0)
+        return;
+    transport_tick_locked();
+    task_mutex_unlock(&transport_lock);
+}
+
 void transport_request_reconnect(void) {
+    task_mutex_lock(&transport_lock);
     session.connected = 0;
     session.heartbeat_missed = TRANSPORT_MAX_MISSED_HEARTBEAT;
+    task_mutex_unlock(&transport_lock);
 }
 
 void transport_get_session(transport_session_t *out) {
-    if (out)
-        memcpy(out, &session, sizeof(transport_session_t));
+    if (!out)
+        return;
+    task_mutex_lock(&transport_lock);
+    memcpy(out, &session, sizeof(transport_session_t));
+    task_mutex_unlock(&transport_lock);
 }
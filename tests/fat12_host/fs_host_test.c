@@ -0,0 +1,134 @@
+/* Host-side FAT12 check: platform/x86/hal_storage.c and src/bcache.c on
+ * a 1.44 MB RAM disk. Built and run by tests/fat12_host/run.sh. */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include "platform.h"
+#include "bcache.h"
+#include "scheduler.h"
+
+#define ROOT_LBA  51
+#define FAT1_LBA  33
+#define FAT2_LBA  42
+
+static uint8_t disk[2880 * 512];
+static int failures;
+
+#define CHECK(cond, what) do { \
+    if (cond) printf("PASS: %s\n", what); \
+    else { printf("FAIL: %s\n", what); failures++; } \
+} while (0)
+
+/* What the kernel links in from the NASM layer and the scheduler. */
+int disk_read_sectors(uint32_t lba, uint32_t count, void *buf) {
+    memcpy(buf, disk + lba * 512, count * 512);
+    return 0;
+}
+int disk_write_sectors(uint32_t lba, uint32_t count, const void *buf) {
+    memcpy(disk + lba * 512, buf, count * 512);
+    return 0;
+}
+int disk_read_sector(uint32_t lba, void *buf) { return disk_read_sectors(lba, 1, buf); }
+int disk_write_sector(uint32_t lba, const void *buf) { return disk_write_sectors(lba, 1, buf); }
+void init_fat12(void) {}
+uint32_t plat_ticks_ms(void) { return 0; }
+void task_mutex_lock(task_mutex_t *m) { (void)m; }
+int task_mutex_trylock(task_mutex_t *m) { (void)m; return 0; }
+void task_mutex_unlock(task_mutex_t *m) { (void)m; }
+void kprint(const char *s) { (void)s; }
+void kprintf(const char *f, ...) { (void)f; }
+
+static uint8_t a[100000], b[100000];
+static uint8_t big[1400000];
+
+int main(void) {
+    uint32_t got, sz;
+    int fd, i, n;
+
+    disk[FAT1_LBA * 512] = 0xF0;             /* media byte, clusters 0/1 reserved */
+    disk[FAT1_LBA * 512 + 1] = 0xFF;
+    disk[FAT1_LBA * 512 + 2] = 0xFF;
+    CHECK(plat_fs_init() == 0, "mount");
+    for (i = 0; i < (int)sizeof(a); i++) a[i] = (uint8_t)(i * 7 + 3);
+
+    CHECK(plat_fs_write("A.BIN", a, 5000) == 0, "write A");
+    CHECK(plat_fs_write("B.BIN", a, 3000) == 0, "write B");
+    CHECK(plat_fs_delete("A.BIN") == 0, "delete A");
+    CHECK(plat_fs_write("C.BIN", a, 20000) == 0, "write C into the hole");
+
+    fd = plat_fs_open("c.bin");
+    for (uint32_t off = 0; off < 20000; off += 777)
+        plat_fs_pread(fd, off, b + off, 777, &got);
+    CHECK(memcmp(a, b, 20000) == 0, "sequential pread");
+    plat_fs_close(fd);
+
+    fd = plat_fs_open("B.BIN");
+    for (uint32_t off = 3000; off < 60000; off += 1000)
+        plat_fs_pwrite(fd, off, a + off, 1000);
+    CHECK(plat_fs_size(fd, &sz) == 0 && sz == 60000, "pwrite extends");
+    memset(b, 0, sizeof b);
+    plat_fs_pread(fd, 0, b, 60000, &got);
+    CHECK(got == 60000 && memcmp(a, b, 60000) == 0, "extended contents");
+    plat_fs_pread(fd, 100, b, 50, &got);
+    CHECK(memcmp(a + 100, b, 50) == 0, "backward pread");
+    plat_fs_close(fd);
+
+    plat_fs_sync();
+    CHECK(memcmp(disk + FAT1_LBA * 512, disk + FAT2_LBA * 512, 9 * 512) == 0, "FAT copies equal");
+    plat_fs_repair();                       /* re-read everything from the disk */
+    memset(b, 0, sizeof b);
+    plat_fs_read("B.BIN", b, sizeof b, &got);
+    CHECK(got == 60000 && memcmp(a, b, 60000) == 0, "contents after remount");
+
+    /* Replacing a file the disk cannot hold keeps the old contents. */
+    plat_file_info_t f[8];
+    uint32_t used = 0;
+    n = plat_fs_list(f, 8);
+    for (i = 0; i < n; i++) used += (f[i].size + 511) / 512;
+    memset(big, 0x5A, sizeof big);
+    CHECK(plat_fs_write("BIG.BIN", big, (2815 - used) * 512 - 512 * 4) == 0, "fill the disk");
+    CHECK(plat_fs_write("B.BIN", big, 60000 + 512 * 8) != 0, "oversized replace fails");
+    memset(b, 0, sizeof b);
+    plat_fs_read("B.BIN", b, sizeof b, &got);
+    CHECK(got == 60000 && memcmp(a, b, 60000) == 0, "old contents kept");
+    CHECK(plat_fs_write("B.BIN", big, 60000 + 512 * 3) == 0, "replace reusing the old clusters");
+    memset(b, 0, sizeof b);
+    plat_fs_read("B.BIN", b, sizeof b, &got);
+    CHECK(got == 60000 + 512 * 3 && memcmp(big, b, got) == 0, "new contents");
+
+    /* Growing past EOF must not expose the freed 0x5A clusters. */
+    int stale = 0;
+    plat_fs_delete("BIG.BIN");
+    plat_fs_write("S.BIN", a, 100);
+    fd = plat_fs_open("S.BIN");
+    CHECK(plat_fs_pwrite(fd, 9000, a, 10) == 0, "sparse pwrite");
+    memset(b, 0xEE, sizeof b);
+    plat_fs_pread(fd, 0, b, 9010, &got);
+    for (i = 100; i < 9000; i++) stale |= b[i];
+    CHECK(got == 9010 && memcmp(a, b, 100) == 0 && memcmp(a, b + 9000, 10) == 0,
+          "sparse file contents");
+    CHECK(stale == 0, "gap reads as zeroes");
+    plat_fs_close(fd);
+
+    /* An entry stored under the pre-fix mangled name ("        LEG"). */
+    uint8_t *root = disk + ROOT_LBA * 512;
+    plat_fs_write("LEGACY.DAT", a, 700);
+    plat_fs_sync();
+    for (i = 0; i < 224 && memcmp(root + i * 32, "LEGACY  DAT", 11); i++) ;
+    memcpy(root + i * 32, "        LEG", 11);
+    plat_fs_repair();
+    memset(b, 0, sizeof b);
+    CHECK(plat_fs_read("legacy.dat", b, sizeof b, &got) == 0 && got == 700 &&
+          memcmp(a, b, 700) == 0, "legacy name readable");
+    CHECK(plat_fs_write("LEGACY.DAT", a + 1, 600) == 0, "legacy rewrite");
+    plat_fs_sync();
+    CHECK(memcmp(root + i * 32, "LEGACY  DAT", 11) == 0, "rewrite renames the entry");
+    CHECK(plat_fs_delete("LEGACY.DAT") == 0, "delete");
+    CHECK(plat_fs_delete("LEGACY.DAT") != 0, "deleted file is gone");
+
+    bcache_stats_t st;
+    bcache_get_stats(&st);
+    printf("cache: %u hits, %u misses, %u written back\n", st.hits, st.misses, st.writebacks);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,11 @@
+#!/bin/bash
+# Host FAT12 check: the kernel's FAT code and sector cache on a RAM disk.
+# Needs only the host gcc (no cross toolchain, nasm or QEMU).
+set -e
+cd "$(dirname "$0")/../.."
+
+OUT="${TMPDIR:-/tmp}/asmos_fs_host_test"
+gcc -std=gnu99 -w -Iinclude -DPLATFORM_X86=1 -o "$OUT" \
+    tests/fat12_host/fs_host_test.c platform/x86/hal_storage.c src/bcache.c
+"$OUT"
+echo "PASS: host FAT12 checks"
@@ -10,6 +10,7 @@ syms=(
     disk_read_sector
     disk_write_sector
     detect_ps2_memory
+    get_boot_params
     sys_read_line
     sys_timer_init
     sys_sound_init
@@ -10,6 +10,7 @@ make all
 
 bash tests/integration/check_fat_chain.sh
 bash tests/integration/check_wiring.sh
+bash tests/fat12_host/run.sh
 
 for sym in _kernel_start fat12_read_file plat_fs_write plat_net_init net_init subsys_init_all; do
     if ! nm build/kernel.elf 2>/dev/null | grep -q " $sym"; then
@@ -0,0 +1,81 @@
+#!/usr/bin/env python3
+"""Symbolize a heap call-site profile ("heapstat sites" in an MM_PROFILE=1 build).
+
+Input is HEAPPROF.TXT as written by the kernel, or text copied off the
+screen. Pass the file name, "-" for stdin, or --image to pull HEAPPROF.TXT
+out of a FAT12 disk image with mcopy.
+"""
+import argparse
+import collections
+import re
+import subprocess
+import sys
+
+SITE_RE = re.compile(r"site\s+(0x[0-9a-fA-F]+)\s+count\s+(\d+)\s+bytes\s+(\d+)(?:\s+age_ms\s+(\d+))?")
+SCREEN_RE = re.compile(r"(0x[0-9a-fA-F]+)\s+(\d+)\s+blocks\s+(\d+)\s+bytes(?:\s+oldest\s+(\d+))?")
+
+
+def parse(text: str):
+    sites = []
+    for line in text.splitlines():
+        m = SITE_RE.search(line) or SCREEN_RE.search(line)
+        if m:
+            sites.append((int(m.group(1), 16), int(m.group(2)), int(m.group(3)),
+                          int(m.group(4) or 0)))
+    return sites
+
+
+def symbolize(elf: str, addrs):
+    """addr -> (function, file:line). Return addresses point past the call, so look up addr-1."""
+    if not addrs:
+        return {}
+    query = "\n".join("0x%x" % max(a - 1, 0) for a in addrs)
+    out = subprocess.run(["addr2line", "-e", elf, "-f", "-C"], input=query,
+                         capture_output=True, text=True, check=True).stdout.splitlines()
+    result = {}
+    for i, a in enumerate(addrs):
+        func = out[2 * i] if 2 * i < len(out) else "??"
+        loc = out[2 * i + 1] if 2 * i + 1 < len(out) else "??:0"
+        result[a] = (func, loc)
+    return result
+
+
+def main() -> int:
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("profile", nargs="?", default="-", help="profile text (default stdin)")
+    ap.add_argument("--elf", default="build/kernel.elf")
+    ap.add_argument("--image", help="read HEAPPROF.TXT from this FAT12 image via mcopy")
+    args = ap.parse_args()
+
+    if args.image:
+        text = subprocess.run(["mcopy", "-n", "-i", args.image, "::HEAPPROF.TXT", "-"],
+                              capture_output=True, text=True, check=True).stdout
+    elif args.profile == "-":
+        text = sys.stdin.read()
+    else:
+        with open(args.profile, encoding="ascii", errors="replace") as f:
+            text = f.read()
+
+    sites = parse(text)
+    if not sites:
+        print("no call sites found in input", file=sys.stderr)
+        return 1
+    syms = symbolize(args.elf, sorted({a for a, _, _, _ in sites if a}))
+
+    modules = collections.defaultdict(lambda: [0, 0])
+    print("%10s %7s %9s  %-28s %s" % ("bytes", "blocks", "age_ms", "function", "location"))
+    for addr, count, nbytes, age in sorted(sites, key=lambda s: -s[2]):
+        func, loc = syms.get(addr, ("(other)", "")) if addr else ("(other)", "")
+        print("%10d %7d %9d  %-28s %s" % (nbytes, count, age, func, loc))
+        module = loc.split(":")[0].rsplit("/", 1)[-1] if loc else "(other)"
+        modules[module][0] += nbytes
+        modules[module][1] += count
+
+    print("\nby module:")
+    for module, (nbytes, count) in sorted(modules.items(), key=lambda m: -m[1][0]):
+        print("%10d %7d  %s" % (nbytes, count, module))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())